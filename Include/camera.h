@@ -10,6 +10,8 @@ namespace xre
 	{
 		glm::mat4 projection;
 		glm::mat4 view;
+		glm::mat4 unjittered_projection;
+		glm::vec2 jitter; // sub-pixel offset the projection moves the image by, in render target pixels
 	};
 
 	class Camera
@@ -28,6 +30,12 @@ namespace xre
 
 		CameraMatrix m_cm;
 
+		// Temporal jitter
+		bool m_jitter_enabled = false;
+		unsigned int m_jitter_index = 0;
+		unsigned int m_jitter_phase_count = 8;
+		float m_render_width = 1.0f, m_render_height = 1.0f;
+
 		void SetCameraOrientation();
 
 	public:
@@ -52,6 +60,11 @@ namespace xre
 			int rightKey = GLFW_KEY_D);
 
 		glm::vec3 GetMouseClickDirection();
+
+		// Offsets the projection by a Halton(2,3) sequence every update, for temporal anti-aliasing / upscaling.
+		// phase_count should grow with the upscale ratio, roughly 8 * (output_width / render_width)^2.
+		// Safe to call every frame, e.g. when dynamic resolution changes the render size.
+		void SetJitter(bool enabled, unsigned int render_width, unsigned int render_height, unsigned int phase_count = 8);
 	};
 }
 #endif // !CAMERA_H
\ No newline at end of file
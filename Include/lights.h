@@ -2,6 +2,8 @@
 #define LIGHTS_H
 
 #include <iostream>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
 #include <shader.h>
 
@@ -16,11 +18,24 @@ namespace xre
 		float m_intensityMultiplier;
 		std::string m_name;
 
+		// The renderer uploads lights again once one of them is dirty. The setters below mark it, code writing
+		// the members directly has to call MarkDirty().
+		bool m_dirty;
+
 		Light();
+		void MarkDirty() { m_dirty = true; }
 		
 		virtual void Translate(const glm::vec3& vector);
 		virtual void SetDirection(const glm::vec3& direction);
 		virtual void SetShaderAttrib(const std::string& lightuniform, const Shader& shader);
+
+	protected:
+		// "<lightuniform><member>" for each member, only rebuilt when lightuniform changes.
+		const std::vector<std::string>& uniformNames(const std::string& lightuniform, const char* const* members, unsigned int member_count);
+
+	private:
+		std::string m_uniform_prefix;
+		std::vector<std::string> m_uniform_names;
 	};
 
 	class DirectionalLight : public Light
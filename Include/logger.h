@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
 
 namespace xre
 {
@@ -32,6 +33,7 @@ namespace xre
 		std::map<int, std::string> m_log_level_mappings;
 		std::map<std::string, int> m_log_string_count;
 		int max_log_string_occurs;
+		std::mutex m_log_mutex; // log() is called from worker threads as well
 
 		LogModule();
 		void printLogMessage(const std::string& m1, const std::string& m2, const std::string& m3);
@@ -0,0 +1,139 @@
+#ifndef MATERIAL_TEXTURES_H
+#define MATERIAL_TEXTURES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <mesh.h>
+#include <shader.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <deque>
+
+// diffuse, specular (metallic for PBR), normal, roughness, occlusion
+#define XRE_MATERIAL_TEXTURE_SLOTS 5
+#define XRE_SSBO_BINDING_MATERIAL_TEXTURES 6
+// Texture units of the array fallback, the fill shaders declare as many samplers.
+#define XRE_MATERIAL_MAX_TEXTURE_ARRAYS 16
+// Layers a new texture array starts with, doubled when it fills up.
+#define XRE_MATERIAL_ARRAY_INITIAL_LAYERS 4
+// Textures pinned at once, each one is copied and unpinned once complete.
+#define XRE_MATERIAL_MAX_PINNED_TEXTURES 8
+// Frames a material texture keeps its copy after it was last drawn, like the streamed mips.
+#define XRE_MATERIAL_KEEP_FRAMES 120
+// Table entry of a slot whose texture found no room, the draw binds it to unit XRE_MATERIAL_BOUND_TEXTURE_UNIT + slot.
+#define XRE_MATERIAL_BOUND_ENTRY 0xFFFFFFFFu
+#define XRE_MATERIAL_BOUND_TEXTURE_UNIT XRE_MATERIAL_MAX_TEXTURE_ARRAYS
+
+namespace xre
+{
+	// Fallback chain, the first one the context supports is picked.
+	enum MATERIAL_TEXTURE_MODE
+	{
+		MATERIAL_TEXTURES_BOUND,	// per draw glBindTexture, the system is off
+		MATERIAL_TEXTURES_ARRAYS,	// GL_TEXTURE_2D_ARRAY per format and size, bound once per pass
+		MATERIAL_TEXTURES_BINDLESS	// GL_ARB_bindless_texture handles
+	};
+
+	// Material texture table for shaders that sample through a material id instead of per draw texture units.
+	// Every material slot is an entry of one SSBO : a bindless handle, or a texture array and a layer.
+	//
+	// Material textures are pinned in the AsyncTextureLoader until they are complete, then copied (into an
+	// immutable texture for a bindless handle, since a handle freezes its texture, or into the layer of the
+	// texture array of their format / size) and unpinned, their source streams out again. Until then a slot
+	// samples a 1x1 texture of the slot's placeholder color. Copies are charged against the loader's memory
+	// budget and released once their materials were not drawn for XRE_MATERIAL_KEEP_FRAMES. A texture
+	// the arrays have no room for is bound by the draws of its materials instead. Must be used on the GL thread.
+	class MaterialTextures
+	{
+	public:
+		// Picks the best mode up to max_mode. Needs the GL context.
+		void create(MATERIAL_TEXTURE_MODE max_mode);
+
+		MATERIAL_TEXTURE_MODE mode() const { return m_mode; }
+		bool enabled() const { return m_mode != MATERIAL_TEXTURES_BOUND; }
+
+		// #define lines (and the bindless extension) the shaders sampling materials are compiled with, empty while the system is off.
+		std::string shaderDefines() const;
+
+		// Material id of the texture set, textures are placed in slots by type.
+		unsigned int acquire(const std::vector<Texture>& textures);
+
+		// The texture was copied, sampling materials does not need its source anymore.
+		bool stored(unsigned int texture_id) const;
+
+		// The material is drawn this frame, call before update().
+		void use(unsigned int material_id);
+
+		// Call once per frame, after the texture loader update.
+		void update();
+
+		// Binds the table (and the arrays), once per pass. Draws only set material_id.
+		void bind(const Shader& shader) const;
+
+		// Some texture of the material is sampled from its source, see bindMaterial.
+		bool bound(unsigned int material_id) const;
+		// Binds the textures of the material that are sampled from their source, per draw.
+		void bindMaterial(unsigned int material_id) const;
+
+	private:
+		struct TextureArray
+		{
+			unsigned int texture = 0;
+			GLenum internal_format = 0;
+			int width = 0, height = 0, levels = 0;
+			unsigned int layers = 0, capacity = 0;
+			size_t layer_bytes = 0;
+			std::vector<unsigned int> free_layers;	// released, below layers
+		};
+
+		struct MaterialTexture
+		{
+			bool ready = false;			// the slot samples the copy, the placeholder otherwise
+			bool bound = false;			// no room for a copy, the draws bind the source
+			bool queued = false;		// waiting or pinned
+			GLuint64 handle = 0;		// bindless
+			unsigned int copy = 0;
+			unsigned int array = 0;		// arrays
+			unsigned int layer = 0;
+			size_t bytes = 0;
+			unsigned int last_used_frame = 0;
+		};
+
+		MATERIAL_TEXTURE_MODE m_mode = MATERIAL_TEXTURES_BOUND;
+
+		std::map<std::vector<unsigned int>, unsigned int> m_material_ids; // slot texture ids, 0 for an empty slot
+		std::vector<std::vector<unsigned int>> m_materials;
+		std::unordered_map<unsigned int, MaterialTexture> m_textures;
+		std::deque<unsigned int> m_waiting;		// not pinned yet
+		std::vector<unsigned int> m_pinned;		// pinned, not ready yet
+
+		std::vector<TextureArray> m_arrays;		// the first one holds the placeholders, one layer per slot
+		unsigned int m_placeholders[XRE_MATERIAL_TEXTURE_SLOTS] = {};
+		GLuint64 m_placeholder_handles[XRE_MATERIAL_TEXTURE_SLOTS] = {};
+
+		unsigned int m_buffer = 0;
+		std::vector<glm::uvec2> m_entries;		// material id * XRE_MATERIAL_TEXTURE_SLOTS + slot
+		std::vector<bool> m_bound_materials;
+		bool m_dirty = false;
+
+		unsigned int m_frame = 0;
+		size_t m_copy_bytes = 0;				// bindless copies and array storage
+
+		bool loadBindlessFunctions();
+		void createPlaceholders();
+		void queue(unsigned int texture_id, MaterialTexture& texture);
+		bool makeReady(unsigned int texture_id, MaterialTexture& texture);
+		bool copyToHandle(unsigned int texture_id, MaterialTexture& texture);
+		bool copyToArray(unsigned int texture_id, MaterialTexture& texture);
+		void release(MaterialTexture& texture);
+		void growArray(TextureArray& array);
+		glm::uvec2 entry(unsigned int texture_id, unsigned int slot) const;
+		void upload();
+	};
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 
 #include <shader.h>
 
@@ -29,6 +30,26 @@ namespace xre
 		glm::vec3 bit_tangent;
 	};
 
+	// GPU vertex layout, 20 bytes instead of the 56 of xre::Vertex. Decoded by the vertex shaders and the
+	// visibility resolve, so every mesh is uploaded this way. The bitangent is rebuilt as cross(normal, tangent) * sign.
+	// There is deliberately no float layout to fall back to : the mesh cache, the static batcher and the meshlet bounds
+	// store quantized data, and a second layout would double every vertex shader variant. xre::Vertex stays the import
+	// and CPU side format, decompress() recovers it.
+	struct CompactVertex
+	{
+		// Position, unorm16 relative to the mesh bounds. w : bitangent sign, 0 for -1 and 65535 for +1
+		glm::u16vec4 position;
+
+		// Normal, octahedral snorm16
+		glm::i16vec2 normal;
+
+		// Texture Coordinates, half floats
+		glm::u16vec2 tex_coords;
+
+		// Tangent, octahedral snorm16
+		glm::i16vec2 tangent;
+	};
+
 	struct Texture
 	{
 		unsigned int id;
@@ -42,26 +63,92 @@ namespace xre
 		glm::vec3 max_v;
 	};
 
+	// Index range of one level of detail, every level shares the vertex buffer. Level 0 is the full mesh.
+	struct MeshLod
+	{
+		unsigned int index_offset;
+		unsigned int index_count;
+		float error; // object space distance the level deviates from the full mesh by, at most
+	};
+
+	// Cluster of consecutive triangles of the full level, culled on the GPU. 64 bytes, laid out as the std430
+	// struct the meshlet cull shader reads. Cone : meshlet is back facing when
+	// dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff, a cutoff of 1 never culls.
+	struct Meshlet
+	{
+		glm::vec3 center;
+		float radius;
+		glm::vec3 cone_axis;
+		float cone_cutoff;
+		glm::vec3 cone_apex;
+		unsigned int index_offset;
+		unsigned int triangle_count;
+		unsigned int padding[3];
+	};
+
+	// Source mesh inside a static batch, drawn with base_vertex since its indices stay local.
+	struct Submesh
+	{
+		BoundingVolume aabb;		// same space as the batch vertices
+		int base_vertex;
+		unsigned int first_lod;		// levels in the batch's lods, index ranges inside the batch index buffer
+		unsigned int lod_count;
+	};
+
 	class Mesh
 	{
 	public:
 		// Mesh Data
-		std::vector<Vertex>			vertices;
-		std::vector<unsigned int>	indices;
+		// Vertex and index data only lives on the GPU once uploaded.
+		unsigned int				vertex_count;
+		unsigned int				index_count;
+		unsigned int				index_type; // GL_UNSIGNED_SHORT while every index fits
 		std::vector<Texture>		textures;
+		std::vector<MeshLod>		lods;
+		unsigned int				meshlet_count;
+		std::vector<Submesh>		submeshes; // static batches only
 		BoundingVolume aabb;
 
 		// Mesh Constructor
 		Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures, BoundingVolume aabb);
+		// Compresses the vertices, then uploads like the constructor below.
+		Mesh(const Vertex* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count, const std::vector<Texture>& textures, BoundingVolume aabb,
+			const MeshLod* lods = NULL, unsigned int lod_count = 0, const Meshlet* meshlets = NULL, unsigned int meshlet_count = 0,
+			const Submesh* submeshes = NULL, unsigned int submesh_count = 0);
+		// Uploads straight from memory the caller owns, e.g. a memory mapped mesh cache. vertices and positions come from
+		// compress, aabb is the bounds they were quantized to.
+		// lods : index ranges inside indices, the whole buffer is one level when there are none.
+		// meshlets : clusters of the first level, the mesh is only culled whole when there are none.
+		// submeshes : static batch parts, each with its own levels in lods.
+		Mesh(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+			const std::vector<Texture>& textures, const BoundingVolume& aabb, const MeshLod* lods = NULL, unsigned int lod_count = 0,
+			const Meshlet* meshlets = NULL, unsigned int meshlet_count = 0, const Submesh* submeshes = NULL, unsigned int submesh_count = 0);
 
 		void draw(const Shader& shader, const std::string model_name, const glm::mat4& model_matrix, const bool& is_dynamic);
 
+		// Deletes the GL objects. The mesh must not be in the draw queue anymore.
+		void release();
+
+		// Sets the uniforms the vertex shaders decode CompactVertex::position with.
+		static void setPositionDecode(const Shader& shader, const BoundingVolume& aabb);
+
+		// Quantizes the vertices to the GPU layout and the position only stream. aabb is grown to enclose every vertex.
+		// Touches no GL state, so it runs at import on the thread pool.
+		static void compress(const Vertex* vertices, unsigned int vertex_count, BoundingVolume& aabb, std::vector<CompactVertex>& compact_vertices, std::vector<glm::u16vec4>& positions);
+		static Vertex decompress(const CompactVertex& vertex, const BoundingVolume& aabb);
+
 	private:
 		unsigned int VAO, VBO, EBO;
+		unsigned int depth_VAO, depth_VBO; // tightly packed positions, shares the EBO
+		unsigned int meshlet_buffer; // shader storage, read by the meshlet cull pass
 		bool setup_success;
 		static std::vector<std::string> texture_types;
 
-		void setupMesh();
+		void create(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+			const std::vector<Texture>& textures, const BoundingVolume& aabb, const MeshLod* lods, unsigned int lod_count,
+			const Meshlet* meshlets, unsigned int meshlet_count, const Submesh* submeshes, unsigned int submesh_count);
+		void setupMesh(const CompactVertex* vertices, const glm::u16vec4* positions, const unsigned int* indices, const Meshlet* meshlets);
+		static CompactVertex compress(const Vertex& vertex, const BoundingVolume& aabb);
 	};
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <mesh.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Bump whenever the file layout or the extracted vertex data changes.
+#define XRE_MESH_CACHE_VERSION 5
+#define XRE_MESH_CACHE_EXTENSION ".xremesh"
+
+// diffuse, specular (metallic), normal, roughness
+#define XRE_MESH_CACHE_TEXTURE_SLOTS 4
+
+namespace xre
+{
+	// Read only, memory mapped view of a whole file.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& file_path);
+		void close();
+
+		const unsigned char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		const unsigned char* m_data = NULL;
+		size_t m_size = 0;
+
+#ifdef _WIN32
+		void* m_file = NULL;
+		void* m_mapping = NULL;
+#else
+		int m_file = -1;
+#endif
+	};
+
+	// Mesh as extracted from the importer, already in the GPU layout (Mesh::compress), written to the cache.
+	struct MeshData
+	{
+		std::vector<CompactVertex> vertices;
+		std::vector<glm::u16vec4> positions;
+		std::vector<unsigned int> indices; // every level of detail, back to back
+		std::vector<MeshLod> lods;
+		std::vector<Meshlet> meshlets; // clusters of the full level
+		BoundingVolume aabb; // the positions are quantized to it
+		std::string texture_paths[XRE_MESH_CACHE_TEXTURE_SLOTS];
+	};
+
+	// Mesh inside an open cache. vertices, positions and indices point into the mapping, ready for glBufferData.
+	struct CachedMesh
+	{
+		const CompactVertex* vertices = NULL;
+		const glm::u16vec4* positions = NULL;
+		unsigned int vertex_count = 0;
+		const unsigned int* indices = NULL;
+		unsigned int index_count = 0;
+		const MeshLod* lods = NULL;
+		unsigned int lod_count = 0;
+		const Meshlet* meshlets = NULL;
+		unsigned int meshlet_count = 0;
+		BoundingVolume aabb;
+		std::string texture_paths[XRE_MESH_CACHE_TEXTURE_SLOTS];
+	};
+
+	// Versioned binary cache of a model's GPU ready vertex / index data, keyed by the source file hash and the
+	// post process flags it was imported with.
+	class MeshCache
+	{
+	public:
+		static std::string cachePath(const std::string& source_path);
+		static uint64_t hashFile(const std::string& file_path);
+		// hashFile of the model, combined with the hashes of the material libraries it references.
+		static uint64_t hashSource(const std::string& file_path);
+		static bool write(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_flags, const std::vector<MeshData>& meshes);
+
+		// Fails on a missing, stale or corrupt cache.
+		bool open(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_flags);
+		const std::vector<CachedMesh>& meshes() const { return m_meshes; }
+
+	private:
+		MappedFile m_file;
+		std::vector<CachedMesh> m_meshes;
+	};
+}
+
+#endif
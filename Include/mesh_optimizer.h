@@ -0,0 +1,68 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <mesh.h>
+
+#include <vector>
+
+// Simulated post-transform cache the triangle order is optimized for.
+#define XRE_MESH_OPTIMIZER_CACHE_SIZE 32
+// FIFO cache used to measure the order and to find cluster boundaries.
+#define XRE_MESH_OPTIMIZER_FIFO_SIZE 16
+// Clusters may cost this much more vertex cache misses than the optimized order, in exchange for less overdraw.
+#define XRE_MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+// Levels of detail, the full mesh included.
+#define XRE_MESH_LOD_MAX_LEVELS 5
+// Triangle count of each level against the previous one.
+#define XRE_MESH_LOD_REDUCTION 0.5f
+// No level below this many triangles.
+#define XRE_MESH_LOD_MIN_TRIANGLES 64
+// Largest simplification error, relative to the mesh bounds diagonal.
+#define XRE_MESH_LOD_MAX_ERROR 0.05f
+
+// Meshlet limits, sized for a 64 wide wave to transform one meshlet.
+#define XRE_MESHLET_MAX_VERTICES 64
+#define XRE_MESHLET_MAX_TRIANGLES 124
+// Normal cones spreading wider than this (cosine of the largest angle to the axis) never cull.
+#define XRE_MESHLET_MIN_CONE_SPREAD 0.1f
+
+namespace xre
+{
+	// Import time reordering of triangle lists. Results are written to the mesh cache, so this runs once per model.
+	class MeshOptimizer
+	{
+	public:
+		// Cache, then overdraw, then fetch optimization.
+		static void optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+		// Forsyth, "Linear-Speed Vertex Cache Optimisation".
+		static void optimizeVertexCache(unsigned int* indices, unsigned int index_count, unsigned int vertex_count);
+
+		// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+		// Splits the cache optimized order into clusters and draws the outward facing ones first, view independently.
+		static void optimizeOverdraw(unsigned int* indices, unsigned int index_count, const Vertex* vertices, unsigned int vertex_count, float threshold);
+
+		// Renumbers the vertices in the order the indices first reference them.
+		static void optimizeVertexFetch(Vertex* vertices, unsigned int vertex_count, unsigned int* indices, unsigned int index_count);
+
+		// Garland and Heckbert quadric error edge collapse. Vertices only collapse onto existing vertices, so every
+		// level shares the vertex buffer. Vertices on attribute seams (uv or normal splits) and open borders never
+		// move. Returns the largest error introduced, as a distance.
+		static float simplify(const Vertex* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+			unsigned int target_index_count, float target_error, std::vector<unsigned int>& result);
+
+		// Splits the triangle list, in its current order, into runs of at most XRE_MESHLET_MAX_VERTICES unique
+		// vertices and XRE_MESHLET_MAX_TRIANGLES triangles, with a bounding sphere and a normal cone each.
+		// The vertex cache order is already spatially coherent, so the index buffer is left as it is.
+		static void buildMeshlets(const std::vector<Vertex>& vertices, const unsigned int* indices, unsigned int index_count, std::vector<Meshlet>& meshlets);
+
+		// Appends the coarser levels to indices. lods[0] is the full mesh.
+		static void buildLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<MeshLod>& lods);
+
+		// Average transformed vertices per triangle, with a FIFO cache.
+		static float averageCacheMissRatio(const unsigned int* indices, unsigned int index_count, unsigned int vertex_count, unsigned int cache_size);
+	};
+}
+
+#endif
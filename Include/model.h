@@ -6,6 +6,8 @@
 #include <assimp/postprocess.h>
 
 #include <mesh.h>
+#include <mesh_cache.h>
+#include <texture_compressor.h>
 #include <shader.h>
 
 #include <string>
@@ -24,11 +26,24 @@ namespace xre
 
 		Model(const std::string& file_path,const std::string& name,unsigned int = aiProcess_Triangulate);
 		void draw(const Shader& model_shader,const std::string& model_name);
+		// Another placement of the same meshes. The renderer draws placements of a mesh that are visible together
+		// as one instanced draw. instance_matrix must outlive the draw queue.
+		void draw(const Shader& model_shader, const std::string& model_name, const glm::mat4& instance_matrix);
 		
 		void translate(glm::vec3 translation);
 		void rotate(float amount, glm::vec3 axes);
 		void scale(glm::vec3 axes);
 
+		// Drops this model's references in the TextureRegistry. Call once the model is no longer drawn.
+		void releaseTextures();
+
+		// Scene build steps that need the CPU side mesh data read it back from the mesh cache,
+		// the cached meshes are in the same order as getMeshes().
+		bool openMeshCache(MeshCache& cache) const;
+		const std::vector<Mesh*>& getMeshes() const { return meshes; }
+		// Deletes the meshes, e.g. once a static batch has taken them over. Must happen before draw().
+		void releaseMeshes();
+
 		bool dynamic;
 		glm::mat4 model_matrix;
 
@@ -37,13 +52,19 @@ namespace xre
 		std::string model_name;
 		std::string directory;
 		std::vector<Texture> loaded_textures;
+		std::string cache_path;
+		uint64_t source_hash;
+		unsigned int post_process_options;
 
 		bool setup_success;
 
-		void processNode(aiNode* node);
-		Texture loadTextureFromPath(aiMaterial* material, aiTextureType texture_type, const std::string& texture_type_name);
-		Mesh* extractMeshData(aiMesh* ai_mesh);
-		unsigned int GetTexture(const std::string& texture_path, bool gamma = false);
+		bool loadFromCache(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_options);
+		void processNode(aiNode* node, std::vector<aiMesh*>& ai_meshes);
+		bool extractMeshData(aiMesh* ai_mesh, MeshData& mesh_data);
+		Mesh* createMesh(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count, const MeshLod* lods, unsigned int lod_count,
+			const Meshlet* meshlets, unsigned int meshlet_count, const BoundingVolume& aabb, const std::string* texture_paths);
+		Texture loadTexture(const std::string& texture_path, const std::string& texture_type_name, TEXTURE_USAGE usage, const unsigned char placeholder[4]);
+		unsigned int GetTexture(const std::string& texture_path, TEXTURE_USAGE usage, const unsigned char placeholder[4]);
 
 		std::vector<Mesh*> meshes;
 	};
@@ -7,13 +7,50 @@
 #include <mesh.h>
 #include <shader.h>
 #include <lights.h>
+#include <material_textures.h>
 
 
 #include <string>
 #include <vector>
+#include <tuple>
 #include <random>
 
 #define XRE_MAX_POINT_SHADOW_MAPS 3
+#define XRE_BLOOM_MIP_LEVELS 6
+#define XRE_SSAO_RESOLUTION_DIVISOR 2
+#define XRE_SSAO_KERNEL_SIZE 8
+#define XRE_UBO_BINDING_SSAO_KERNEL 0
+#define XRE_GPU_TIMER_QUERIES 4
+#define XRE_SSBO_BINDING_VISIBILITY_VERTICES 0
+#define XRE_SSBO_BINDING_VISIBILITY_INDICES 1
+#define XRE_SSBO_BINDING_MESHLETS 2
+#define XRE_SSBO_BINDING_MESHLET_COMMANDS 3
+#define XRE_SSBO_BINDING_MESHLET_COUNTS 4
+#define XRE_MESHLET_CULL_GROUP_SIZE 64
+#define XRE_SSBO_BINDING_INSTANCES 5
+#define XRE_UBO_BINDING_FRAME 1
+#define XRE_UBO_BINDING_LIGHTS 2
+// Frames the frame constants are written ahead of the GPU, each one into its own slot
+#define XRE_FRAME_UNIFORM_SLOTS 3
+// MAX_POINT_LIGHTS of the shaders reading the Lights block
+#define XRE_MAX_POINT_LIGHTS 20
+#define XRE_SSBO_BINDING_OBJECTS 7
+// Frames in flight the object buffer has a region for, each guarded by a fence
+#define XRE_OBJECT_BUFFER_FRAMES 3
+
+// Visibility buffer id : draw index << XRE_VISIBILITY_TRIANGLE_BITS | triangle index, all ones is empty
+#define XRE_VISIBILITY_TRIANGLE_BITS 23
+#define XRE_VISIBILITY_MAX_DRAWS ((1u << (32 - XRE_VISIBILITY_TRIANGLE_BITS)) - 1)
+
+// Coarsest level of detail whose simplification error projects to at most this many pixels
+#define XRE_LOD_PIXEL_ERROR 1.0f
+// A coarser level is only picked once it fits this fraction below the pixel error, stops popping at the boundary
+#define XRE_LOD_HYSTERESIS 0.25f
+// Shadow maps draw this many levels coarser than the camera
+#define XRE_LOD_SHADOW_BIAS 1
+
+// Best material texture mode the deferred pipeline may use, MATERIAL_TEXTURES_BOUND keeps per draw texture binding
+#define XRE_MATERIAL_TEXTURE_MODE MATERIAL_TEXTURES_BINDLESS
 
 namespace xre
 {
@@ -23,6 +60,7 @@ namespace xre
 	{
 		DEFERRED,
 		FORWARD,
+		VISIBILITY, // triangle ids + depth, materials resolved per pixel in compute, deferred lighting
 		DEBUG_MODE,
 	};
 	enum LIGHTING_MODE
@@ -30,6 +68,33 @@ namespace xre
 		PBR,
 		BLINNPHONG
 	};
+	enum AMBIENT_OCCLUSION_MODE
+	{
+		AO_DISABLED,
+		AO_SSAO,
+		AO_GTAO
+	};
+	enum DEPTH_PREPASS_MODE
+	{
+		PREPASS_OFF,
+		PREPASS_ON,
+		PREPASS_AUTO // on while the visible triangle count is small next to the pixel count
+	};
+	// GLSL blocks Renderer::shaderPreamble declares, combined as flags
+	enum SHADER_PREAMBLE
+	{
+		SHADER_PREAMBLE_FRAME = 1 << 0,				// Frame uniform block
+		SHADER_PREAMBLE_OBJECTS = 1 << 1,			// Objects storage block, object_id, DecodePosition and DecodeOctahedral
+		SHADER_PREAMBLE_POSITION_UNIFORMS = 1 << 2	// DecodePosition from the Mesh::setPositionDecode uniforms and DecodeOctahedral, instead of OBJECTS
+	};
+
+	// glMultiDrawElementsBaseVertex arguments
+	struct draw_ranges
+	{
+		std::vector<GLsizei> counts;
+		std::vector<const void*> offsets;
+		std::vector<GLint> base_vertices;
+	};
 
 	struct model_information
 	{
@@ -37,13 +102,36 @@ namespace xre
 		std::string model_name = "";
 		bool dynamic;
 		unsigned int object_VAO = 0;
+		unsigned int depth_VAO = 0; // positions only, for the depth and shadow passes
+		unsigned int vertex_buffer = 0, index_buffer = 0; // read directly by the visibility resolve
 		unsigned int indices_size = 0;
+		unsigned int index_type = GL_UNSIGNED_INT;
+		const std::vector<MeshLod>* lods = NULL; // index ranges inside the index buffer, level 0 is the full mesh
+		unsigned int lod = 0, shadow_lod = 0; // levels picked this frame for the camera and the shadow passes
+		unsigned int meshlet_buffer = 0, meshlet_count = 0; // clusters of level 0
+		unsigned int meshlet_commands = 0; // first indirect command of the draw in the meshlet command buffer
+		bool meshlets_culled = false; // the camera passes draw the surviving meshlets this frame
+		const std::vector<Submesh>* submeshes = NULL; // static batches, culled and given levels of detail one by one
+		std::vector<unsigned int> submesh_lods;
+		draw_ranges camera_ranges, shadow_ranges; // rebuilt every frame
 		const xre::Shader* object_shader = NULL;
 		const glm::mat4* object_model_matrix = NULL;
 		std::vector<Texture>* object_textures = NULL;
 		std::vector<std::string>* texture_types = NULL;
 		BoundingVolume mesh_aabb;
 		bool frustum_cull = false;
+		glm::mat4 previous_model_matrix = glm::mat4(1.0f);
+		bool alpha_tested = false; // diffuse texture has an alpha channel, needs the discarding pre-pass shader
+		unsigned int diffuse_texture = 0;
+		unsigned int material_id = 0; // MaterialTextures table entry, while the system is on
+		bool alpha_resolved = false; // false while the diffuse texture is still a streaming placeholder
+		float view_distance = 0.0f; // camera to the closest point of the world space bounds, sort key
+		// Instancing, rebuilt every frame : 1 draws alone, more draws the whole group from the instance buffer,
+		// 0 is drawn by the group's first entry (instance_leader)
+		unsigned int instance_count = 1;
+		unsigned int instance_offset = 0;
+		unsigned int instance_leader = 0;
+		unsigned int object_id = 0; // object buffer entry, stays with the entry when the draw queue is sorted
 	};
 
 #pragma endregion
@@ -64,11 +152,101 @@ namespace xre
 			glm::mat4 point_light_space_matrix_5;
 		};
 
+		struct draw_elements_indirect_command
+		{
+			unsigned int count;
+			unsigned int instance_count;
+			unsigned int first_index;
+			int base_vertex;
+			unsigned int base_instance;
+		};
+
+		// std430 layout of the instance buffer
+		struct instance_data
+		{
+			glm::mat4 model;
+			glm::mat4 previous_model;
+		};
+
+		// vertex array, level, shader, textures
+		typedef std::tuple<unsigned int, unsigned int, const Shader*, const std::vector<Texture>*> instance_key;
+
+		// std430 layout of the object buffer
+		struct object_data
+		{
+			glm::mat4 model;
+			glm::mat4 previous_model;
+			glm::mat4 normal_matrix;
+			glm::vec4 position_min;
+			glm::vec4 position_extent;
+			unsigned int material_id;
+			unsigned int padding[3];
+		};
+
+		// GLSL declaration of object_data, change both together
+		static const char* const object_block;
+
+		// std140 layout of the Frame uniform block
+		struct frame_uniforms
+		{
+			glm::mat4 view;
+			glm::mat4 projection;
+			glm::mat4 inv_view;
+			glm::mat4 inv_projection;
+			glm::mat4 unjittered_view_projection;
+			glm::mat4 previous_view_projection;
+			glm::mat4 directional_light_space_matrix;
+			glm::vec3 camera_position;
+			float near_plane;				// of the shadow maps
+			glm::vec3 camera_look_direction;
+			float far_plane;
+			float positive_exponent;
+			float negative_exponent;
+			float padding[2];
+		};
+
+		// GLSL declaration of frame_uniforms, change both together
+		static const char* const frame_block;
+
+		// std140 layout of the Lights uniform block, and of the DirectionalLight and PointLight structs in it
+		struct directional_light_uniforms
+		{
+			glm::vec3 position;
+			float padding_0;
+			glm::vec3 direction;
+			float padding_1;
+			glm::vec3 color;
+			float padding_2;
+		};
+
+		struct point_light_uniforms
+		{
+			glm::vec3 position;
+			float padding_0;
+			glm::vec3 color;
+			float kc;
+			float kl;
+			float kq;
+			float padding_1[2];
+		};
+
+		struct light_uniforms
+		{
+			int point_light_count;
+			unsigned int directional_lighting_enabled;
+			float padding[2];
+			directional_light_uniforms directional_light;
+			point_light_uniforms point_lights[XRE_MAX_POINT_LIGHTS];
+		};
+
 #pragma endregion
 
 #pragma region Functions
 
 		void sortDrawQueue();
+		void updateTextureStreaming();
+		void updateLods();
+		void updateSubmeshRanges();
 		void createForwardFramebuffers();
 		void createDeferredBuffers();
 		void createShadowMapFramebuffers();
@@ -77,25 +255,53 @@ namespace xre
 		void createDirectionalLightMatrix(glm::vec3 light_position, glm::vec3 light_front);
 		void createPointLightMatrices(glm::vec3 light_position, unsigned int light_index);
 		void createBlurringFramebuffers();
+		void createBloomMipChain();
 		void clearForwardFramebuffer();
 		void clearDefaultFramebuffer();
 		void clearDirectionalShadowMapFramebuffer();
 		void clearDirectionalShadowBlurringFramebuffers();
 		void clearPointShadowFramebuffer();
-		void clearPrimaryBlurringFramebuffers();
 		void directionalShadowPass();
 		void pointShadowPass();
 		void ForwardColorPass();
+		void depthPrepass(float alpha_cutoff);
+		void createMeshletCullData();
+		void meshletCullPass();
+		void createInstanceBuffer();
+		void buildInstanceGroups();
+		void createUniformBuffers();
+		void createObjectBuffer(unsigned int capacity);
+		void updateObjectData();
+		void waitForFence(GLsync& fence);
+		void fenceFrame();
+		void updateFrameUniforms();
+		void updateLightUniforms();
+		void drawCameraView(const model_information& model_info);
+		void drawShadowView(const model_information& model_info);
+		void drawPositionOnly(const Shader& opaque_shader, const Shader& alpha_tested_shader, float alpha_cutoff);
+		void createVisibilityBuffer();
+		void visibilityPass();
+		void visibilityResolvePass();
+		glm::ivec4 getScreenRect(const model_information& model_info, const glm::mat4& view_projection) const;
+		bool useDepthPrepass(DEPTH_PREPASS_MODE mode, float max_triangles_per_pixel, unsigned int pixels) const;
 		void deferredFillPass();
 		void deferredColorPass();
-		void blurPass(unsigned int main_color_texture, unsigned int ssao_texture, unsigned int amount);
+		void BloomPass(unsigned int bright_color_texture);
+		void createTAAFramebuffers();
+		void beginGPUTimer();
+		void endGPUTimer();
+		void updateDynamicResolution();
+		glm::vec2 getRenderUVScale() const;
+		void TAAResolvePass();
 		void SoftShadowPass(unsigned int amount);
 		void SSAOPass();
 		void createSSAOData();
+		void DepthPyramidPass();
+		void GTAOPass();
+		void createGTAOData();
 		void createSSAOKernel(unsigned int num_samples);
-		void createSSAONoise();
 
-		Renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode);
+		Renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode, float render_scale_p);
 
 #pragma endregion
 
@@ -108,6 +314,23 @@ namespace xre
 
 		unsigned int framebuffer_width, framebuffer_height;
 
+		// Internal resolution of the deferred pipeline, upscaled to the framebuffer by the TAA resolve or the composite.
+		// Targets are allocated once at render_target size, each frame renders into a render_width x render_height viewport.
+		float render_scale;
+		unsigned int render_width, render_height;
+		unsigned int render_target_width, render_target_height;
+
+		// Dynamic resolution
+		bool dynamic_resolution_enabled = false;
+		float dynamic_resolution_target_ms = 16.0f;
+		float dynamic_resolution_min_scale = 0.5f;
+		unsigned int gpu_timer_queries[XRE_GPU_TIMER_QUERIES];
+		float gpu_timer_scales[XRE_GPU_TIMER_QUERIES] = {};	// render scale of the frame each query measures
+		unsigned int gpu_timer_frame = 0;
+		float gpu_frame_time_ms = 0.0f;
+		float gpu_frame_time_scale = 1.0f;
+		bool gpu_frame_time_fresh = false;
+
 		// Forward Shading
 		unsigned int
 			ForwardFramebuffer,
@@ -121,15 +344,68 @@ namespace xre
 		unsigned int DeferredDataFrameBuffer,
 			DeferredFinalBuffer;
 
-		unsigned int DeferredRenderBuffer;
-
 		unsigned int DeferredFinal_primary_texture,
 			DeferredFinal_secondary_texture;
 
+		// G-Buffer layout
+		// color    : RGBA8   - albedo, metallic (PBR) / specular (BlinnPhong)
+		// normal   : RGB10A2 - octahedral world normal, roughness, flags
+		// occlusion: R8      - material occlusion (PBR only)
+		// velocity : RG16F   - always the last attachment
+		// depth    : DEPTH24 - hardware depth, positions are reconstructed from it
 		unsigned int DeferredGbuffer_depth,
 			DeferredGbuffer_color,
 			DeferredGbuffer_normal,
-			DeferredGbuffer_texture_mor;
+			DeferredGbuffer_occlusion,
+			DeferredGbuffer_velocity;
+
+		// Depth pre-pass, the color passes that follow use GL_EQUAL without depth writes
+		DEPTH_PREPASS_MODE deferred_depth_prepass_mode = DEPTH_PREPASS_MODE::PREPASS_AUTO;
+		DEPTH_PREPASS_MODE forward_depth_prepass_mode = DEPTH_PREPASS_MODE::PREPASS_AUTO;
+		bool depth_prepass_active = false;
+
+		// Level of detail selection
+		float lod_pixel_error = XRE_LOD_PIXEL_ERROR;
+		float lod_hysteresis = XRE_LOD_HYSTERESIS;
+		unsigned int shadow_lod_bias = XRE_LOD_SHADOW_BIAS;
+
+		// Meshlet culling, survivors are compacted into one indirect command range per draw
+		unsigned int MeshletCommand_buffer, MeshletCount_buffer;
+		unsigned int meshlet_command_capacity = 0, meshlet_count_capacity = 0;
+		bool meshlet_culling = true;
+		bool meshlet_occlusion_culling = false;
+
+		// Instancing, matrices of every group with more than one visible entry
+		unsigned int Instance_buffer;
+		unsigned int instance_capacity = 0;
+		bool instancing = true;
+		std::vector<instance_data> instances;
+
+		// Frame constants and lights, bound once for every program. The frame block cycles through
+		// XRE_FRAME_UNIFORM_SLOTS fenced slots, lights are only written when one of them changed.
+		unsigned int Frame_UBO, Lights_UBO;
+		unsigned int frame_uniform_stride = 0;
+		unsigned int frame_uniform_slot = 0;
+		GLsync frame_uniform_fences[XRE_FRAME_UNIFORM_SLOTS] = {};
+		bool lights_dirty = true;
+
+		// Per object data, persistently mapped with a region per frame in flight. objects holds what was last
+		// written for each object, object_pending the regions that still have to be brought up to date.
+		unsigned int Object_buffer = 0;
+		unsigned char* object_buffer_mapping = NULL;
+		unsigned int object_capacity = 0;
+		unsigned int object_region_size = 0;
+		unsigned int object_region = 0;
+		GLsync object_fences[XRE_OBJECT_BUFFER_FRAMES] = {};
+		std::vector<object_data> objects;
+		std::vector<unsigned int> object_pending;
+
+		// Material textures of the deferred fill and its alpha tested pre-pass, off in the other pipelines
+		MaterialTextures material_textures;
+
+		// Visibility Buffer, shares the G-Buffer depth
+		unsigned int VisibilityFramebuffer,
+			Visibility_id_texture;
 
 		unsigned int num_draw_buffers;
 		unsigned int DeferredFrameBuffer_primary_color_attachments[4];
@@ -160,37 +436,85 @@ namespace xre
 		unsigned int SSAOFrameBuffer;
 		unsigned int SSAOFramebuffer_color;
 
-		std::vector<glm::vec3> ssao_kernel;
-		std::vector<glm::vec3> ssao_noise;
+		// Half resolution linear depth, AO + depth history (ping-pong)
+		unsigned int SSAODepthFramebuffer,
+			SSAO_linear_depth_texture;
+		unsigned int SSAOHistoryFramebuffers[2],
+			SSAO_history_textures[2];
+		unsigned int ssao_width, ssao_height;
+		unsigned int ssao_history_index = 0;
+		unsigned int ssao_frame_index = 0;
+		bool ssao_history_valid = false;
+
+		std::vector<glm::vec4> ssao_kernel;
+		unsigned int ssao_kernel_UBO;
+
+		glm::mat4 previous_view_projection;
+		glm::vec2 ssao_history_uv_scale = glm::vec2(1.0f);
+
+		AMBIENT_OCCLUSION_MODE ambient_occlusion_mode = AMBIENT_OCCLUSION_MODE::AO_SSAO;
+
+		// Linear depth pyramid (r : closest, g : farthest), full mip chain
+		unsigned int DepthPyramid_texture;
+		unsigned int depth_pyramid_levels;
+		bool depth_pyramid_valid = false; // built last frame, the meshlet occlusion test can read it
+		glm::vec2 depth_pyramid_size = glm::vec2(0.0f); // rendered region of level 0 when it was built
+
+		// GTAO (rgb : bent normal, a : visibility)
+		unsigned int GTAO_texture;
+		unsigned int gtao_frame_index = 0;
 
 #pragma endregion
 
 #pragma region Additional Effects Data
 
-		// PrimaryBlurring Buffers
-		unsigned int PrimaryBlurringFramebuffers[2],
-			PrimaryBlurringFramebuffer_bloom_textures[2],
-			PrimaryBlurringFramebuffer_ssao_textures[2],
-			PrimaryBlurringFramebuffers_attachments[2];
+		// Bloom Mip Chain (progressive downsample / upsample)
+		unsigned int BloomFramebuffer,
+			Bloom_mip_chain_texture;
+
+		unsigned int bloom_mip_width[XRE_BLOOM_MIP_LEVELS],
+			bloom_mip_height[XRE_BLOOM_MIP_LEVELS];
+		float bloom_filter_radius;
+
+		// TAA history (output resolution, ping-pong)
+		unsigned int TAAFramebuffers[2],
+			TAA_history_textures[2];
+		unsigned int taa_history_index = 0;
+		unsigned int taa_resolved_texture;
+		bool taa_enabled = false;
+		bool taa_history_valid = false;
+
+		glm::mat4 previous_unjittered_view_projection = glm::mat4(1.0f);
 
 		// DirectionalShadowBlur Buffers
 		unsigned int DirectionalShadowBlurringFramebuffers[2],
 			DirectionalShadowBlurring_soft_shadow_textures[2];
 
-		unsigned int random_rotation_texture;
 		float positive_exponent, negative_exponent;
 
 #pragma endregion
 
 #pragma region Shaders
 
+		Shader depth_prepass_Shader;
+		Shader depth_prepass_alpha_Shader;
+		Shader visibilityShader;
+		Shader visibility_alpha_Shader;
+		Shader visibility_resolve_Shader;
 		Shader deferredFillShader;
 		Shader deferredColorShader;
 		Shader SSAOShader;
 		Shader quadShader;
 		Shader depthShader_point;
 		Shader depthShader_directional;
-		Shader bloomSSAO_blur_Shader;
+		Shader SSAO_depth_downsample_Shader;
+		Shader SSAO_upsample_Shader;
+		Shader depth_pyramid_Shader;
+		Shader meshlet_cull_Shader;
+		Shader GTAOShader;
+		Shader TAAShader;
+		Shader bloom_downsample_Shader;
+		Shader bloom_upsample_Shader;
 		Shader directional_shadow_blur_Shader;
 		Shader debugShader;
 
@@ -230,6 +554,10 @@ namespace xre
 		const glm::mat4* camera_projection_matrix;
 		const glm::vec3* camera_position;
 		const glm::vec3* camera_front;
+		const glm::mat4* camera_unjittered_projection_matrix;
+		const glm::vec2* camera_jitter;
+
+		glm::vec2 no_jitter = glm::vec2(0.0f);
 
 #pragma endregion
 	
@@ -242,16 +570,39 @@ namespace xre
 	public:
 
 		static Renderer* renderer();
-		static Renderer* renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode);
+		static Renderer* renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode, float render_scale_p = 1.0f);
 
 		Renderer(Renderer& other) = delete;
 		Renderer() = delete;
 		
-		void pushToDrawQueue(unsigned int vertex_array_object, unsigned int indices_size, const xre::Shader& object_shader, const glm::mat4& model_matrix, std::vector<Texture>* object_textures, std::vector<std::string>* texture_types, std::string model_name, bool isdynamic, bool* setup_success, BoundingVolume aabb);
+		void pushToDrawQueue(unsigned int vertex_array_object, unsigned int depth_vertex_array_object, unsigned int vertex_buffer_object, unsigned int element_buffer_object, unsigned int indices_size, unsigned int index_type, const std::vector<MeshLod>* lods, unsigned int meshlet_buffer, unsigned int meshlet_count, const std::vector<Submesh>* submeshes, const xre::Shader& object_shader, const glm::mat4& model_matrix, std::vector<Texture>* object_textures, std::vector<std::string>* texture_types, std::string model_name, bool isdynamic, bool* setup_success, BoundingVolume aabb);
 		void Render();
 		void StartOptimizationThreads();
-		void setCameraMatrices(const glm::mat4* view, const glm::mat4* projection, const glm::vec3* position, const glm::vec3* front);
+		void setCameraMatrices(const glm::mat4* view, const glm::mat4* projection, const glm::vec3* position, const glm::vec3* front,
+			const glm::mat4* unjittered_projection = NULL, const glm::vec2* jitter = NULL);
+		void setTemporalAntiAliasing(bool enabled);
+		bool getTemporalAntiAliasing() const;
+		void setDynamicResolution(bool enabled, float target_gpu_time_ms = 16.0f, float min_render_scale = 0.5f);
+		float getGPUFrameTime() const;
+		unsigned int getRenderWidth() const;
+		unsigned int getRenderHeight() const;
 		void addToLights(Light* light);
+		void setAmbientOcclusionMode(AMBIENT_OCCLUSION_MODE mode);
+		void setDepthPrepassMode(RENDER_PIPELINE pipeline, DEPTH_PREPASS_MODE mode);
+		void setLodSelection(float max_pixel_error, float hysteresis, unsigned int shadow_lod_bias);
+		// occlusion_culling : also test against the previous frame's depth pyramid, only built while GTAO is on
+		void setMeshletCulling(bool enabled, bool occlusion_culling = false);
+		void setInstancing(bool enabled);
+
+		// pixels_per_unit : screen pixels covered by one unit at distance one, projection[1][1] * height / 2
+		// Static batches get level 0, drawElements draws their submeshes at the level or their coarsest one.
+		static unsigned int selectLod(const model_information& model_info, const glm::vec3& eye, float pixels_per_unit, float max_pixel_error);
+		static void drawElements(const model_information& model_info, unsigned int lod);
+		// Sets the instanced / instance_offset uniforms of the vertex shaders that read the instance buffer.
+		static void setInstanceUniforms(const Shader& shader, const model_information& model_info);
+		// Declarations shared by the programs, pass them in the Shader defines after any material defines.
+		// blocks : SHADER_PREAMBLE flags
+		static std::string shaderPreamble(unsigned int blocks);
 
 		glm::vec3 world_view_pos;
 	};
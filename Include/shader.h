@@ -8,6 +8,10 @@
 
 #include <variant>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
 #include <unordered_map>
 
 namespace xre
@@ -19,15 +23,46 @@ namespace xre
 
 		Shader() = default;
 		
-		Shader(const char* vertex_shader_path, const char* fragment_shader_path, const char* geometry_shader_path = NULL);
+		// defines : preamble inserted after the #version line of every stage, "#define" lines then Renderer::shaderPreamble
+		Shader(const char* vertex_shader_path, const char* fragment_shader_path, const char* geometry_shader_path = NULL, const std::string& defines = "");
+
+		// Compute shader program
+		explicit Shader(const char* compute_shader_path);
+
+		// Handle of an active uniform, -1 if the program has none by that name. Array elements are "name[i]" and
+		// the bare array name is its first element, element i of an array is its handle + i.
+		int uniform(std::string_view uniform_name) const;
+		// Handle of an array element, -1 past the active end of the array.
+		int uniform(std::string_view array_name, unsigned int element) const;
 
 		// Set Uniform Functions
-		void setBool(std::string uniform_name, bool value) const;
-		void setInt(std::string uniform_name, int value) const;
-		void setFloat(std::string uniform_name, float value) const;
-		void setMat4(std::string uniform_name, glm::mat4 value) const;
-		void setVec3(std::string uniform_name, glm::vec3 value) const;
-		void setVec4(std::string uniform_name, glm::vec4 value) const;
+		// Values go to this program whether or not it is in use, and are only uploaded when they change.
+		void setBool(std::string_view uniform_name, bool value) const;
+		void setInt(std::string_view uniform_name, int value) const;
+		void setUInt(std::string_view uniform_name, unsigned int value) const;
+		void setFloat(std::string_view uniform_name, float value) const;
+		void setMat3(std::string_view uniform_name, const glm::mat3& value) const;
+		void setMat4(std::string_view uniform_name, const glm::mat4& value) const;
+		void setIVec2(std::string_view uniform_name, const glm::ivec2& value) const;
+		void setVec2(std::string_view uniform_name, const glm::vec2& value) const;
+		void setVec3(std::string_view uniform_name, const glm::vec3& value) const;
+		void setVec4(std::string_view uniform_name, const glm::vec4& value) const;
+
+		// Same, through a handle from uniform()
+		void setBool(int uniform, bool value) const;
+		void setInt(int uniform, int value) const;
+		void setUInt(int uniform, unsigned int value) const;
+		void setFloat(int uniform, float value) const;
+		void setMat3(int uniform, const glm::mat3& value) const;
+		void setMat4(int uniform, const glm::mat4& value) const;
+		void setIVec2(int uniform, const glm::ivec2& value) const;
+		void setVec2(int uniform, const glm::vec2& value) const;
+		void setVec3(int uniform, const glm::vec3& value) const;
+		void setVec4(int uniform, const glm::vec4& value) const;
+
+		// count consecutive array elements, starting at the handle's one
+		void setVec4(int uniform, const glm::vec4* values, int count) const;
+		void setMat4(int uniform, const glm::mat4* values, int count) const;
 
 		// Activate the shader
 		void use() const;
@@ -37,6 +72,25 @@ namespace xre
 		//  Utility function for checking compliation / linking errors
 		void checkCompileErrors(unsigned int& shader, const std::string& type);
 
+		struct UniformRecord
+		{
+			int location = -1;
+			int elements = 1; // array elements from this one on
+			bool cached = false;
+			unsigned char value[sizeof(glm::mat4)]; // last uploaded value
+		};
+
+		// Active uniforms, read once after linking. The names (array names included) are looked up through a
+		// perfect hash : no two of them share a slot of uniform_table for uniform_hash_seed.
+		void introspectUniforms();
+		void buildUniformTable();
+		bool valueChanged(int uniform, const void* value, size_t size) const;
+
+		mutable std::vector<UniformRecord> uniforms;
+		std::vector<std::pair<std::string, int>> uniform_names;
+		std::vector<int> uniform_table; // index into uniform_names, -1 for an empty slot
+		uint32_t uniform_hash_seed = 0;
+
 		// Data Type to Uniform function mapping
 		typedef void(xre::Shader::* functionPointer)();
 		std::unordered_map<std::string, functionPointer> uniform_function_map;
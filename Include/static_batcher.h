@@ -0,0 +1,59 @@
+#ifndef STATIC_BATCHER_H
+#define STATIC_BATCHER_H
+
+#include <mesh.h>
+#include <mesh_cache.h>
+#include <model.h>
+#include <shader.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace xre
+{
+	// Scene build step. Merges the meshes of static models that share a material into one vertex / index
+	// buffer per material, with the vertices pre-transformed to world space. Every source mesh stays a
+	// submesh with its own bounds and levels of detail, the renderer culls submeshes and draws the
+	// survivors with one multi-draw call per batch.
+	//
+	// Batched meshes lose their meshlets, and the visibility pipeline does not accept batches since its
+	// triangle ids cannot tell submeshes apart.
+	class StaticBatcher
+	{
+	public:
+		StaticBatcher() = default;
+		StaticBatcher(const StaticBatcher&) = delete;
+		StaticBatcher& operator=(const StaticBatcher&) = delete;
+		~StaticBatcher();
+
+		// Reads the model back from its mesh cache and releases its meshes, the model draws nothing afterwards.
+		// Returns false and leaves the model untouched if it is dynamic or has no valid cache.
+		bool add(Model& model);
+
+		// Uploads one mesh per material. Must be called once every model is added.
+		void build();
+
+		// Pushes the batches to the draw queue. The batcher must outlive the draw queue.
+		void draw(const Shader& shader, const std::string& name);
+
+	private:
+		struct PendingBatch
+		{
+			std::vector<Texture> textures;
+			std::vector<Vertex> vertices;
+			std::vector<unsigned int> indices;
+			std::vector<MeshLod> lods;
+			std::vector<Submesh> submeshes;
+		};
+
+		// keyed by the material's texture ids
+		std::map<std::vector<unsigned int>, PendingBatch> m_pending;
+		std::vector<Mesh*> m_batches;
+		glm::mat4 m_model_matrix = glm::mat4(1.0f); // the vertices are already in world space
+	};
+}
+
+#endif
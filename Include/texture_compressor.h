@@ -0,0 +1,61 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// S3TC is not core, but every desktop driver exposes it.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Bump whenever the encoders or the mip filtering change.
+#define XRE_TEXTURE_CACHE_VERSION 1
+#define XRE_TEXTURE_CACHE_EXTENSION ".xretex.dds"
+
+namespace xre
+{
+	enum TEXTURE_USAGE
+	{
+		TEXTURE_USAGE_COLOR,	// sRGB albedo : BC1, or BC3 when any texel is translucent
+		TEXTURE_USAGE_NORMAL,	// tangent space xy : BC5, z is rebuilt in the shaders
+		TEXTURE_USAGE_MASK		// single channel (metallic, roughness) : BC4
+	};
+
+	// Block compressed texture with its full mip chain, level 0 first.
+	struct CompressedTexture
+	{
+		GLenum internal_format = 0;
+		unsigned int block_size = 0; // bytes per 4x4 block
+		std::vector<int> widths, heights;
+		std::vector<std::vector<unsigned char>> levels;
+	};
+
+	// Import time BC encoding with gamma correct mip generation, cached as DDS next to the source image.
+	class TextureCompressor
+	{
+	public:
+		// One cache per usage, an image used both ways (albedo and mask) is encoded twice.
+		static std::string cachePath(const std::string& source_path, TEXTURE_USAGE usage);
+
+		// rgba : width * height * 4 bytes
+		static void compress(const unsigned char* rgba, int width, int height, TEXTURE_USAGE usage, CompressedTexture& texture);
+
+		static bool readCache(const std::string& cache_path, uint64_t source_hash, TEXTURE_USAGE usage, CompressedTexture& texture);
+		static bool writeCache(const std::string& cache_path, uint64_t source_hash, TEXTURE_USAGE usage, const CompressedTexture& texture);
+	};
+}
+
+#endif
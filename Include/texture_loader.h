@@ -0,0 +1,146 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <texture_compressor.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+
+// Bytes copied into the staging ring and uploaded per frame.
+#define XRE_TEXTURE_UPLOAD_BUDGET (4 * 1024 * 1024)
+// Staging ring segments, one per frame in flight.
+#define XRE_TEXTURE_STAGING_SEGMENTS 3
+
+// Default GPU memory budget for streamed material textures.
+#define XRE_TEXTURE_MEMORY_BUDGET (512 * 1024 * 1024)
+// Textures always keep the mips up to this size resident, finer mips are streamed on demand.
+#define XRE_TEXTURE_STREAMING_MIN_SIZE 64
+// Mips finer than the screen footprint estimate, covers tiled uvs and anisotropic filtering.
+#define XRE_TEXTURE_STREAMING_MIP_BIAS 1
+// Frames a texture keeps its finer mips after they were last requested.
+#define XRE_TEXTURE_STREAMING_KEEP_FRAMES 120
+
+namespace xre
+{
+	enum TEXTURE_RESIDENCY
+	{
+		TEXTURE_PENDING,	// placeholder, waiting for the decode
+		TEXTURE_STREAMING,	// real format and size, finer mips still on their way
+		TEXTURE_RESIDENT,	// every requested mip is resident
+		TEXTURE_FAILED		// keeps the placeholder
+	};
+
+	// Decodes textures on the thread pool (from the block compressed cache when it is up to date, otherwise
+	// from the source image, encoding and caching it) and uploads them through a persistently mapped PBO ring,
+	// a bounded number of bytes per frame. Texture ids are valid immediately and show a 1x1 placeholder
+	// until their first mip arrives.
+	//
+	// Each texture starts with its coarse mips only. Finer mips are streamed in and out according to the
+	// screen size requested every frame, within a GPU memory budget. Levels are specified one by one so
+	// that dropped mips really release their memory, GL_TEXTURE_BASE_LEVEL clamps sampling to the finest
+	// complete level. All calls must be made on the GL thread.
+	class AsyncTextureLoader
+	{
+	private:
+		inline static std::unique_ptr<AsyncTextureLoader> instance = NULL;
+
+		struct DecodedTexture
+		{
+			unsigned int texture_id = 0;
+			std::string file_path;
+			TEXTURE_USAGE usage = TEXTURE_USAGE_COLOR;
+			bool success = false;
+			CompressedTexture image;
+		};
+
+		struct DecodeQueue
+		{
+			std::mutex mutex;
+			std::vector<std::shared_ptr<DecodedTexture>> textures;
+		};
+
+		struct StreamedTexture
+		{
+			std::shared_ptr<DecodedTexture> decoded; // kept on the CPU so that dropped mips can come back
+			int coarse_level = 0;		// finest level that is never streamed out
+			int resident_level = 0;		// finest complete level, level count while nothing is resident
+			int target_level = 0;
+			int uploading_level = -1;	// allocated level whose block rows are still arriving
+			int uploaded_rows = 0;
+			size_t allocated_bytes = 0;
+
+			bool pinned = false;		// every level, outside of the memory budget
+			int requested_level = 0;	// finest level asked for this frame
+			float priority = 0.0f;		// largest screen size asked for this frame
+			unsigned int last_request_frame = 0;
+			unsigned int target_request_frame = 0;	// last frame the target level, or a finer one, was asked for
+		};
+
+		std::shared_ptr<DecodeQueue> m_decoded;
+		std::unordered_map<unsigned int, StreamedTexture> m_textures;
+		std::unordered_map<unsigned int, TEXTURE_RESIDENCY> m_residency;
+		std::unordered_set<unsigned int> m_destroyed; // destroyed while still decoding
+		std::unordered_set<unsigned int> m_pinned; // pinned while still decoding
+		unsigned int m_decoding;
+		unsigned int m_frame;
+		size_t m_memory_budget;
+		size_t m_allocated_bytes;
+		size_t m_reserved_bytes;
+
+		unsigned int m_staging_buffer;
+		unsigned char* m_staging_memory;
+		GLsync m_segment_fences[XRE_TEXTURE_STAGING_SEGMENTS];
+		unsigned int m_segment;
+
+		AsyncTextureLoader();
+		void createStagingBuffer();
+		void receiveDecodedTextures();
+		void updateTargetLevels();
+		void streamOut(unsigned int texture_id, StreamedTexture& texture);
+		bool streamIn(unsigned int texture_id, StreamedTexture& texture, size_t segment_offset, size_t& used);
+
+		static size_t levelBytes(const CompressedTexture& image, int first_level);
+		static void decode(DecodedTexture& texture);
+
+	public:
+		static AsyncTextureLoader* loader();
+		AsyncTextureLoader(AsyncTextureLoader& other) = delete;
+
+		// placeholder : RGBA8 color shown until the texture is resident
+		unsigned int load(const std::string& file_path, TEXTURE_USAGE usage, const unsigned char placeholder[4]);
+
+		// screen_size : pixels covered by the largest dimension of a visible mesh using the texture.
+		// Call for every visible texture before update().
+		void requestScreenSize(unsigned int texture_id, float screen_size);
+
+		// Call once per frame.
+		void update();
+
+		// Streams every level of the texture in and keeps them until it is unpinned, the other textures make room for it.
+		// Once complete a pinned texture is not re-specified, so it can be copied.
+		void pin(unsigned int texture_id, bool pinned);
+		bool complete(unsigned int texture_id) const; // every level resident
+
+		// Deletes the texture, deferred until its decode finishes if it is still in flight.
+		void destroy(unsigned int texture_id);
+
+		void setMemoryBudget(size_t bytes) { m_memory_budget = bytes; }
+		// GPU memory held outside of the loader for streamed textures (copies of them), charged against the budget.
+		void setReservedBytes(size_t bytes) { m_reserved_bytes = bytes; }
+		size_t allocatedBytes() const { return m_allocated_bytes; }
+
+		TEXTURE_RESIDENCY residency(unsigned int texture_id) const;
+		bool translucent(unsigned int texture_id) const; // BC3 albedo, false until decoded
+		size_t textureBytes(unsigned int texture_id) const; // GPU memory of the resident mips
+		bool idle() const;
+	};
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <texture_compressor.h>
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <cstddef>
+
+namespace xre
+{
+	struct TextureRegistryStats
+	{
+		unsigned int texture_count = 0;		// unique GL textures
+		unsigned int reference_count = 0;	// acquisitions across all models
+		size_t resident_bytes = 0;			// GPU memory of the uploaded textures
+		size_t shared_bytes = 0;			// memory saved against every reference owning its own copy
+	};
+
+	// Process wide, reference counted texture cache keyed by normalized path and usage.
+	// Must be used on the GL thread.
+	class TextureRegistry
+	{
+	private:
+		inline static std::unique_ptr<TextureRegistry> instance = NULL;
+
+		struct Entry
+		{
+			unsigned int texture_id = 0;
+			unsigned int references = 0;
+		};
+
+		std::unordered_map<std::string, Entry> m_entries;
+		std::unordered_map<unsigned int, std::string> m_keys; // texture id -> entry key
+
+		TextureRegistry() = default;
+
+	public:
+		static TextureRegistry* registry();
+		TextureRegistry(TextureRegistry& other) = delete;
+
+		static std::string normalizePath(const std::string& file_path);
+
+		// Returns the shared texture, loading it through the AsyncTextureLoader on first use.
+		unsigned int acquire(const std::string& file_path, TEXTURE_USAGE usage, const unsigned char placeholder[4]);
+		// Deletes the texture once its last reference is gone.
+		void release(unsigned int texture_id);
+
+		TextureRegistryStats stats() const;
+	};
+}
+
+#endif
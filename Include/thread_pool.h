@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <queue>
+
+namespace xre
+{
+	// Fixed set of worker threads shared by the engine's CPU side loading work.
+	// Tasks must not touch GL; results are handed back to the GL thread by the caller.
+	class ThreadPool
+	{
+	private:
+		inline static std::unique_ptr<ThreadPool> instance = NULL;
+
+		std::vector<std::thread> m_workers;
+		std::queue<std::function<void()>> m_tasks;
+		std::mutex m_queue_mutex;
+		std::condition_variable m_queue_condition;
+		bool m_stop;
+
+		ThreadPool(unsigned int worker_count);
+		void workerLoop();
+
+	public:
+		static ThreadPool* threadPool();
+		ThreadPool(ThreadPool& other) = delete;
+		~ThreadPool();
+
+		unsigned int workerCount() const { return (unsigned int)m_workers.size(); }
+
+		// Queues a task and returns immediately.
+		void submit(std::function<void()> task);
+
+		// Runs task(0) ... task(count - 1) across the workers and the calling thread, returns when all are done.
+		void parallelFor(unsigned int count, const std::function<void(unsigned int)>& task);
+	};
+}
+
+#endif
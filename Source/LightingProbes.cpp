@@ -53,7 +53,8 @@ xre::ProbeRenderer::ProbeRenderer(unsigned int irradiance_map_resolution, unsign
 
 	renderingShader = Shader(
 		"./Source/Resources/Shaders/IBL/forward_bphong_shadowless_vertex_shader.vert",
-		"./Source/Resources/Shaders/IBL/forward_bphong_shadowless_fragment_shader.frag"
+		"./Source/Resources/Shaders/IBL/forward_bphong_shadowless_fragment_shader.frag",
+		NULL, Renderer::shaderPreamble(SHADER_PREAMBLE_POSITION_UNIFORMS)
 	);
 
 
@@ -242,8 +243,6 @@ void xre::ProbeRenderer::RenderProbes(
 	renderingShader.setFloat("near", 0.1f);
 	renderingShader.setFloat("far", 10.0f);
 
-	std::stringstream ss;
-
 	for (unsigned int p = 0; p < light_probes.size(); p++)  //optimize state changes.
 	{
 		renderingShader.setVec3("camera_pos", light_probes[p].position);
@@ -264,6 +263,7 @@ void xre::ProbeRenderer::RenderProbes(
 				}
 
 				renderingShader.setMat4("model", *draw_queue->at(d).object_model_matrix);
+				Mesh::setPositionDecode(renderingShader, draw_queue->at(d).mesh_aabb);
 
 				unsigned int j;
 				for (j = 0; j < draw_queue->at(d).object_textures->size(); j++)
@@ -277,10 +277,8 @@ void xre::ProbeRenderer::RenderProbes(
 				{
 					for (unsigned int k = j; k < XRE_MAX_POINT_SHADOW_MAPS + j; k++)
 					{
-						ss.str("");
-						ss << "[" << k - j << "]";
 						glActiveTexture(GL_TEXTURE0 + k);
-						renderingShader.setInt("point_shadow_depth_map" + ss.str(), k);
+						renderingShader.setInt(renderingShader.uniform("point_shadow_depth_map", k - j), k);
 						glBindTexture(GL_TEXTURE_CUBE_MAP, point_shadow_depth_storage[k - j]);
 					}
 				}
@@ -306,8 +304,10 @@ void xre::ProbeRenderer::RenderProbes(
 					directional_light->SetShaderAttrib(directional_light->m_name, renderingShader);
 				}
 
+				// probes are low resolution, picked per probe as the camera levels do not apply here
+				unsigned int lod = Renderer::selectLod(draw_queue->at(d), light_probes[p].position, projection[1][1] * rendering_resolution * 0.5f, XRE_LOD_PIXEL_ERROR);
 				glBindVertexArray(draw_queue->at(d).object_VAO);
-				glDrawElements(GL_TRIANGLES, draw_queue->at(d).indices_size, GL_UNSIGNED_INT, 0);
+				Renderer::drawElements(draw_queue->at(d), lod);
 				glBindVertexArray(0);
 			}
 		}
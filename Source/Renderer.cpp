@@ -3,6 +3,9 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <algorithm>
+#include <map>
+#include <cstring>
 
 
 #include <glad/glad.h>
@@ -19,6 +22,7 @@
 #include <LightingProbes.h>
 #include <CullingTester.h>
 #include <xre_configuration.h>
+#include <texture_loader.h>
 
 using namespace xre;
 
@@ -36,7 +40,7 @@ Renderer* Renderer::renderer()
 }
 
 // SHOULD BE CALLED ONLY ONCE, BEFORE ENTERING RENDER LOOP.
-Renderer* Renderer::renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode)
+Renderer* Renderer::renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode, float render_scale_p)
 {
 	if (!instance)
 	{
@@ -50,50 +54,82 @@ Renderer* Renderer::renderer(unsigned int screen_width, unsigned int screen_heig
 				lights_near_plane_p, lights_far_plane_p,
 				shadow_map_width_p, shadow_map_height_p,
 				render_pipeline,
-				light_mode
+				light_mode,
+				render_scale_p
 			)
 		);
 	}
 	return instance.get();
 }
 
-Renderer::Renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode)
+Renderer::Renderer(unsigned int screen_width, unsigned int screen_height, const glm::vec4& background_color, float lights_near_plane_p, float lights_far_plane_p, int shadow_map_width_p, int shadow_map_height_p, RENDER_PIPELINE render_pipeline, LIGHTING_MODE light_mode, float render_scale_p)
 	:framebuffer_width(screen_width), framebuffer_height(screen_height), bg_color(background_color), light_near_plane(lights_near_plane_p), light_far_plane(lights_far_plane_p), shadow_map_width(shadow_map_height_p), shadow_map_height(shadow_map_height_p)
 {
 	positive_exponent = 20.0f;
 	negative_exponent = 80.0f;
-	num_draw_buffers = lighting_model == LIGHTING_MODE::PBR ? 4 : 3;
-
 
 	rendering_pipeline = render_pipeline;
 	lighting_model = light_mode;
 	bg_color = background_color;
 
-	if (rendering_pipeline == RENDER_PIPELINE::DEFERRED)
+	// The visibility pipeline shares the G-Buffer, lighting and post processing of the deferred one
+	deferred = rendering_pipeline == RENDER_PIPELINE::DEFERRED || rendering_pipeline == RENDER_PIPELINE::VISIBILITY;
+
+	// color, normal, (occlusion), velocity
+	num_draw_buffers = lighting_model == LIGHTING_MODE::PBR ? 4 : 3;
+
+	// Only the deferred pipeline has a temporal resolve to upscale with.
+	// Allocate at the largest size dynamic resolution may ask for.
+	render_target_width = framebuffer_width;
+	render_target_height = framebuffer_height;
+	render_scale = deferred ? glm::clamp(render_scale_p, 0.25f, 1.0f) : 1.0f;
+	render_width = (unsigned int)(framebuffer_width * render_scale);
+	render_height = (unsigned int)(framebuffer_height * render_scale);
+	taa_enabled = deferred;
+
+	std::string frame_preamble = shaderPreamble(SHADER_PREAMBLE_FRAME);
+	std::string object_preamble = shaderPreamble(SHADER_PREAMBLE_FRAME | SHADER_PREAMBLE_OBJECTS);
+
+	if (deferred)
 	{
 		createDeferredBuffers();
 		createShadowMapFramebuffers();
 
+		// The visibility resolve still binds the textures of each draw
+		if (rendering_pipeline == RENDER_PIPELINE::DEFERRED)
+		{
+			material_textures.create(XRE_MATERIAL_TEXTURE_MODE);
+		}
+
+		if (rendering_pipeline == RENDER_PIPELINE::VISIBILITY)
+		{
+			createVisibilityBuffer();
+		}
+
 
 		if (lighting_model == LIGHTING_MODE::BLINNPHONG)
 		{
 			deferredFillShader = Shader(
 				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_vertex_shader.vert",
-				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_bphong_fragment_shader.frag");
+				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_bphong_fragment_shader.frag",
+				NULL, material_textures.shaderDefines() + object_preamble);
 
 			deferredColorShader = Shader(
 				"./Source/Resources/Shaders/BlinnPhong/deferred_bphong_color_vertex_shader.vert",
-				"./Source/Resources/Shaders/BlinnPhong/deferred_bphong_color_fragment_shader.frag");
+				"./Source/Resources/Shaders/BlinnPhong/deferred_bphong_color_fragment_shader.frag",
+				NULL, frame_preamble);
 		}
 		else
 		{
 			deferredFillShader = Shader(
 				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_vertex_shader.vert",
-				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_pbr_fragment_shader.frag");
+				"./Source/Resources/Shaders/DeferredAdditional/deferred_fill_pbr_fragment_shader.frag",
+				NULL, material_textures.shaderDefines() + object_preamble);
 
 			deferredColorShader = Shader(
 				"./Source/Resources/Shaders/BlinnPhong/deferred_bphong_color_vertex_shader.vert",
-				"./Source/Resources/Shaders/PBR/deferred_pbr_color_fragment_shader.frag");
+				"./Source/Resources/Shaders/PBR/deferred_pbr_color_fragment_shader.frag",
+				NULL, frame_preamble);
 
 			glGenTextures(1, &brdfLUT);
 
@@ -138,18 +174,26 @@ Renderer::Renderer(unsigned int screen_width, unsigned int screen_height, const
 	(
 		"./Source/Resources/Shaders/ShadowMapping/depth_map_vertex_shader.vert",
 		"./Source/Resources/Shaders/ShadowMapping/depth_map_point_fragment_shader.frag",
-		"./Source/Resources/Shaders/ShadowMapping/depth_map_geometry_shader.geom");
+		"./Source/Resources/Shaders/ShadowMapping/depth_map_geometry_shader.geom",
+		shaderPreamble(SHADER_PREAMBLE_OBJECTS));
 
 	depthShader_directional = Shader
 	(
 		"./Source/Resources/Shaders/ShadowMapping/depth_map_vertex_shader.vert",
 		"./Source/Resources/Shaders/ShadowMapping/depth_map_directional_fragment_shader.frag",
-		"./Source/Resources/Shaders/ShadowMapping/depth_map_geometry_shader.geom");
+		"./Source/Resources/Shaders/ShadowMapping/depth_map_geometry_shader.geom",
+		shaderPreamble(SHADER_PREAMBLE_OBJECTS));
+
+	bloom_downsample_Shader = Shader
+	(
+		"./Source/Resources/Shaders/Quad/quad_vertex_shader.vert",
+		"./Source/Resources/Shaders/Blur/bloom_downsample_shader.frag"
+	);
 
-	bloomSSAO_blur_Shader = Shader
+	bloom_upsample_Shader = Shader
 	(
 		"./Source/Resources/Shaders/Quad/quad_vertex_shader.vert",
-		"./Source/Resources/Shaders/Blur/bloom_ssao_blur_shader.frag"
+		"./Source/Resources/Shaders/Blur/bloom_upsample_shader.frag"
 	);
 
 	directional_shadow_blur_Shader = Shader
@@ -163,11 +207,72 @@ Renderer::Renderer(unsigned int screen_width, unsigned int screen_height, const
 		"./Source/Resources/Shaders/SSAO/ssao_fragment_shader.frag"
 	);
 
+	SSAO_depth_downsample_Shader = Shader(
+		"./Source/Resources/Shaders/SSAO/ssao_vertex_shader.vert",
+		"./Source/Resources/Shaders/SSAO/ssao_depth_downsample_shader.frag"
+	);
+
+	SSAO_upsample_Shader = Shader(
+		"./Source/Resources/Shaders/SSAO/ssao_vertex_shader.vert",
+		"./Source/Resources/Shaders/SSAO/ssao_upsample_shader.frag"
+	);
+
+	depth_pyramid_Shader = Shader("./Source/Resources/Shaders/DepthPyramid/depth_pyramid_compute_shader.comp");
+	meshlet_cull_Shader = Shader("./Source/Resources/Shaders/MeshletCull/meshlet_cull_compute_shader.comp");
+	GTAOShader = Shader("./Source/Resources/Shaders/GTAO/gtao_compute_shader.comp");
+
+	TAAShader = Shader
+	(
+		"./Source/Resources/Shaders/Quad/quad_vertex_shader.vert",
+		"./Source/Resources/Shaders/TAA/taa_resolve_shader.frag"
+	);
+
+	depth_prepass_Shader = Shader
+	(
+		"./Source/Resources/Shaders/DepthPrepass/depth_prepass_vertex_shader.vert",
+		"./Source/Resources/Shaders/DepthPrepass/depth_prepass_fragment_shader.frag",
+		NULL, object_preamble
+	);
+
+	depth_prepass_alpha_Shader = Shader
+	(
+		"./Source/Resources/Shaders/DepthPrepass/depth_prepass_alpha_vertex_shader.vert",
+		"./Source/Resources/Shaders/DepthPrepass/depth_prepass_alpha_fragment_shader.frag",
+		NULL, material_textures.shaderDefines() + object_preamble
+	);
+
+	if (rendering_pipeline == RENDER_PIPELINE::VISIBILITY)
+	{
+		visibilityShader = Shader
+		(
+			"./Source/Resources/Shaders/DepthPrepass/depth_prepass_vertex_shader.vert",
+			"./Source/Resources/Shaders/Visibility/visibility_fragment_shader.frag",
+			NULL, object_preamble
+		);
+
+		visibility_alpha_Shader = Shader
+		(
+			"./Source/Resources/Shaders/DepthPrepass/depth_prepass_alpha_vertex_shader.vert",
+			"./Source/Resources/Shaders/Visibility/visibility_alpha_fragment_shader.frag",
+			NULL, object_preamble
+		);
+
+		visibility_resolve_Shader = Shader("./Source/Resources/Shaders/Visibility/visibility_resolve_compute_shader.comp");
+	}
+
 #pragma endregion
 
 	createQuad();
 	createSSAOData();
+	createGTAOData();
+	createMeshletCullData();
+	createInstanceBuffer();
+	createUniformBuffers();
 	createBlurringFramebuffers();
+	createBloomMipChain();
+	createTAAFramebuffers();
+
+	glGenQueries(XRE_GPU_TIMER_QUERIES, gpu_timer_queries);
 
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
@@ -176,29 +281,274 @@ Renderer::Renderer(unsigned int screen_width, unsigned int screen_height, const
 	directional_light = NULL;
 }
 
+// Front to back. Must not run while anything else reads or writes the draw queue.
 void Renderer::sortDrawQueue()
 {
-	std::sort(draw_queue.begin(), draw_queue.end(), [=](model_information a, model_information b)
-		{
-			glm::vec3 a_centroid = (a.mesh_aabb.max_v + a.mesh_aabb.min_v) / glm::vec3(2.0);
-			glm::vec3 b_centroid = (b.mesh_aabb.max_v + b.mesh_aabb.min_v) / glm::vec3(2.0);
+	for (model_information& model_info : draw_queue)
+	{
+		// world space bounds : transform the center, and the extents by the absolute rotation / scale
+		const glm::mat4& model = *model_info.object_model_matrix;
+		glm::vec3 center = glm::vec3(model * glm::vec4((model_info.mesh_aabb.max_v + model_info.mesh_aabb.min_v) * 0.5f, 1.0f));
+		glm::vec3 local_extents = (model_info.mesh_aabb.max_v - model_info.mesh_aabb.min_v) * 0.5f;
+
+		glm::mat3 abs_model = glm::mat3(model);
+		for (unsigned int c = 0; c < 3; c++)
+			abs_model[c] = glm::abs(abs_model[c]);
+
+		glm::vec3 extents = abs_model * local_extents;
 
-			float d_a = glm::length(a_centroid - *camera_position);
-			float d_b = glm::length(b_centroid - *camera_position);
+		// zero when the camera is inside the bounds
+		model_info.view_distance = glm::length(glm::max(glm::abs(*camera_position - center) - extents, glm::vec3(0.0f)));
+	}
 
-			return d_a < d_b;
+	std::sort(draw_queue.begin(), draw_queue.end(), [](const model_information& a, const model_information& b)
+		{
+			return a.view_distance < b.view_distance;
 		});
 }
 
+void Renderer::updateTextureStreaming()
+{
+	AsyncTextureLoader* texture_loader = AsyncTextureLoader::loader();
+
+	// Screen footprint of every mesh that passed last frame's frustum test, in pixels across its bounding sphere.
+	for (const model_information& model_info : draw_queue)
+	{
+		if (model_info.frustum_cull)
+		{
+			continue;
+		}
+
+		const glm::mat4& model = *model_info.object_model_matrix;
+		glm::vec3 center = glm::vec3(model * glm::vec4((model_info.mesh_aabb.max_v + model_info.mesh_aabb.min_v) * 0.5f, 1.0f));
+		glm::vec3 local_extents = (model_info.mesh_aabb.max_v - model_info.mesh_aabb.min_v) * 0.5f;
+
+		glm::mat3 abs_model = glm::mat3(model);
+		for (unsigned int c = 0; c < 3; c++)
+			abs_model[c] = glm::abs(abs_model[c]);
+
+		glm::vec3 extents = abs_model * local_extents;
+		float distance = glm::length(glm::max(glm::abs(*camera_position - center) - extents, glm::vec3(0.0f)));
+		float screen_size = glm::length(extents) * (*camera_projection_matrix)[1][1] * render_height / std::max(distance, 0.01f);
+
+		material_textures.use(model_info.material_id);
+
+		// textures copied by the material table may stream out
+		for (const Texture& texture : *model_info.object_textures)
+		{
+			if (!material_textures.stored(texture.id))
+			{
+				texture_loader->requestScreenSize(texture.id, screen_size);
+			}
+		}
+	}
+
+	texture_loader->update();
+	material_textures.update();
+
+	for (model_information& model_info : draw_queue)
+	{
+		if (model_info.alpha_resolved || texture_loader->residency(model_info.diffuse_texture) == TEXTURE_PENDING)
+		{
+			continue;
+		}
+
+		model_info.alpha_tested = texture_loader->translucent(model_info.diffuse_texture);
+		model_info.alpha_resolved = true;
+	}
+}
+
+// Camera to the closest point of the world space bounds, zero inside them.
+static float boundsDistance(const BoundingVolume& aabb, const glm::mat4& model, const glm::vec3& eye)
+{
+	glm::vec3 center = glm::vec3(model * glm::vec4((aabb.max_v + aabb.min_v) * 0.5f, 1.0f));
+	glm::vec3 local_extents = (aabb.max_v - aabb.min_v) * 0.5f;
+
+	glm::mat3 abs_model = glm::mat3(model);
+	for (unsigned int c = 0; c < 3; c++)
+		abs_model[c] = glm::abs(abs_model[c]);
+
+	glm::vec3 extents = abs_model * local_extents;
+	return glm::length(glm::max(glm::abs(eye - center) - extents, glm::vec3(0.0f)));
+}
+
+// Coarsest level whose error projects to at most max_pixel_error.
+static unsigned int selectLevel(const MeshLod* lods, unsigned int lod_count, const BoundingVolume& aabb, const glm::mat4& model,
+	const glm::vec3& eye, float pixels_per_unit, float max_pixel_error)
+{
+	if (lod_count < 2)
+	{
+		return 0;
+	}
+
+	// errors are in object space, the largest axis scale bounds them in world space
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	float distance = std::max(boundsDistance(aabb, model, eye), 0.01f);
+
+	unsigned int lod = 0;
+	for (unsigned int l = 1; l < lod_count; l++)
+	{
+		if (lods[l].error * scale / distance * pixels_per_unit > max_pixel_error)
+		{
+			break;
+		}
+		lod = l;
+	}
+
+	return lod;
+}
+
+// Levels switch to finer ones as soon as the error shows, and to coarser ones only once they are well below it.
+static unsigned int updateLevel(unsigned int current, const MeshLod* lods, unsigned int lod_count, const BoundingVolume& aabb, const glm::mat4& model,
+	const glm::vec3& eye, float pixels_per_unit, float max_pixel_error, float hysteresis)
+{
+	unsigned int needed = selectLevel(lods, lod_count, aabb, model, eye, pixels_per_unit, max_pixel_error);
+	unsigned int relaxed = selectLevel(lods, lod_count, aabb, model, eye, pixels_per_unit, max_pixel_error * (1.0f - hysteresis));
+
+	if (needed < current)
+	{
+		return needed;
+	}
+	return std::max(relaxed, current);
+}
+
+unsigned int Renderer::selectLod(const model_information& model_info, const glm::vec3& eye, float pixels_per_unit, float max_pixel_error)
+{
+	// static batches pick a level per submesh
+	if (model_info.submeshes != NULL)
+	{
+		return 0;
+	}
+
+	return selectLevel(model_info.lods->data(), (unsigned int)model_info.lods->size(), model_info.mesh_aabb, *model_info.object_model_matrix,
+		eye, pixels_per_unit, max_pixel_error);
+}
+
+void Renderer::drawElements(const model_information& model_info, unsigned int lod)
+{
+	size_t index_size = model_info.index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	if (model_info.submeshes == NULL)
+	{
+		const MeshLod& level = model_info.lods->at(lod);
+		glDrawElements(GL_TRIANGLES, level.index_count, model_info.index_type, (void*)(level.index_offset * index_size));
+		return;
+	}
+
+	// every submesh at that level, or at its coarsest one
+	for (const Submesh& submesh : *model_info.submeshes)
+	{
+		const MeshLod& level = model_info.lods->at(submesh.first_lod + std::min(lod, submesh.lod_count - 1));
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.index_count, model_info.index_type, (void*)(level.index_offset * index_size), submesh.base_vertex);
+	}
+}
+
+void Renderer::updateLods()
+{
+	float pixels_per_unit = (*camera_projection_matrix)[1][1] * render_height * 0.5f;
+
+	for (model_information& model_info : draw_queue)
+	{
+		const glm::mat4& model = *model_info.object_model_matrix;
+
+		if (model_info.submeshes == NULL)
+		{
+			model_info.lod = updateLevel(model_info.lod, model_info.lods->data(), (unsigned int)model_info.lods->size(), model_info.mesh_aabb, model,
+				*camera_position, pixels_per_unit, lod_pixel_error, lod_hysteresis);
+
+			unsigned int last = (unsigned int)model_info.lods->size() - 1;
+			model_info.shadow_lod = std::min(model_info.lod + shadow_lod_bias, last);
+			continue;
+		}
+
+		// Static batches keep a level per submesh, updateSubmeshRanges turns them into draw ranges
+		for (unsigned int s = 0; s < model_info.submeshes->size(); s++)
+		{
+			const Submesh& submesh = model_info.submeshes->at(s);
+			model_info.submesh_lods[s] = updateLevel(model_info.submesh_lods[s], model_info.lods->data() + submesh.first_lod, submesh.lod_count, submesh.aabb, model,
+				*camera_position, pixels_per_unit, lod_pixel_error, lod_hysteresis);
+		}
+	}
+}
+
+static void pushRange(draw_ranges& ranges, const MeshLod& level, size_t index_size, int base_vertex)
+{
+	ranges.counts.push_back((GLsizei)level.index_count);
+	ranges.offsets.push_back((const void*)(level.index_offset * index_size));
+	ranges.base_vertices.push_back(base_vertex);
+}
+
+// Static batches : one range per submesh inside the camera frustum, at its own level. The shadow passes get
+// every submesh, casters outside the camera frustum still shade what is inside it.
+void Renderer::updateSubmeshRanges()
+{
+	const glm::mat4 view_projection = *camera_projection_matrix * *camera_view_matrix;
+
+	for (model_information& model_info : draw_queue)
+	{
+		if (model_info.submeshes == NULL)
+		{
+			continue;
+		}
+
+		draw_ranges& camera_ranges = model_info.camera_ranges;
+		draw_ranges& shadow_ranges = model_info.shadow_ranges;
+		camera_ranges.counts.clear();
+		camera_ranges.offsets.clear();
+		camera_ranges.base_vertices.clear();
+		shadow_ranges.counts.clear();
+		shadow_ranges.offsets.clear();
+		shadow_ranges.base_vertices.clear();
+
+		size_t index_size = model_info.index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+		// Gribb / Hartmann, in the space of the batch vertices
+		glm::mat4 rows = glm::transpose(view_projection * *model_info.object_model_matrix);
+		glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+
+		for (unsigned int s = 0; s < model_info.submeshes->size(); s++)
+		{
+			const Submesh& submesh = model_info.submeshes->at(s);
+			unsigned int lod = model_info.submesh_lods[s];
+
+			pushRange(shadow_ranges, model_info.lods->at(submesh.first_lod + std::min(lod + shadow_lod_bias, submesh.lod_count - 1)), index_size, submesh.base_vertex);
+
+			if (model_info.frustum_cull)
+			{
+				continue;
+			}
+
+			glm::vec3 center = (submesh.aabb.max_v + submesh.aabb.min_v) * 0.5f;
+			glm::vec3 extents = (submesh.aabb.max_v - submesh.aabb.min_v) * 0.5f;
+
+			bool outside = false;
+			for (unsigned int p = 0; p < 6 && !outside; p++)
+			{
+				glm::vec3 normal = glm::vec3(planes[p]);
+				outside = glm::dot(normal, center) + planes[p].w < -glm::dot(glm::abs(normal), extents);
+			}
+
+			if (!outside)
+			{
+				pushRange(camera_ranges, model_info.lods->at(submesh.first_lod + lod), index_size, submesh.base_vertex);
+			}
+		}
+	}
+}
+
 void Renderer::Render()
 {
-	if (rendering_pipeline == RENDER_PIPELINE::DEFERRED)
+	updateTextureStreaming();
+	updateLods();
+
+	if (deferred)
 	{
+		// Sorting reorders the draw queue, so it has to finish before the frustum test starts writing to it
+		sortDrawQueue();
+		updateObjectData();
 		std::thread frustum_test_thread(UpdateFrustumTestResults, *camera_view_matrix, *camera_projection_matrix, &draw_queue);
-		std::thread sorting_thread(&Renderer::sortDrawQueue, this);
 
-		frustum_test_thread.detach();
-		sorting_thread.detach();
+		beginGPUTimer();
 
 		if (point_lights.size() > 0 && shadow_frames % 5 == 0)
 		{
@@ -213,18 +563,57 @@ void Renderer::Render()
 		}
 		shadow_frames++;
 
+		updateFrameUniforms();
+		updateLightUniforms();
+
+		frustum_test_thread.join();
+
+		updateSubmeshRanges();
+		buildInstanceGroups();
+		meshletCullPass();
 		clearDeferredBuffers();
-		deferredFillPass();
-		//SSAOPass();
+
+		if (rendering_pipeline == RENDER_PIPELINE::VISIBILITY)
+		{
+			visibilityPass();
+			visibilityResolvePass();
+		}
+		else
+		{
+			depth_prepass_active = useDepthPrepass(deferred_depth_prepass_mode, 0.5f, render_width * render_height);
+			if (depth_prepass_active)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, DeferredDataFrameBuffer);
+				glViewport(0, 0, render_width, render_height);
+				depthPrepass(lighting_model == LIGHTING_MODE::PBR ? 0.8f : 0.1f);
+			}
+
+			deferredFillPass();
+		}
+		if (ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE::AO_SSAO)
+		{
+			SSAOPass();
+		}
+		else if (ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE::AO_GTAO)
+		{
+			DepthPyramidPass();
+			GTAOPass();
+		}
+		depth_pyramid_valid = ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE::AO_GTAO;
+
 		deferredColorShader.use();
-		deferredColorShader.setInt("use_ssao", 2);
+		deferredColorShader.setInt("ao_mode", ambient_occlusion_mode);
 		deferredColorPass();
 
-		clearPrimaryBlurringFramebuffers();
-		blurPass(DeferredFinal_secondary_texture, SSAOFramebuffer_color, 2); // blooooom....
+		BloomPass(DeferredFinal_secondary_texture); // blooooom....
 
 		SoftShadowPass(2);
 
+		if (taa_enabled)
+			TAAResolvePass();
+
+		previous_unjittered_view_projection = *camera_unjittered_projection_matrix * *camera_view_matrix;
+
 		glViewport(0, 0, framebuffer_width, framebuffer_height);
 
 		clearDefaultFramebuffer();
@@ -234,19 +623,23 @@ void Renderer::Render()
 
 		quadShader.use();
 
+		// Without TAA the composite does the upscale from the render viewport
 		glActiveTexture(GL_TEXTURE0);
 		quadShader.setInt("screenTexture", 0);
-		glBindTexture(GL_TEXTURE_2D, DeferredFinal_primary_texture);
+		quadShader.setVec2("uv_scale", taa_enabled ? glm::vec2(1.0f) : getRenderUVScale());
+		glBindTexture(GL_TEXTURE_2D, taa_enabled ? taa_resolved_texture : DeferredFinal_primary_texture);
 
 		glActiveTexture(GL_TEXTURE1);
 		quadShader.setInt("bloomTexture", 1);
-		glBindTexture(GL_TEXTURE_2D, PrimaryBlurringFramebuffer_bloom_textures[0]);
+		quadShader.setFloat("bloom_strength", 1.0f / XRE_BLOOM_MIP_LEVELS);
+		glBindTexture(GL_TEXTURE_2D, Bloom_mip_chain_texture);
 
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 		glBindVertexArray(0);
 
-		frustum_test_thread.~thread();
-		sorting_thread.~thread();
+		endGPUTimer();
+		updateDynamicResolution();
+
 
 		if (!lightmaps_drawn)
 		{
@@ -266,11 +659,13 @@ void Renderer::Render()
 	}
 	else
 	{
-		std::thread frustum_test_thread(UpdateFrustumTestResults, *camera_view_matrix, *camera_projection_matrix, &draw_queue);
-		std::thread sorting_thread(&Renderer::sortDrawQueue, this);
+		// the forward pipeline builds no depth pyramid, the one left from a deferred frame is stale
+		depth_pyramid_valid = false;
 
-		frustum_test_thread.detach();
-		sorting_thread.detach();
+		// Sorting reorders the draw queue, so it has to finish before the frustum test starts writing to it
+		sortDrawQueue();
+		updateObjectData();
+		std::thread frustum_test_thread(UpdateFrustumTestResults, *camera_view_matrix, *camera_projection_matrix, &draw_queue);
 
 		if (point_lights.size() > 0 && shadow_frames % 10 == 0)
 		{
@@ -285,11 +680,28 @@ void Renderer::Render()
 		}
 		shadow_frames++;
 
+		updateFrameUniforms();
+		updateLightUniforms();
+
+		frustum_test_thread.join();
+
+		updateSubmeshRanges();
+		buildInstanceGroups();
+		meshletCullPass();
 		clearForwardFramebuffer();
+
+		// Forward shading is heavier per pixel, so the pre-pass pays off with more geometry
+		depth_prepass_active = useDepthPrepass(forward_depth_prepass_mode, 1.0f, framebuffer_width * framebuffer_height);
+		if (depth_prepass_active)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, ForwardFramebuffer);
+			glViewport(0, 0, framebuffer_width, framebuffer_height);
+			depthPrepass(0.1f);
+		}
+
 		ForwardColorPass();
 
-		clearPrimaryBlurringFramebuffers();
-		blurPass(ForwardFramebuffer_secondary_texture, ForwardFramebuffer_secondary_texture, 5); // blooooom....
+		BloomPass(ForwardFramebuffer_secondary_texture); // blooooom....
 
 		SoftShadowPass(2);
 
@@ -304,31 +716,51 @@ void Renderer::Render()
 
 		glActiveTexture(GL_TEXTURE0);
 		quadShader.setInt("screenTexture", 0);
+		quadShader.setVec2("uv_scale", glm::vec2(1.0f));
 		glBindTexture(GL_TEXTURE_2D, ForwardFramebuffer_primary_texture);
 
 		glActiveTexture(GL_TEXTURE1);
 		quadShader.setInt("bloomTexture", 1);
-		glBindTexture(GL_TEXTURE_2D, PrimaryBlurringFramebuffer_bloom_textures[0]);
+		quadShader.setFloat("bloom_strength", 1.0f / XRE_BLOOM_MIP_LEVELS);
+		glBindTexture(GL_TEXTURE_2D, Bloom_mip_chain_texture);
 
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 		glBindVertexArray(0);
 
-		frustum_test_thread.~thread();
-		sorting_thread.~thread();
 	}
+
+	fenceFrame();
 }
 
-void Renderer::pushToDrawQueue(unsigned int vertex_array_object, unsigned int indices_size,
-	const xre::Shader& object_shader, const glm::mat4& model_matrix,
+void Renderer::pushToDrawQueue(unsigned int vertex_array_object, unsigned int depth_vertex_array_object, unsigned int vertex_buffer_object, unsigned int element_buffer_object, unsigned int indices_size, unsigned int index_type,
+	const std::vector<MeshLod>* lods, unsigned int meshlet_buffer, unsigned int meshlet_count, const std::vector<Submesh>* submeshes, const xre::Shader& object_shader, const glm::mat4& model_matrix,
 	std::vector<Texture>* object_textures, std::vector<std::string>* texture_types,
 	std::string model_name, bool is_dynamic,
 	bool* setup_success, BoundingVolume aabb)
 
 
 {
+	if (submeshes != NULL && rendering_pipeline == RENDER_PIPELINE::VISIBILITY)
+	{
+		LOGGER->log(ERROR, "Renderer : pushToDrawQueue", "The visibility pipeline does not draw static batches, skipping " + model_name + ".");
+		return;
+	}
+
 	model_information model_info_i;
 	model_info_i.object_VAO = vertex_array_object;
+	model_info_i.depth_VAO = depth_vertex_array_object;
+	model_info_i.vertex_buffer = vertex_buffer_object;
+	model_info_i.index_buffer = element_buffer_object;
 	model_info_i.indices_size = indices_size;
+	model_info_i.index_type = index_type;
+	model_info_i.lods = lods;
+	model_info_i.meshlet_buffer = meshlet_buffer;
+	model_info_i.meshlet_count = meshlet_count;
+	model_info_i.submeshes = submeshes;
+	if (submeshes != NULL)
+	{
+		model_info_i.submesh_lods.assign(submeshes->size(), 0);
+	}
 	model_info_i.object_shader = &(object_shader);
 	model_info_i.object_model_matrix = &(model_matrix);
 	model_info_i.object_textures = object_textures;
@@ -338,6 +770,24 @@ void Renderer::pushToDrawQueue(unsigned int vertex_array_object, unsigned int in
 	model_info_i.dynamic = is_dynamic;
 	model_info_i.mesh_aabb = aabb;
 	model_info_i.frustum_cull = false;
+	model_info_i.previous_model_matrix = model_matrix;
+	model_info_i.object_id = (unsigned int)draw_queue.size();
+
+	// Materials whose diffuse texture carries alpha get the discarding pre-pass shader.
+	// Placeholders are resolved by updateTextureStreaming once the real format is known.
+	for (const Texture& texture : *object_textures)
+	{
+		if (texture.type == "texture_diffuse")
+		{
+			model_info_i.diffuse_texture = texture.id;
+			break;
+		}
+	}
+
+	if (material_textures.enabled())
+	{
+		model_info_i.material_id = material_textures.acquire(*object_textures);
+	}
 
 	*setup_success = true;
 
@@ -437,10 +887,12 @@ void Renderer::createDeferredBuffers()
 	glGenTextures(1, &DeferredFinal_primary_texture);
 	glBindTexture(GL_TEXTURE_2D, DeferredFinal_primary_texture);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, framebuffer_width, framebuffer_height, 0, GL_RGB, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, render_target_width, render_target_height, 0, GL_RGB, GL_FLOAT, NULL);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, DeferredFinal_primary_texture, 0);
@@ -450,10 +902,12 @@ void Renderer::createDeferredBuffers()
 	glGenTextures(1, &DeferredFinal_secondary_texture);
 	glBindTexture(GL_TEXTURE_2D, DeferredFinal_secondary_texture);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, framebuffer_width, framebuffer_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, render_target_width, render_target_height, 0, GL_RGB, GL_FLOAT, NULL);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, DeferredFinal_secondary_texture, 0);
@@ -468,11 +922,11 @@ void Renderer::createDeferredBuffers()
 	glGenFramebuffers(1, &DeferredDataFrameBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, DeferredDataFrameBuffer);
 
-	// Albedo Buffer (with alpha)
+	// Albedo Buffer, alpha : metallic (PBR) / specular (BlinnPhong)
 	glGenTextures(1, &DeferredGbuffer_color);
 	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_color);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, render_target_width, render_target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -481,40 +935,29 @@ void Renderer::createDeferredBuffers()
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, DeferredGbuffer_color, 0);
 	// ----------------------------------
 
-	// Normal Buffer
+	// Normal Buffer - octahedral normal (rg), roughness (b), flags (a)
 	glGenTextures(1, &DeferredGbuffer_normal);
 	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_normal);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, framebuffer_width, framebuffer_height, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, DeferredGbuffer_normal, 0);
-	// ----------------------------------
-
-	// Depth Buffer
-	glGenTextures(1, &DeferredGbuffer_depth);
-	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, framebuffer_width, framebuffer_height, 0, GL_RED, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, render_target_width, render_target_height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// octahedral normals can't be filtered across the fold
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, DeferredGbuffer_depth, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, DeferredGbuffer_normal, 0);
 	// ----------------------------------
 
-	// MOR Buffer - Metalness, Occlusion, Roughness
+	// Occlusion Buffer - metallic and roughness live in the color and normal alpha / blue channels
 	if (lighting_model == LIGHTING_MODE::PBR)
 	{
-		glGenTextures(1, &DeferredGbuffer_texture_mor);
-		glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_texture_mor);
+		glGenTextures(1, &DeferredGbuffer_occlusion);
+		glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_occlusion);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R3_G3_B2, framebuffer_width, framebuffer_height, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, render_target_width, render_target_height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -522,21 +965,42 @@ void Renderer::createDeferredBuffers()
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glBindTexture(GL_TEXTURE_2D, 0);
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, DeferredGbuffer_texture_mor, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, DeferredGbuffer_occlusion, 0);
 	}
 
 	// ----------------------------------
 
-	// ---------------------------------------------------------------------------------------------------------------------
+	// Velocity Buffer - always the last attachment
+	glGenTextures(1, &DeferredGbuffer_velocity);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_velocity);
 
-	glGenRenderbuffers(1, &DeferredRenderBuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, DeferredRenderBuffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, render_target_width, render_target_height, 0, GL_RG, GL_FLOAT, NULL);
 
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, framebuffer_width, framebuffer_height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DeferredRenderBuffer);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + num_draw_buffers - 1, GL_TEXTURE_2D, DeferredGbuffer_velocity, 0);
+	// ----------------------------------
+
+	// Depth Buffer - sampled directly by the lighting, SSAO, GTAO and TAA passes
+	glGenTextures(1, &DeferredGbuffer_depth);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, render_target_width, render_target_height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DeferredGbuffer_depth, 0);
+
+	// ---------------------------------------------------------------------------------------------------------------------
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		LOGGER->log(ERROR, "Renderer : GBuffer", "GBuffer is incomplete!");
@@ -555,6 +1019,14 @@ void Renderer::clearDeferredBuffers()
 	glBindFramebuffer(GL_FRAMEBUFFER, DeferredDataFrameBuffer);
 	glClearColor(bg_color.x, bg_color.y, bg_color.z, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// flags of 0 mark the background, the lighting pass passes the clear color through there
+	const float no_surface[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 1, no_surface);
+
+	const float no_motion[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, num_draw_buffers - 1, no_motion);
+
 	glBindFramebuffer(GL_FRAMEBUFFER, DeferredFinalBuffer);
 	glClear(GL_COLOR_BUFFER_BIT);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -565,17 +1037,17 @@ void Renderer::deferredFillPass()
 	glBindFramebuffer(GL_FRAMEBUFFER, DeferredDataFrameBuffer);
 	glDrawBuffers(num_draw_buffers, &DeferredFrameBuffer_primary_color_attachments[0]);
 	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
-	glViewport(0, 0, framebuffer_width, framebuffer_height);
+	glDepthFunc(depth_prepass_active ? GL_EQUAL : GL_LESS);
+	glDepthMask(depth_prepass_active ? GL_FALSE : GL_TRUE);
+	glViewport(0, 0, render_width, render_height);
 
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
 
 	deferredFillShader.use();
-	deferredFillShader.setMat4("view", *camera_view_matrix);
-	deferredFillShader.setMat4("projection", *camera_projection_matrix);
-	deferredFillShader.setVec3("camera_position", *camera_position);
+	material_textures.bind(deferredFillShader);
 
+	const int object_id_uniform = deferredFillShader.uniform("object_id");
 
 	for (unsigned int i = 0; i < draw_queue.size(); i++)
 	{
@@ -584,21 +1056,40 @@ void Renderer::deferredFillPass()
 			continue;
 		}
 
-		for (unsigned int j = 0; j < draw_queue[i].object_textures->size(); j++)
+		if (draw_queue[i].instance_count == 0)
 		{
-			glActiveTexture(GL_TEXTURE0 + j);
-			deferredFillShader.setInt(draw_queue[i].object_textures->at(j).type, j);
-			glBindTexture(GL_TEXTURE_2D, draw_queue[i].object_textures->at(j).id);
+			draw_queue[i].previous_model_matrix = *draw_queue[i].object_model_matrix;
+			continue;
+		}
+
+		// with material textures the vertex shader passes the object's material id on
+		if (!material_textures.enabled())
+		{
+			for (unsigned int j = 0; j < draw_queue[i].object_textures->size(); j++)
+			{
+				glActiveTexture(GL_TEXTURE0 + j);
+				deferredFillShader.setInt(draw_queue[i].object_textures->at(j).type, j);
+				glBindTexture(GL_TEXTURE_2D, draw_queue[i].object_textures->at(j).id);
+			}
+		}
+		else if (material_textures.bound(draw_queue[i].material_id))
+		{
+			material_textures.bindMaterial(draw_queue[i].material_id);
 		}
 
-		deferredFillShader.setMat4("model", *draw_queue[i].object_model_matrix);
+		deferredFillShader.setUInt(object_id_uniform, draw_queue[i].object_id);
+		setInstanceUniforms(deferredFillShader, draw_queue[i]);
 
 		glBindVertexArray(draw_queue[i].object_VAO);
-		glDrawElements(GL_TRIANGLES, draw_queue[i].indices_size, GL_UNSIGNED_INT, 0);
+		drawCameraView(draw_queue[i]);
 		glBindVertexArray(0);
 
+		draw_queue[i].previous_model_matrix = *draw_queue[i].object_model_matrix;
+
 	}
 
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
 	glDisable(GL_CULL_FACE);
 	glDisable(GL_DEPTH_TEST);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -610,22 +1101,12 @@ void Renderer::deferredColorPass()
 	glDrawBuffers(2, &DeferredFinal_attachments[0]);
 
 	glDisable(GL_DEPTH_TEST);
-	glViewport(0, 0, framebuffer_width, framebuffer_height);
+	glViewport(0, 0, render_width, render_height);
 
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
 
-	deferredColorShader.setMat4("view", *camera_view_matrix);
-	deferredColorShader.setVec3("camera_pos", *camera_position);
-	deferredColorShader.setVec3("camera_look_direction", *camera_front);
-	deferredColorShader.setFloat("near", light_near_plane);
-	deferredColorShader.setFloat("far", light_far_plane);
-	deferredColorShader.setBool("directional_lighting_enabled", directional_light != NULL);
-	deferredColorShader.setInt("N_POINT", point_lights.size());
-	deferredColorShader.setMat4("inv_projection", glm::inverse(*camera_projection_matrix));
-	deferredColorShader.setMat4("inv_view", glm::inverse(*camera_view_matrix));
-	deferredColorShader.setFloat("positive_exponent", positive_exponent);
-	deferredColorShader.setFloat("negative_exponent", negative_exponent);
+	deferredColorShader.setVec2("uv_scale", getRenderUVScale());
 
 	glActiveTexture(GL_TEXTURE0);
 	deferredColorShader.setInt("diffuse_texture", 0);
@@ -640,12 +1121,12 @@ void Renderer::deferredColorPass()
 	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
 
 	glActiveTexture(GL_TEXTURE3);
-	deferredColorShader.setInt("ssao_texture", 3);
-	glBindTexture(GL_TEXTURE_2D, PrimaryBlurringFramebuffer_ssao_textures[0]);
+	deferredColorShader.setInt("ao_texture", 3);
+	glBindTexture(GL_TEXTURE_2D, ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE::AO_GTAO ? GTAO_texture : SSAOFramebuffer_color);
 
 	glActiveTexture(GL_TEXTURE4);
-	deferredColorShader.setInt("mor_texture", 4);
-	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_texture_mor);
+	deferredColorShader.setInt("occlusion_texture", 4);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_occlusion);
 
 	glActiveTexture(GL_TEXTURE5);
 	deferredColorShader.setInt("diffuse_irradiance_light_probe_cubemaps", 5);
@@ -664,24 +1145,13 @@ void Renderer::deferredColorPass()
 		glActiveTexture(GL_TEXTURE8);
 		glBindTexture(GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[0]);
 		deferredColorShader.setInt("directional_shadow_depth_map", 8);
-
-		deferredColorShader.setMat4("directional_light_space_matrix", directional_light_space_matrix);
 	}
 
-	std::stringstream ss;
 	for (unsigned int i = 0; i < XRE_MAX_POINT_SHADOW_MAPS; i++)
 	{
-		ss.str("");
-		ss << '[' << i << ']';
-
 		glActiveTexture(GL_TEXTURE9 + i);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, point_shadow_depth_storage[i]);
-		deferredColorShader.setInt("point_shadow_depth_map" + ss.str(), 9 + i);
-	}
-
-	for (unsigned int l = 0; l < lights.size(); l++)
-	{
-		lights[l]->SetShaderAttrib(lights[l]->m_name, deferredColorShader);
+		deferredColorShader.setInt(deferredColorShader.uniform("point_shadow_depth_map", i), 9 + i);
 	}
 
 	glBindVertexArray(quadVAO);
@@ -719,9 +1189,9 @@ void Renderer::directionalShadowPass()
 
 		for (unsigned int i = 0; i < draw_queue.size(); i++)
 		{
-			depthShader_directional.setMat4("model", *draw_queue[i].object_model_matrix);
-			glBindVertexArray(draw_queue[i].object_VAO);
-			glDrawElements(GL_TRIANGLES, draw_queue[i].indices_size, GL_UNSIGNED_INT, 0);
+			depthShader_directional.setUInt("object_id", draw_queue[i].object_id);
+			glBindVertexArray(draw_queue[i].depth_VAO);
+			drawShadowView(draw_queue[i]);
 			glBindVertexArray(0);
 		}
 	}
@@ -772,9 +1242,9 @@ void Renderer::pointShadowPass()
 					continue;
 				}
 
-				depthShader_point.setMat4("model", *draw_queue[i].object_model_matrix);
-				glBindVertexArray(draw_queue[i].object_VAO);
-				glDrawElements(GL_TRIANGLES, draw_queue[i].indices_size, GL_UNSIGNED_INT, 0);
+				depthShader_point.setUInt("object_id", draw_queue[i].object_id);
+				glBindVertexArray(draw_queue[i].depth_VAO);
+				drawShadowView(draw_queue[i]);
 				glBindVertexArray(0);
 			}
 
@@ -795,9 +1265,9 @@ void Renderer::pointShadowPass()
 			if (glm::length(object_bb_position - point_lights[k]->m_position) > 3)
 				continue;
 
-			depthShader_point.setMat4("model", *draw_queue[i].object_model_matrix);
-			glBindVertexArray(draw_queue[i].object_VAO);
-			glDrawElements(GL_TRIANGLES, draw_queue[i].indices_size, GL_UNSIGNED_INT, 0);
+			depthShader_point.setUInt("object_id", draw_queue[i].object_id);
+			glBindVertexArray(draw_queue[i].depth_VAO);
+			drawShadowView(draw_queue[i]);
 			glBindVertexArray(0);
 		}
 	}
@@ -866,6 +1336,8 @@ void Renderer::createForwardFramebuffers()
 void Renderer::ForwardColorPass() // draw everything to Framebuffer. 2nd pass.
 {
 	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(depth_prepass_active ? GL_EQUAL : GL_LESS);
+	glDepthMask(depth_prepass_active ? GL_FALSE : GL_TRUE);
 	glViewport(0, 0, framebuffer_width, framebuffer_height);
 
 	glEnable(GL_CULL_FACE);
@@ -874,21 +1346,17 @@ void Renderer::ForwardColorPass() // draw everything to Framebuffer. 2nd pass.
 	glBindFramebuffer(GL_FRAMEBUFFER, ForwardFramebuffer);
 	glDrawBuffers(2, &ForwardFramebuffer_Color_Attachments[0]);
 
-	std::stringstream ss;
-
 	for (unsigned int i = 0; i < draw_queue.size(); i++) //optimize state changes.
 	{
-		if (draw_queue[i].frustum_cull == true)
+		if (draw_queue[i].frustum_cull == true || draw_queue[i].instance_count == 0)
 		{
 			continue;
 		}
 
 		draw_queue[i].object_shader->use();
 
-		draw_queue[i].object_shader->setFloat("near", light_near_plane);
-		draw_queue[i].object_shader->setFloat("far", light_far_plane);
-		draw_queue[i].object_shader->setBool("directional_lighting_enabled", directional_light != NULL);
-		draw_queue[i].object_shader->setInt("N_POINT", point_lights.size());
+		draw_queue[i].object_shader->setUInt("object_id", draw_queue[i].object_id);
+		setInstanceUniforms(*draw_queue[i].object_shader, draw_queue[i]);
 
 		unsigned int j;
 		for (j = 0; j < draw_queue[i].object_textures->size(); j++)
@@ -902,15 +1370,10 @@ void Renderer::ForwardColorPass() // draw everything to Framebuffer. 2nd pass.
 		{
 			for (unsigned int k = j; k < XRE_MAX_POINT_SHADOW_MAPS + j; k++)
 			{
-				ss.str("");
-				ss << "[" << k - j + 1 << "]";
+				draw_queue[i].object_shader->setVec3(draw_queue[i].object_shader->uniform("light_position_vertex", k - j + 1), point_lights[k - j]->m_position);
 
-				draw_queue[i].object_shader->setVec3("light_position_vertex" + ss.str(), point_lights[k - j]->m_position);
-
-				ss.str("");
-				ss << "[" << k - j << "]";
 				glActiveTexture(GL_TEXTURE0 + k);
-				draw_queue[i].object_shader->setInt("point_shadow_depth_map" + ss.str(), k);
+				draw_queue[i].object_shader->setInt(draw_queue[i].object_shader->uniform("point_shadow_depth_map", k - j), k);
 				glBindTexture(GL_TEXTURE_CUBE_MAP, point_shadow_depth_storage[k - j]);
 			}
 		}
@@ -919,9 +1382,6 @@ void Renderer::ForwardColorPass() // draw everything to Framebuffer. 2nd pass.
 
 		if (directional_light != NULL)
 		{
-			draw_queue[i].object_shader->setMat4("directional_light_space_matrix", directional_light_space_matrix);
-			draw_queue[i].object_shader->setVec3("directional_light_position", directional_light->m_position);
-
 			glActiveTexture(GL_TEXTURE0 + j);
 			draw_queue[i].object_shader->setInt("directional_shadow_depth_map", j);
 			glBindTexture(GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[0]);
@@ -929,285 +1389,1271 @@ void Renderer::ForwardColorPass() // draw everything to Framebuffer. 2nd pass.
 			draw_queue[i].object_shader->setVec3("light_position_vertex[0]", directional_light->m_position);
 		}
 
-		for (unsigned int l = 0; l < lights.size(); l++)
-		{
-			lights[l]->SetShaderAttrib(lights[l]->m_name, *draw_queue[i].object_shader);
-		}
-
 		glBindVertexArray(draw_queue[i].object_VAO);
-		glDrawElements(GL_TRIANGLES, draw_queue[i].indices_size, GL_UNSIGNED_INT, 0);
+		drawCameraView(draw_queue[i]);
 		glBindVertexArray(0);
 
 	}
 
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
 	glDisable(GL_CULL_FACE);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void Renderer::clearForwardFramebuffer()
+// Lays down depth only, for the framebuffer and viewport bound by the caller.
+void Renderer::depthPrepass(float alpha_cutoff)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, ForwardFramebuffer);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-	glClearColor(bg_color.x, bg_color.y, bg_color.z, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawPositionOnly(depth_prepass_Shader, depth_prepass_alpha_Shader, alpha_cutoff);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
-void Renderer::clearDefaultFramebuffer()
+// Opaque geometry with the position only shader first, then the alpha tested geometry.
+// Both shaders get the draw queue index as draw_id.
+void Renderer::drawPositionOnly(const Shader& opaque_shader, const Shader& alpha_tested_shader, float alpha_cutoff)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glClearColor(bg_color.x, bg_color.y, bg_color.z, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+
+	for (unsigned int pass = 0; pass < 2; pass++)
+	{
+		bool alpha_pass = pass == 1;
+		const Shader& pass_shader = alpha_pass ? alpha_tested_shader : opaque_shader;
+
+		pass_shader.use();
+
+		if (alpha_pass)
+		{
+			pass_shader.setFloat("alpha_cutoff", alpha_cutoff);
+			if (material_textures.enabled())
+			{
+				material_textures.bind(pass_shader);
+			}
+			else
+			{
+				pass_shader.setInt("texture_diffuse", 0);
+				glActiveTexture(GL_TEXTURE0);
+			}
+		}
+
+		const int draw_id_uniform = pass_shader.uniform("draw_id");
+		const int object_id_uniform = pass_shader.uniform("object_id");
+
+		for (unsigned int i = 0; i < draw_queue.size(); i++)
+		{
+			if (draw_queue[i].frustum_cull == true || draw_queue[i].instance_count == 0 || draw_queue[i].alpha_tested != alpha_pass)
+			{
+				continue;
+			}
+
+			if (alpha_pass && !material_textures.enabled())
+			{
+				glBindTexture(GL_TEXTURE_2D, draw_queue[i].diffuse_texture);
+			}
+			else if (alpha_pass && material_textures.bound(draw_queue[i].material_id))
+			{
+				material_textures.bindMaterial(draw_queue[i].material_id);
+			}
+
+			pass_shader.setUInt(draw_id_uniform, i);
+			pass_shader.setUInt(object_id_uniform, draw_queue[i].object_id);
+			setInstanceUniforms(pass_shader, draw_queue[i]);
+
+			// the alpha tested shader also needs the uvs
+			glBindVertexArray(alpha_pass ? draw_queue[i].object_VAO : draw_queue[i].depth_VAO);
+			drawCameraView(draw_queue[i]);
+		}
+	}
+
+	glBindVertexArray(0);
+	glDisable(GL_CULL_FACE);
 }
 
-void Renderer::clearDirectionalShadowMapFramebuffer()
+void Renderer::createMeshletCullData()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, directional_shadow_framebuffer);
-	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGenBuffers(1, &MeshletCommand_buffer);
+	glGenBuffers(1, &MeshletCount_buffer);
 }
 
-void Renderer::clearDirectionalShadowBlurringFramebuffers()
+// Culls the meshlets of every visible draw against the camera and compacts the survivors into indirect commands
+// for this frame's camera passes. The visibility pipeline keeps whole draws, its triangle ids rely on
+// gl_PrimitiveID counting from the first index of the level.
+void Renderer::meshletCullPass()
 {
-	for (unsigned int i = 0; i < 2; i++)
+	unsigned int command_count = 0;
+	for (model_information& model_info : draw_queue)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[i]);
-		glClearColor(1.0, 1.0, 1.0, 1.0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		model_info.meshlets_culled = meshlet_culling && rendering_pipeline != RENDER_PIPELINE::VISIBILITY
+			&& !model_info.frustum_cull && model_info.lod == 0 && model_info.meshlet_count > 1 && model_info.instance_count == 1;
+
+		if (model_info.meshlets_culled)
+		{
+			model_info.meshlet_commands = command_count;
+			command_count += model_info.meshlet_count;
+		}
 	}
-}
 
-void Renderer::clearPointShadowFramebuffer()
-{
-	glColorMask(false, false, true, true);
-	for (unsigned int i = 0; i < XRE_MAX_POINT_SHADOW_MAPS; i++)
+	if (command_count == 0)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, point_shadow_framebuffer[i]);
-		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+		return;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glColorMask(true, true, true, true);
-
-}
 
-void Renderer::clearPrimaryBlurringFramebuffers()
-{
-	glClearColor(bg_color.r, bg_color.g, bg_color.b, 1.0);
-	for (unsigned int i = 0; i < 2; i++)
+	if (command_count > meshlet_command_capacity)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, PrimaryBlurringFramebuffers[i]);
-		glClear(GL_COLOR_BUFFER_BIT);
+		meshlet_command_capacity = std::max(command_count, meshlet_command_capacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, MeshletCommand_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshlet_command_capacity * sizeof(draw_elements_indirect_command), NULL, GL_DYNAMIC_DRAW);
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
+	unsigned int draw_count = (unsigned int)draw_queue.size();
+	if (draw_count > meshlet_count_capacity)
+	{
+		meshlet_count_capacity = std::max(draw_count, meshlet_count_capacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, MeshletCount_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshlet_count_capacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+	}
 
-void Renderer::createDirectionalLightMatrix(glm::vec3 light_position, glm::vec3 light_front)
-{
-	directional_light_projection = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, light_near_plane, light_far_plane);
-	directional_light_space_matrix = directional_light_projection * glm::lookAt(light_position, glm::vec3(0.0f), glm::cross(xre::WORLD_RIGHT, light_front));
-}
+	// zeroed commands past the survivors draw nothing
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, MeshletCommand_buffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, command_count * sizeof(draw_elements_indirect_command), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, MeshletCount_buffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, draw_count * sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-void Renderer::createPointLightMatrices(glm::vec3 light_position, unsigned int light_index)
-{
-	point_light_space_matrix_cube plsmc;
-	point_light_projection = glm::perspective(glm::radians(90.0f), 1.0f, light_near_plane, light_far_plane);
+	// Single pass against last frame's pyramid, rejected meshlets are not tested again once this frame's depth
+	// exists. A meshlet that was hidden last frame and is uncovered this frame is missing for that one frame.
+	bool occlusion = meshlet_occlusion_culling && depth_pyramid_valid;
 
-	plsmc.point_light_space_matrix_0 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-	plsmc.point_light_space_matrix_1 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-	plsmc.point_light_space_matrix_2 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	plsmc.point_light_space_matrix_3 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
-	plsmc.point_light_space_matrix_4 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-	plsmc.point_light_space_matrix_5 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	meshlet_cull_Shader.use();
+	meshlet_cull_Shader.setBool("occlusion_culling", occlusion);
+	if (occlusion)
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, DepthPyramid_texture);
+		meshlet_cull_Shader.setInt("depth_pyramid", 0);
+		meshlet_cull_Shader.setVec2("pyramid_size", depth_pyramid_size);
+		meshlet_cull_Shader.setInt("max_pyramid_level", depth_pyramid_levels - 1);
+	}
 
-	point_light_space_matrix_cube_array[light_index] = plsmc;
-}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_MESHLET_COMMANDS, MeshletCommand_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_MESHLET_COUNTS, MeshletCount_buffer);
 
-void Renderer::createBlurringFramebuffers()
-{
-	// Primary Blurring Framebuffers
-	glGenFramebuffers(2, PrimaryBlurringFramebuffers);
-	glGenTextures(2, &PrimaryBlurringFramebuffer_bloom_textures[0]);
-	glGenTextures(2, &PrimaryBlurringFramebuffer_ssao_textures[0]);
+	const glm::mat4 view_projection = *camera_projection_matrix * *camera_view_matrix;
+	const int frustum_planes_uniform = meshlet_cull_Shader.uniform("frustum_planes");
 
-	for (unsigned int i = 0; i < 2; i++)
+	for (unsigned int i = 0; i < draw_queue.size(); i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, PrimaryBlurringFramebuffers[i]);
-
-		glBindTexture(GL_TEXTURE_2D, PrimaryBlurringFramebuffer_bloom_textures[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, framebuffer_width / 4, framebuffer_height / 4, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, PrimaryBlurringFramebuffer_bloom_textures[i], 0);
+		const model_information& model_info = draw_queue[i];
+		if (!model_info.meshlets_culled)
+		{
+			continue;
+		}
 
-		glBindTexture(GL_TEXTURE_2D, PrimaryBlurringFramebuffer_ssao_textures[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, framebuffer_width / 4, framebuffer_height / 4, 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, PrimaryBlurringFramebuffer_ssao_textures[i], 0);
+		const glm::mat4& model = *model_info.object_model_matrix;
 
-		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+		// Gribb / Hartmann, the planes of the full transform are in object space
+		glm::mat4 rows = glm::transpose(view_projection * model);
+		glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+		for (unsigned int p = 0; p < 6; p++)
 		{
-			LOGGER->log(INFO, "Render System : createFramebuffer", "PrimaryBlurring Framebuffer complete.");
+			planes[p] /= glm::length(glm::vec3(planes[p]));
 		}
-		else
+		meshlet_cull_Shader.setVec4(frustum_planes_uniform, planes, 6);
+
+		meshlet_cull_Shader.setVec3("eye", glm::vec3(glm::inverse(model) * glm::vec4(*camera_position, 1.0f)));
+		meshlet_cull_Shader.setUInt("meshlet_count", model_info.meshlet_count);
+		meshlet_cull_Shader.setUInt("first_command", model_info.meshlet_commands);
+		meshlet_cull_Shader.setUInt("draw_index", i);
+
+		if (occlusion)
 		{
-			LOGGER->log(ERROR, "Render System : createFramebuffer", "PrimaryBlurring Framebuffer incomplete!");
+			const glm::mat4& previous_model = model_info.previous_model_matrix;
+			meshlet_cull_Shader.setMat4("previous_model_view_projection", previous_unjittered_view_projection * previous_model);
+			meshlet_cull_Shader.setFloat("view_scale", std::max(glm::length(glm::vec3(previous_model[0])), std::max(glm::length(glm::vec3(previous_model[1])), glm::length(glm::vec3(previous_model[2])))));
 		}
-	}
 
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_MESHLETS, model_info.meshlet_buffer);
+		glDispatchCompute((model_info.meshlet_count + XRE_MESHLET_CULL_GROUP_SIZE - 1) / XRE_MESHLET_CULL_GROUP_SIZE, 1, 1);
+	}
 
-	PrimaryBlurringFramebuffers_attachments[0] = GL_COLOR_ATTACHMENT0;
-	PrimaryBlurringFramebuffers_attachments[1] = GL_COLOR_ATTACHMENT1;
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
 
-	clearPrimaryBlurringFramebuffers();
+void Renderer::createInstanceBuffer()
+{
+	glGenBuffers(1, &Instance_buffer);
+}
 
-	// Shadow Blurring Framebuffers
-	glGenFramebuffers(2, DirectionalShadowBlurringFramebuffers);
-	glGenTextures(2, &DirectionalShadowBlurring_soft_shadow_textures[0]);
+// Visible entries sharing a vertex array, level, shader and textures become one instanced draw, issued by the
+// closest one, so the draw queue order still holds between groups. Static batches and the visibility pipeline,
+// whose ids name a single draw, always draw alone. Grouped entries skip meshlet culling.
+void Renderer::buildInstanceGroups()
+{
+	std::map<instance_key, unsigned int> groups; // first entry of each group
 
-	for (unsigned int i = 0; i < 2; i++)
+	for (unsigned int i = 0; i < draw_queue.size(); i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[i]);
-
-		glBindTexture(GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, shadow_map_width * 4, 4 * shadow_map_height, 0, GL_RED, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[i], 0);
+		model_information& model_info = draw_queue[i];
+		model_info.instance_count = 1;
+		model_info.instance_leader = i;
 
-		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+		if (!instancing || rendering_pipeline == RENDER_PIPELINE::VISIBILITY || model_info.frustum_cull || model_info.submeshes != NULL)
 		{
-			LOGGER->log(INFO, "Render System : createFramebuffer", "DirectionalShadowBlurring Framebuffer complete.");
+			continue;
 		}
-		else
+
+		instance_key key = std::make_tuple(model_info.object_VAO, model_info.lod, model_info.object_shader, (const std::vector<Texture>*)model_info.object_textures);
+		auto group = groups.find(key);
+		if (group == groups.end())
 		{
-			LOGGER->log(ERROR, "Render System : createFramebuffer", "DirectionalShadowBlurring Framebuffer incomplete!");
+			groups.emplace(key, i);
+			continue;
 		}
-	}
 
-	clearPrimaryBlurringFramebuffers();
-
-}
+		model_info.instance_count = 0;
+		model_info.instance_leader = group->second;
+		draw_queue[group->second].instance_count++;
+	}
 
-void Renderer::addToLights(Light* light)
-{
-	if (typeid(*light) == typeid(DirectionalLight))
+	unsigned int instance_total = 0;
+	for (model_information& model_info : draw_queue)
 	{
-		if (directional_light == NULL)
+		if (model_info.instance_count > 1)
 		{
-			directional_light = (DirectionalLight*)light;
+			model_info.instance_offset = instance_total;
+			instance_total += model_info.instance_count;
 		}
-		else
+	}
+
+	if (instance_total == 0)
+	{
+		return;
+	}
+
+	// the leader first, then its group in draw queue order
+	instances.resize(instance_total);
+	std::vector<unsigned int> written(draw_queue.size(), 0);
+	for (const model_information& model_info : draw_queue)
+	{
+		const model_information& leader = draw_queue[model_info.instance_leader];
+		if (leader.instance_count < 2)
 		{
-			LOGGER->log(ERROR, " Renderer::addToRenderer(Light* light)", "Cannot have more than 1 directional light.");
+			continue;
 		}
+
+		instance_data& instance = instances[leader.instance_offset + written[model_info.instance_leader]++];
+		instance.model = *model_info.object_model_matrix;
+		instance.previous_model = model_info.previous_model_matrix;
 	}
-	else
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, Instance_buffer);
+	if (instance_total > instance_capacity)
 	{
-		point_lights.push_back((PointLight*)light);
+		instance_capacity = std::max(instance_total, instance_capacity * 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, instance_capacity * sizeof(instance_data), NULL, GL_DYNAMIC_DRAW);
 	}
-	lights.push_back(light);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instance_total * sizeof(instance_data), instances.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_INSTANCES, Instance_buffer);
 }
 
-void Renderer::setCameraMatrices(const glm::mat4* view, const glm::mat4* projection, const glm::vec3* position, const glm::vec3* front)
+void Renderer::setInstanceUniforms(const Shader& shader, const model_information& model_info)
 {
-	camera_view_matrix = view;
-	camera_projection_matrix = projection;
-	camera_position = position;
-	camera_front = front;
+	shader.setBool("instanced", model_info.instance_count > 1);
+	shader.setUInt("instance_offset", model_info.instance_offset);
 }
 
-void Renderer::blurPass(unsigned int main_color_texture, unsigned int ssao_texture, unsigned int amount)
+const char* const Renderer::frame_block = R"(
+// Renderer::frame_uniforms, filled by Renderer::updateFrameUniforms
+layout (std140, binding = 1) uniform Frame
 {
-	glDisable(GL_DEPTH_TEST);
+	mat4 view;
+	mat4 projection;
+	mat4 inv_view;
+	mat4 inv_projection;
+	mat4 unjittered_view_projection;
+	mat4 previous_view_projection;	// unjittered
+	mat4 directional_light_space_matrix;
+	vec3 camera_position;
+	float near;						// of the shadow maps
+	vec3 camera_look_direction;
+	float far;
+	float positive_exponent;
+	float negative_exponent;
+};
+)";
+
+const char* const Renderer::object_block = R"(
+// Renderer::object_data, filled by Renderer::updateObjectData and indexed by the draw queue entry's object id
+struct Object
+{
+	mat4 model;
+	mat4 previous_model;
+	mat4 normal_matrix;		// inverse transpose of the model matrix, upper 3x3
+	vec4 position_min;		// mesh bounds the positions are quantized to
+	vec4 position_extent;
+	uint material_id;
+};
+
+layout (std430, binding = 7) readonly buffer Objects
+{
+	Object objects[];
+};
+
+uniform uint object_id;
+
+// xre::CompactVertex : position quantized to the mesh bounds
+vec3 DecodePosition(vec4 position)
+{
+	return objects[object_id].position_min.xyz + position.xyz * objects[object_id].position_extent.xyz;
+}
+)";
 
-	bloomSSAO_blur_Shader.use();
-	first_iteration = true;
+// Programs drawn outside the draw queue, Mesh::setPositionDecode sets the bounds
+static const char* position_uniforms_block = R"(
+uniform vec3 position_min;
+uniform vec3 position_extent;
 
-	horizontal = true;
+// xre::CompactVertex : position quantized to the mesh bounds
+vec3 DecodePosition(vec4 position)
+{
+	return position_min + position.xyz * position_extent;
+}
+)";
+
+static const char* octahedral_block = R"(
+// xre::CompactVertex : octahedral normal / tangent
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+)";
 
-	for (unsigned int i = 0; i < amount; i++)
+std::string Renderer::shaderPreamble(unsigned int blocks)
+{
+	std::string preamble;
+	if (blocks & SHADER_PREAMBLE_FRAME)
+	{
+		preamble += frame_block;
+	}
+	if (blocks & SHADER_PREAMBLE_OBJECTS)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, PrimaryBlurringFramebuffers[horizontal]);
-		glDrawBuffers(2, &PrimaryBlurringFramebuffers_attachments[0]);
+		preamble += object_block;
+	}
+	else if (blocks & SHADER_PREAMBLE_POSITION_UNIFORMS)
+	{
+		preamble += position_uniforms_block;
+	}
+	if (blocks & (SHADER_PREAMBLE_OBJECTS | SHADER_PREAMBLE_POSITION_UNIFORMS))
+	{
+		preamble += octahedral_block;
+	}
 
-		bloomSSAO_blur_Shader.setBool("horizontal", horizontal);
+	// keeps the line numbers of the compile errors pointing into the shader file
+	return preamble.empty() ? preamble : preamble + "#line 2\n";
+}
 
-		glViewport(0, 0, framebuffer_width / 4, framebuffer_height / 4);
+void Renderer::createUniformBuffers()
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	frame_uniform_stride = (unsigned int)((sizeof(frame_uniforms) + alignment - 1) / alignment * alignment);
 
-		glActiveTexture(GL_TEXTURE0);
-		bloomSSAO_blur_Shader.setInt("inputTexture_1", 0);
-		glBindTexture(GL_TEXTURE_2D, first_iteration ? main_color_texture : PrimaryBlurringFramebuffer_bloom_textures[!horizontal]);
+	glGenBuffers(1, &Frame_UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, Frame_UBO);
+	glBufferData(GL_UNIFORM_BUFFER, XRE_FRAME_UNIFORM_SLOTS * frame_uniform_stride, NULL, GL_DYNAMIC_DRAW);
 
-		glActiveTexture(GL_TEXTURE1);
-		bloomSSAO_blur_Shader.setInt("inputTexture_2", 1);
-		glBindTexture(GL_TEXTURE_2D, first_iteration ? ssao_texture : PrimaryBlurringFramebuffer_ssao_textures[!horizontal]);
+	glGenBuffers(1, &Lights_UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, Lights_UBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(light_uniforms), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-		glBindVertexArray(quadVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		glBindVertexArray(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, XRE_UBO_BINDING_LIGHTS, Lights_UBO);
+}
+
+void Renderer::createObjectBuffer(unsigned int capacity)
+{
+	if (Object_buffer != 0)
+	{
+		for (unsigned int region = 0; region < XRE_OBJECT_BUFFER_FRAMES; region++)
+		{
+			waitForFence(object_fences[region]);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, Object_buffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glDeleteBuffers(1, &Object_buffer);
+	}
 
-		horizontal = !horizontal;
+	GLint alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	object_region_size = (unsigned int)((capacity * sizeof(object_data) + alignment - 1) / alignment * alignment);
+	object_capacity = capacity;
 
-		if (first_iteration)
-			first_iteration = false;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &Object_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, Object_buffer);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)XRE_OBJECT_BUFFER_FRAMES * object_region_size, NULL, flags);
+	object_buffer_mapping = (unsigned char*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)XRE_OBJECT_BUFFER_FRAMES * object_region_size, flags);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (object_buffer_mapping == NULL)
+	{
+		LOGGER->log(ERROR, "Renderer::createObjectBuffer", "Could not map the object buffer.");
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// a new buffer holds nothing yet, in any region
+	std::fill(object_pending.begin(), object_pending.end(), XRE_OBJECT_BUFFER_FRAMES);
 }
 
-void Renderer::SoftShadowPass(unsigned int amount)
+// Right after the draw queue is sorted, writes the objects into this frame's region. An object is written when it
+// is added or, for dynamic objects, when its matrices change, and again in the following frames until every region
+// holds the same data. Static objects are only written while they are new.
+void Renderer::updateObjectData()
 {
-	if (directional_light)
+	if (draw_queue.empty())
 	{
-		glDisable(GL_DEPTH_TEST);
-		glViewport(0, 0, shadow_map_width * 4, 4 * shadow_map_height);
-
-		directional_shadow_blur_Shader.use();
-		first_iteration = true;
+		return;
+	}
 
-		horizontal = true;
+	objects.resize(draw_queue.size());
+	object_pending.resize(draw_queue.size(), XRE_OBJECT_BUFFER_FRAMES);
 
-		for (unsigned int i = 0; i < amount; i++)
-		{
-			glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[horizontal]);
+	if (draw_queue.size() > object_capacity)
+	{
+		createObjectBuffer(std::max((unsigned int)draw_queue.size(), object_capacity * 2));
+	}
 
-			directional_shadow_blur_Shader.setBool("horizontal", horizontal);
+	if (object_buffer_mapping == NULL)
+	{
+		return;
+	}
 
-			glActiveTexture(GL_TEXTURE0);
-			directional_shadow_blur_Shader.setInt("inputTexture_1", 0);
-			glBindTexture(GL_TEXTURE_2D, first_iteration ? directional_shadow_depth_storage : DirectionalShadowBlurring_soft_shadow_textures[!horizontal]);
+	object_region = (object_region + 1) % XRE_OBJECT_BUFFER_FRAMES;
+	waitForFence(object_fences[object_region]);
 
-			glBindVertexArray(quadVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 6);
-			glBindVertexArray(0);
+	unsigned char* region = object_buffer_mapping + (size_t)object_region * object_region_size;
+	for (const model_information& model_info : draw_queue)
+	{
+		object_data& object = objects[model_info.object_id];
+		unsigned int& pending = object_pending[model_info.object_id];
 
-			horizontal = !horizontal;
+		// only dynamic objects move, a change restarts the writes so that every region ends up with the newest data
+		if (model_info.dynamic && (object.model != *model_info.object_model_matrix || object.previous_model != model_info.previous_model_matrix))
+		{
+			pending = XRE_OBJECT_BUFFER_FRAMES;
+		}
 
-			if (first_iteration)
-				first_iteration = false;
+		if (pending == 0)
+		{
+			continue;
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		object.model = *model_info.object_model_matrix;
+		object.previous_model = model_info.previous_model_matrix;
+		object.normal_matrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(object.model))));
+		object.position_min = glm::vec4(model_info.mesh_aabb.min_v, 0.0f);
+		object.position_extent = glm::vec4(model_info.mesh_aabb.max_v - model_info.mesh_aabb.min_v, 0.0f);
+		object.material_id = model_info.material_id;
+
+		memcpy(region + model_info.object_id * sizeof(object_data), &object, sizeof(object_data));
+		pending--;
 	}
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_OBJECTS, Object_buffer, (GLintptr)object_region * object_region_size, object_region_size);
 }
 
-void Renderer::createQuad()
+// Ring buffer slots are fenced after the frame that wrote them, this only blocks when the GPU is that many frames behind.
+void Renderer::waitForFence(GLsync& fence)
 {
-	float quadVertices[] = {
-		// positions   // texCoords
-		-1.0f,  1.0f,  0.0f, 1.0f,
-		-1.0f, -1.0f,  0.0f, 0.0f,
-		 1.0f, -1.0f,  1.0f, 0.0f,
-
+	if (fence == NULL)
+	{
+		return;
+	}
+
+	// the first wait flushes, so the fence is sure to be reached
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	while (result == GL_TIMEOUT_EXPIRED)
+	{
+		result = glClientWaitSync(fence, 0, 1000000000);
+	}
+
+	if (result == GL_WAIT_FAILED)
+	{
+		LOGGER->log(ERROR, "Renderer::waitForFence", "Waiting for a ring buffer fence failed.");
+	}
+
+	glDeleteSync(fence);
+	fence = NULL;
+}
+
+// After the last pass of the frame, the object region and frame uniform slot written this frame are free again
+// once the fence is reached.
+void Renderer::fenceFrame()
+{
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	if (frame_uniform_fences[frame_uniform_slot] != NULL)
+	{
+		glDeleteSync(frame_uniform_fences[frame_uniform_slot]);
+	}
+	frame_uniform_fences[frame_uniform_slot] = fence;
+
+	if (Object_buffer != 0)
+	{
+		if (object_fences[object_region] != NULL)
+		{
+			glDeleteSync(object_fences[object_region]);
+		}
+		object_fences[object_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+// Once per frame, after the shadow passes placed the directional light. Each frame writes the next slot
+// without synchronizing, after waiting for the fence of the frame that last used it.
+void Renderer::updateFrameUniforms()
+{
+	frame_uniforms frame = {};
+	frame.view = *camera_view_matrix;
+	frame.projection = *camera_projection_matrix;
+	frame.inv_view = glm::inverse(*camera_view_matrix);
+	frame.inv_projection = glm::inverse(*camera_projection_matrix);
+	frame.unjittered_view_projection = *camera_unjittered_projection_matrix * *camera_view_matrix;
+	frame.previous_view_projection = previous_unjittered_view_projection;
+	frame.directional_light_space_matrix = directional_light_space_matrix;
+	frame.camera_position = *camera_position;
+	frame.near_plane = light_near_plane;
+	frame.camera_look_direction = *camera_front;
+	frame.far_plane = light_far_plane;
+	frame.positive_exponent = positive_exponent;
+	frame.negative_exponent = negative_exponent;
+
+	frame_uniform_slot = (frame_uniform_slot + 1) % XRE_FRAME_UNIFORM_SLOTS;
+	waitForFence(frame_uniform_fences[frame_uniform_slot]);
+	GLintptr offset = (GLintptr)frame_uniform_slot * frame_uniform_stride;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, Frame_UBO);
+	void* slot = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(frame_uniforms), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (slot != NULL)
+	{
+		memcpy(slot, &frame, sizeof(frame_uniforms));
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, XRE_UBO_BINDING_FRAME, Frame_UBO, offset, sizeof(frame_uniforms));
+}
+
+// Lights in point_lights order, the point shadow maps are indexed the same way.
+void Renderer::updateLightUniforms()
+{
+	for (Light* light : lights)
+	{
+		lights_dirty |= light->m_dirty;
+		light->m_dirty = false;
+	}
+
+	if (!lights_dirty)
+	{
+		return;
+	}
+	lights_dirty = false;
+
+	light_uniforms data = {};
+	data.directional_lighting_enabled = directional_light != NULL;
+	if (directional_light != NULL)
+	{
+		data.directional_light.position = directional_light->m_position;
+		data.directional_light.direction = directional_light->m_direction;
+		data.directional_light.color = directional_light->m_color * directional_light->m_intensityMultiplier;
+	}
+
+	if (point_lights.size() > XRE_MAX_POINT_LIGHTS)
+	{
+		LOGGER->log(WARN, "Renderer::updateLightUniforms", "Only the first " + std::to_string(XRE_MAX_POINT_LIGHTS) + " point lights are shaded.");
+	}
+
+	data.point_light_count = (int)std::min(point_lights.size(), (size_t)XRE_MAX_POINT_LIGHTS);
+	for (int i = 0; i < data.point_light_count; i++)
+	{
+		point_light_uniforms& point_light = data.point_lights[i];
+		point_light.position = point_lights[i]->m_position;
+		point_light.color = point_lights[i]->m_color * point_lights[i]->m_intensityMultiplier;
+		point_light.kc = point_lights[i]->m_constantFalloff;
+		point_light.kl = point_lights[i]->m_linearFalloff;
+		point_light.kq = point_lights[i]->m_quadraticFalloff;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, Lights_UBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(light_uniforms), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static void drawRanges(const draw_ranges& ranges, unsigned int index_type)
+{
+	if (!ranges.counts.empty())
+	{
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, ranges.counts.data(), index_type, ranges.offsets.data(), (GLsizei)ranges.counts.size(), ranges.base_vertices.data());
+	}
+}
+
+// Camera passes : the whole group of instanced entries, the surviving meshlets when they were culled this frame,
+// the visible submeshes of static batches, the selected level otherwise.
+void Renderer::drawCameraView(const model_information& model_info)
+{
+	if (model_info.instance_count > 1)
+	{
+		size_t index_size = model_info.index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+		const MeshLod& level = model_info.lods->at(model_info.lod);
+		glDrawElementsInstanced(GL_TRIANGLES, level.index_count, model_info.index_type, (void*)(level.index_offset * index_size), model_info.instance_count);
+	}
+	else if (model_info.meshlets_culled)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, MeshletCommand_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, model_info.index_type, (void*)(model_info.meshlet_commands * sizeof(draw_elements_indirect_command)), model_info.meshlet_count, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else if (model_info.submeshes != NULL)
+	{
+		drawRanges(model_info.camera_ranges, model_info.index_type);
+	}
+	else
+	{
+		drawElements(model_info, model_info.lod);
+	}
+}
+
+void Renderer::drawShadowView(const model_information& model_info)
+{
+	if (model_info.submeshes != NULL)
+	{
+		drawRanges(model_info.shadow_ranges, model_info.index_type);
+	}
+	else
+	{
+		drawElements(model_info, model_info.shadow_lod);
+	}
+}
+
+void Renderer::createVisibilityBuffer()
+{
+	glGenFramebuffers(1, &VisibilityFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, VisibilityFramebuffer);
+
+	glGenTextures(1, &Visibility_id_texture);
+	glBindTexture(GL_TEXTURE_2D, Visibility_id_texture);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, render_target_width, render_target_height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Visibility_id_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DeferredGbuffer_depth, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOGGER->log(ERROR, "Renderer : VisibilityFramebuffer", "VisibilityFramebuffer is incomplete!");
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Rasterizes triangle ids only, depth goes straight into the G-Buffer depth cleared by clearDeferredBuffers.
+void Renderer::visibilityPass()
+{
+	if (draw_queue.size() > XRE_VISIBILITY_MAX_DRAWS)
+	{
+		LOGGER->log(ERROR, "Renderer : visibilityPass", "Too many draws for the visibility buffer id, the rest are not drawn.");
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, VisibilityFramebuffer);
+	glViewport(0, 0, render_width, render_height);
+
+	const unsigned int empty_id[] = { 0xFFFFFFFF, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, empty_id);
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	drawPositionOnly(visibilityShader, visibility_alpha_Shader, lighting_model == LIGHTING_MODE::PBR ? 0.8f : 0.1f);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Per draw material evaluation over the screen rectangle of its bounds, writes the G-Buffer through images.
+void Renderer::visibilityResolvePass()
+{
+	const glm::mat4 view_projection = *camera_projection_matrix * *camera_view_matrix;
+	const glm::mat4 unjittered_view_projection = *camera_unjittered_projection_matrix * *camera_view_matrix;
+	const unsigned int visibility_texture_unit = 15; // material textures start at 0
+
+	visibility_resolve_Shader.use();
+	visibility_resolve_Shader.setVec2("render_size", glm::vec2(render_width, render_height));
+	visibility_resolve_Shader.setBool("pbr_material", lighting_model == LIGHTING_MODE::PBR);
+
+	glActiveTexture(GL_TEXTURE0 + visibility_texture_unit);
+	glBindTexture(GL_TEXTURE_2D, Visibility_id_texture);
+	visibility_resolve_Shader.setInt("visibility_texture", visibility_texture_unit);
+
+	glBindImageTexture(0, DeferredGbuffer_color, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glBindImageTexture(1, DeferredGbuffer_normal, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGB10_A2);
+	if (lighting_model == LIGHTING_MODE::PBR)
+		glBindImageTexture(2, DeferredGbuffer_occlusion, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+	glBindImageTexture(3, DeferredGbuffer_velocity, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+
+	for (unsigned int i = 0; i < draw_queue.size() && i < XRE_VISIBILITY_MAX_DRAWS; i++)
+	{
+		if (draw_queue[i].frustum_cull == true)
+		{
+			continue;
+		}
+
+		const glm::mat4& model = *draw_queue[i].object_model_matrix;
+		glm::ivec4 rect = getScreenRect(draw_queue[i], view_projection);
+
+		if (rect.z > rect.x && rect.w > rect.y)
+		{
+			for (unsigned int j = 0; j < draw_queue[i].object_textures->size(); j++)
+			{
+				glActiveTexture(GL_TEXTURE0 + j);
+				visibility_resolve_Shader.setInt(draw_queue[i].object_textures->at(j).type, j);
+				glBindTexture(GL_TEXTURE_2D, draw_queue[i].object_textures->at(j).id);
+			}
+
+			visibility_resolve_Shader.setUInt("draw_id", i);
+			visibility_resolve_Shader.setIVec2("rect_origin", glm::ivec2(rect.x, rect.y));
+			visibility_resolve_Shader.setIVec2("rect_end", glm::ivec2(rect.z, rect.w));
+			visibility_resolve_Shader.setMat4("model_view_projection", view_projection * model);
+			visibility_resolve_Shader.setMat4("unjittered_model_view_projection", unjittered_view_projection * model);
+			visibility_resolve_Shader.setMat4("previous_model_view_projection", previous_unjittered_view_projection * draw_queue[i].previous_model_matrix);
+			visibility_resolve_Shader.setBool("short_indices", draw_queue[i].index_type == GL_UNSIGNED_SHORT);
+			visibility_resolve_Shader.setUInt("index_offset", draw_queue[i].lods->at(draw_queue[i].lod).index_offset);
+			visibility_resolve_Shader.setMat3("normal_matrix", glm::transpose(glm::inverse(glm::mat3(model))));
+			Mesh::setPositionDecode(visibility_resolve_Shader, draw_queue[i].mesh_aabb);
+
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_VISIBILITY_VERTICES, draw_queue[i].vertex_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_VISIBILITY_INDICES, draw_queue[i].index_buffer);
+
+			// Draws cover disjoint pixels, so the dispatches need no barriers between them
+			glDispatchCompute((rect.z - rect.x + 7) / 8, (rect.w - rect.y + 7) / 8, 1);
+		}
+
+		draw_queue[i].previous_model_matrix = model;
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+// Pixel rectangle (min xy, max xy exclusive) of the world space bounds, the whole viewport if they cross the near plane.
+glm::ivec4 Renderer::getScreenRect(const model_information& model_info, const glm::mat4& view_projection) const
+{
+	const glm::mat4 model_view_projection = view_projection * *model_info.object_model_matrix;
+	const BoundingVolume& aabb = model_info.mesh_aabb;
+
+	glm::vec2 ndc_min = glm::vec2(1.0f), ndc_max = glm::vec2(-1.0f);
+	for (unsigned int c = 0; c < 8; c++)
+	{
+		glm::vec4 corner = glm::vec4(
+			c & 1 ? aabb.max_v.x : aabb.min_v.x,
+			c & 2 ? aabb.max_v.y : aabb.min_v.y,
+			c & 4 ? aabb.max_v.z : aabb.min_v.z, 1.0f);
+
+		glm::vec4 clip = model_view_projection * corner;
+		if (clip.w <= 0.0001f)
+		{
+			return glm::ivec4(0, 0, render_width, render_height);
+		}
+
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndc_min = glm::min(ndc_min, ndc);
+		ndc_max = glm::max(ndc_max, ndc);
+	}
+
+	ndc_min = glm::clamp(ndc_min * 0.5f + 0.5f, 0.0f, 1.0f);
+	ndc_max = glm::clamp(ndc_max * 0.5f + 0.5f, 0.0f, 1.0f);
+
+	const glm::vec2 size = glm::vec2(render_width, render_height);
+	return glm::ivec4(glm::floor(ndc_min * size), glm::ceil(ndc_max * size));
+}
+
+bool Renderer::useDepthPrepass(DEPTH_PREPASS_MODE mode, float max_triangles_per_pixel, unsigned int pixels) const
+{
+	if (mode != DEPTH_PREPASS_MODE::PREPASS_AUTO)
+	{
+		return mode == DEPTH_PREPASS_MODE::PREPASS_ON;
+	}
+
+	// The pre-pass transforms every visible triangle a second time to save shading the overdrawn pixels.
+	// That only pays off while the visible geometry is light next to the number of pixels shaded.
+	unsigned long long visible_triangles = 0;
+	for (const model_information& model_info : draw_queue)
+	{
+		if (!model_info.frustum_cull)
+		{
+			if (model_info.submeshes == NULL)
+			{
+				visible_triangles += model_info.lods->at(model_info.lod).index_count / 3;
+			}
+			else
+			{
+				for (GLsizei count : model_info.camera_ranges.counts)
+					visible_triangles += count / 3;
+			}
+		}
+	}
+
+	return visible_triangles <= (unsigned long long)(max_triangles_per_pixel * pixels);
+}
+
+void Renderer::clearForwardFramebuffer()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, ForwardFramebuffer);
+
+	glClearColor(bg_color.x, bg_color.y, bg_color.z, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::clearDefaultFramebuffer()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glClearColor(bg_color.x, bg_color.y, bg_color.z, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void Renderer::clearDirectionalShadowMapFramebuffer()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, directional_shadow_framebuffer);
+	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::clearDirectionalShadowBlurringFramebuffers()
+{
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[i]);
+		glClearColor(1.0, 1.0, 1.0, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+}
+
+void Renderer::clearPointShadowFramebuffer()
+{
+	glColorMask(false, false, true, true);
+	for (unsigned int i = 0; i < XRE_MAX_POINT_SHADOW_MAPS; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, point_shadow_framebuffer[i]);
+		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glColorMask(true, true, true, true);
+
+}
+
+void Renderer::createDirectionalLightMatrix(glm::vec3 light_position, glm::vec3 light_front)
+{
+	directional_light_projection = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, light_near_plane, light_far_plane);
+	directional_light_space_matrix = directional_light_projection * glm::lookAt(light_position, glm::vec3(0.0f), glm::cross(xre::WORLD_RIGHT, light_front));
+}
+
+void Renderer::createPointLightMatrices(glm::vec3 light_position, unsigned int light_index)
+{
+	point_light_space_matrix_cube plsmc;
+	point_light_projection = glm::perspective(glm::radians(90.0f), 1.0f, light_near_plane, light_far_plane);
+
+	plsmc.point_light_space_matrix_0 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	plsmc.point_light_space_matrix_1 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	plsmc.point_light_space_matrix_2 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	plsmc.point_light_space_matrix_3 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	plsmc.point_light_space_matrix_4 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	plsmc.point_light_space_matrix_5 = point_light_projection * glm::lookAt(light_position, light_position + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+
+	point_light_space_matrix_cube_array[light_index] = plsmc;
+}
+
+void Renderer::createBlurringFramebuffers()
+{
+	// Shadow Blurring Framebuffers
+	glGenFramebuffers(2, DirectionalShadowBlurringFramebuffers);
+	glGenTextures(2, &DirectionalShadowBlurring_soft_shadow_textures[0]);
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[i]);
+
+		glBindTexture(GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, shadow_map_width * 4, 4 * shadow_map_height, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, DirectionalShadowBlurring_soft_shadow_textures[i], 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+		{
+			LOGGER->log(INFO, "Render System : createFramebuffer", "DirectionalShadowBlurring Framebuffer complete.");
+		}
+		else
+		{
+			LOGGER->log(ERROR, "Render System : createFramebuffer", "DirectionalShadowBlurring Framebuffer incomplete!");
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::createBloomMipChain()
+{
+	// A single mipmapped HDR texture; each level is one step of the downsample / upsample chain.
+	glGenTextures(1, &Bloom_mip_chain_texture);
+	glBindTexture(GL_TEXTURE_2D, Bloom_mip_chain_texture);
+
+	unsigned int mip_width = render_target_width / 2, mip_height = render_target_height / 2;
+	for (unsigned int i = 0; i < XRE_BLOOM_MIP_LEVELS; i++)
+	{
+		bloom_mip_width[i] = mip_width > 1 ? mip_width : 1;
+		bloom_mip_height[i] = mip_height > 1 ? mip_height : 1;
+
+		glTexImage2D(GL_TEXTURE_2D, i, GL_R11F_G11F_B10F, bloom_mip_width[i], bloom_mip_height[i], 0, GL_RGB, GL_FLOAT, NULL);
+
+		mip_width /= 2;
+		mip_height /= 2;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, XRE_BLOOM_MIP_LEVELS - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &BloomFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, BloomFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Bloom_mip_chain_texture, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+	{
+		LOGGER->log(INFO, "Render System : createFramebuffer", "Bloom Framebuffer complete.");
+	}
+	else
+	{
+		LOGGER->log(ERROR, "Render System : createFramebuffer", "Bloom Framebuffer incomplete!");
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	bloom_filter_radius = 1.0f;
+}
+
+void Renderer::addToLights(Light* light)
+{
+	if (typeid(*light) == typeid(DirectionalLight))
+	{
+		if (directional_light == NULL)
+		{
+			directional_light = (DirectionalLight*)light;
+		}
+		else
+		{
+			LOGGER->log(ERROR, " Renderer::addToRenderer(Light* light)", "Cannot have more than 1 directional light.");
+		}
+	}
+	else
+	{
+		point_lights.push_back((PointLight*)light);
+	}
+	lights.push_back(light);
+	lights_dirty = true;
+}
+
+void Renderer::setDepthPrepassMode(RENDER_PIPELINE pipeline, DEPTH_PREPASS_MODE mode)
+{
+	if (pipeline == RENDER_PIPELINE::DEFERRED)
+	{
+		deferred_depth_prepass_mode = mode;
+	}
+	else if (pipeline == RENDER_PIPELINE::FORWARD)
+	{
+		forward_depth_prepass_mode = mode;
+	}
+	else
+	{
+		LOGGER->log(ERROR, "Renderer : setDepthPrepassMode", "The depth pre-pass is only available for the deferred and forward pipelines.");
+	}
+}
+
+void Renderer::setLodSelection(float max_pixel_error, float hysteresis, unsigned int shadow_lod_bias)
+{
+	lod_pixel_error = max_pixel_error;
+	lod_hysteresis = glm::clamp(hysteresis, 0.0f, 1.0f);
+	this->shadow_lod_bias = shadow_lod_bias;
+}
+
+void Renderer::setMeshletCulling(bool enabled, bool occlusion_culling)
+{
+	meshlet_culling = enabled;
+	meshlet_occlusion_culling = occlusion_culling;
+}
+
+void Renderer::setInstancing(bool enabled)
+{
+	instancing = enabled;
+}
+
+void Renderer::setAmbientOcclusionMode(AMBIENT_OCCLUSION_MODE mode)
+{
+	// history from an earlier SSAO run is stale by now
+	if (mode == AMBIENT_OCCLUSION_MODE::AO_SSAO && ambient_occlusion_mode != mode)
+		ssao_history_valid = false;
+
+	ambient_occlusion_mode = mode;
+}
+
+void Renderer::setCameraMatrices(const glm::mat4* view, const glm::mat4* projection, const glm::vec3* position, const glm::vec3* front,
+	const glm::mat4* unjittered_projection, const glm::vec2* jitter)
+{
+	camera_view_matrix = view;
+	camera_projection_matrix = projection;
+	camera_position = position;
+	camera_front = front;
+	camera_unjittered_projection_matrix = unjittered_projection ? unjittered_projection : projection;
+	camera_jitter = jitter ? jitter : &no_jitter;
+}
+
+void Renderer::setTemporalAntiAliasing(bool enabled)
+{
+	if (!deferred)
+	{
+		LOGGER->log(ERROR, "Renderer : setTemporalAntiAliasing", "Temporal anti-aliasing is only available with the deferred and visibility pipelines.");
+		return;
+	}
+
+	if (enabled && !taa_enabled)
+		taa_history_valid = false;
+
+	taa_enabled = enabled;
+}
+
+bool Renderer::getTemporalAntiAliasing() const
+{
+	return taa_enabled;
+}
+
+void Renderer::setDynamicResolution(bool enabled, float target_gpu_time_ms, float min_render_scale)
+{
+	if (!deferred)
+	{
+		LOGGER->log(ERROR, "Renderer : setDynamicResolution", "Dynamic resolution is only available with the deferred and visibility pipelines.");
+		return;
+	}
+
+	dynamic_resolution_enabled = enabled;
+	dynamic_resolution_target_ms = target_gpu_time_ms;
+	dynamic_resolution_min_scale = glm::clamp(min_render_scale, 0.25f, 1.0f);
+}
+
+float Renderer::getGPUFrameTime() const
+{
+	return gpu_frame_time_ms;
+}
+
+glm::vec2 Renderer::getRenderUVScale() const
+{
+	return glm::vec2((float)render_width / render_target_width, (float)render_height / render_target_height);
+}
+
+void Renderer::beginGPUTimer()
+{
+	gpu_timer_scales[gpu_timer_frame % XRE_GPU_TIMER_QUERIES] = render_scale;
+	glBeginQuery(GL_TIME_ELAPSED, gpu_timer_queries[gpu_timer_frame % XRE_GPU_TIMER_QUERIES]);
+}
+
+void Renderer::endGPUTimer()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_timer_frame++;
+
+	// Read the oldest query in the ring, it has had XRE_GPU_TIMER_QUERIES - 1 frames to finish so this rarely stalls.
+	if (gpu_timer_frame < XRE_GPU_TIMER_QUERIES)
+		return;
+
+	unsigned int slot = gpu_timer_frame % XRE_GPU_TIMER_QUERIES;
+	int available = 0;
+	glGetQueryObjectiv(gpu_timer_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if (available)
+	{
+		GLuint64 elapsed_ns = 0;
+		glGetQueryObjectui64v(gpu_timer_queries[slot], GL_QUERY_RESULT, &elapsed_ns);
+		gpu_frame_time_ms = elapsed_ns / 1000000.0f;
+		gpu_frame_time_scale = gpu_timer_scales[slot];
+		gpu_frame_time_fresh = true;
+	}
+}
+
+void Renderer::updateDynamicResolution()
+{
+	// Only a new sample adjusts the scale, the same one would otherwise be applied again every frame.
+	if (!dynamic_resolution_enabled || !gpu_frame_time_fresh || gpu_frame_time_ms <= 0.0f)
+		return;
+	gpu_frame_time_fresh = false;
+
+	// Cost scales with pixel count, so the linear scale follows the square root of the time ratio.
+	float ratio = dynamic_resolution_target_ms / gpu_frame_time_ms;
+
+	// small dead band, and damping, keep the resolution from oscillating
+	if (ratio > 0.95f && ratio < 1.05f)
+		return;
+
+	// The sample is a few frames old, so the ratio applies to the scale it was measured at, not the current one.
+	float desired_scale = gpu_frame_time_scale * glm::sqrt(ratio);
+	render_scale = glm::clamp(render_scale + (desired_scale - render_scale) * 0.25f, dynamic_resolution_min_scale, 1.0f);
+
+	// even sizes keep the half resolution passes aligned
+	render_width = std::max(2u, (unsigned int)(render_target_width * render_scale) & ~1u);
+	render_height = std::max(2u, (unsigned int)(render_target_height * render_scale) & ~1u);
+}
+
+unsigned int Renderer::getRenderWidth() const
+{
+	return render_width;
+}
+
+unsigned int Renderer::getRenderHeight() const
+{
+	return render_height;
+}
+
+void Renderer::BloomPass(unsigned int bright_color_texture)
+{
+	// Every level of the chain is fully overwritten by the downsample, so no clear is needed.
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, BloomFramebuffer);
+	glBindVertexArray(quadVAO);
+
+	// Downsample : bright colors -> mip 0 -> mip 1 -> ... -> mip N-1
+	bloom_downsample_Shader.use();
+	bloom_downsample_Shader.setInt("source_texture", 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	for (unsigned int i = 0; i < XRE_BLOOM_MIP_LEVELS; i++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Bloom_mip_chain_texture, i);
+		glViewport(0, 0, bloom_mip_width[i], bloom_mip_height[i]);
+
+		if (i == 0)
+		{
+			glBindTexture(GL_TEXTURE_2D, bright_color_texture);
+			bloom_downsample_Shader.setVec2("source_uv_scale", bright_color_texture == DeferredFinal_secondary_texture ? getRenderUVScale() : glm::vec2(1.0f));
+		}
+		else
+		{
+			// Restrict sampling to the previous level so it never overlaps the level being written.
+			glBindTexture(GL_TEXTURE_2D, Bloom_mip_chain_texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, i - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i - 1);
+		}
+
+		if (i == 1)
+			bloom_downsample_Shader.setVec2("source_uv_scale", glm::vec2(1.0f));
+
+		bloom_downsample_Shader.setBool("karis_average", i == 0);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
+
+	// Upsample : mip N-1 is tent filtered and added onto mip N-2, and so on up to mip 0.
+	bloom_upsample_Shader.use();
+	bloom_upsample_Shader.setInt("source_texture", 0);
+	bloom_upsample_Shader.setFloat("filter_radius", bloom_filter_radius);
+	glBindTexture(GL_TEXTURE_2D, Bloom_mip_chain_texture);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glBlendEquation(GL_FUNC_ADD);
+
+	for (unsigned int i = XRE_BLOOM_MIP_LEVELS - 1; i > 0; i--)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Bloom_mip_chain_texture, i - 1);
+		glViewport(0, 0, bloom_mip_width[i - 1], bloom_mip_height[i - 1]);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, i);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i);
+
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
+
+	glDisable(GL_BLEND);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::SoftShadowPass(unsigned int amount)
+{
+	if (directional_light)
+	{
+		glDisable(GL_DEPTH_TEST);
+		glViewport(0, 0, shadow_map_width * 4, 4 * shadow_map_height);
+
+		directional_shadow_blur_Shader.use();
+		first_iteration = true;
+
+		horizontal = true;
+
+		for (unsigned int i = 0; i < amount; i++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, DirectionalShadowBlurringFramebuffers[horizontal]);
+
+			directional_shadow_blur_Shader.setBool("horizontal", horizontal);
+
+			glActiveTexture(GL_TEXTURE0);
+			directional_shadow_blur_Shader.setInt("inputTexture_1", 0);
+			glBindTexture(GL_TEXTURE_2D, first_iteration ? directional_shadow_depth_storage : DirectionalShadowBlurring_soft_shadow_textures[!horizontal]);
+
+			glBindVertexArray(quadVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			glBindVertexArray(0);
+
+			horizontal = !horizontal;
+
+			if (first_iteration)
+				first_iteration = false;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+}
+
+void Renderer::createQuad()
+{
+	float quadVertices[] = {
+		// positions   // texCoords
+		-1.0f,  1.0f,  0.0f, 1.0f,
+		-1.0f, -1.0f,  0.0f, 0.0f,
+		 1.0f, -1.0f,  1.0f, 0.0f,
+
 		-1.0f,  1.0f,  0.0f, 1.0f,
 		 1.0f, -1.0f,  1.0f, 0.0f,
 		 1.0f,  1.0f,  1.0f, 1.0f
@@ -1230,78 +2676,169 @@ void Renderer::createQuad()
 
 void Renderer::SSAOPass()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, SSAOFrameBuffer);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glViewport(0, 0, framebuffer_width, framebuffer_height);
+	const glm::mat4& projection = *camera_projection_matrix;
+	const glm::vec2 depth_params = glm::vec2(projection[2][2], projection[3][2]);
+	const float far_plane = projection[3][2] / (1.0f + projection[2][2]);
+	const glm::mat4 view_projection = projection * *camera_view_matrix;
 
-	SSAOShader.use();
+	const glm::vec2 uv_scale = getRenderUVScale();
+	const unsigned int ssao_viewport_width = render_width / XRE_SSAO_RESOLUTION_DIVISOR,
+		ssao_viewport_height = render_height / XRE_SSAO_RESOLUTION_DIVISOR;
+
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(quadVAO);
+	glViewport(0, 0, ssao_viewport_width, ssao_viewport_height);
+
+	// Half resolution linear depth
+	glBindFramebuffer(GL_FRAMEBUFFER, SSAODepthFramebuffer);
+
+	SSAO_depth_downsample_Shader.use();
+	SSAO_depth_downsample_Shader.setVec2("depth_params", depth_params);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
-	SSAOShader.setInt("depth_texture", 0);
+	SSAO_depth_downsample_Shader.setInt("depth_texture", 0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+
+	// Ambient occlusion, accumulated into the history of the previous frame
+	unsigned int current = ssao_history_index, previous = !ssao_history_index;
+	glBindFramebuffer(GL_FRAMEBUFFER, SSAOHistoryFramebuffers[current]);
+
+	SSAOShader.use();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, SSAO_linear_depth_texture);
+	SSAOShader.setInt("linear_depth_texture", 0);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_normal);
 	SSAOShader.setInt("normal_texture", 1);
 
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, random_rotation_texture);
-	SSAOShader.setInt("noise_texture", 2);
+	glBindTexture(GL_TEXTURE_2D, SSAO_history_textures[previous]);
+	SSAOShader.setInt("history_texture", 2);
 
-	std::stringstream ss;
-	for (unsigned int i = 0; i < ssao_kernel.size(); i++)
-	{
-		ss.str("");
-		ss << "[" << i << "]";
-		SSAOShader.setVec3("kernel" + ss.str(), ssao_kernel[i]);
-	}
-
-	SSAOShader.setMat4("inv_projection", glm::inverse(*camera_projection_matrix));
-	SSAOShader.setMat4("projection", *camera_projection_matrix);
+	SSAOShader.setMat4("projection", projection);
 	SSAOShader.setMat4("view", *camera_view_matrix);
+	SSAOShader.setMat4("inv_view", glm::inverse(*camera_view_matrix));
+	SSAOShader.setMat4("previous_view_projection", previous_view_projection);
+	SSAOShader.setVec2("proj_params", glm::vec2(1.0f / projection[0][0], 1.0f / projection[1][1]));
+	SSAOShader.setFloat("far_plane", far_plane);
+	SSAOShader.setUInt("frame_index", ssao_frame_index);
+	SSAOShader.setBool("history_valid", ssao_history_valid);
+	SSAOShader.setVec2("uv_scale", uv_scale);
+	SSAOShader.setVec2("history_uv_scale", ssao_history_uv_scale);
 
-	glBindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
 
+	// Bilateral upsample to full resolution
+	glViewport(0, 0, render_width, render_height);
+	glBindFramebuffer(GL_FRAMEBUFFER, SSAOFrameBuffer);
+
+	SSAO_upsample_Shader.use();
+	SSAO_upsample_Shader.setVec2("depth_params", depth_params);
+	SSAO_upsample_Shader.setFloat("far_plane", far_plane);
+	SSAO_upsample_Shader.setVec2("uv_scale", uv_scale);
+	SSAO_upsample_Shader.setVec2("ssao_size", glm::vec2(ssao_viewport_width, ssao_viewport_height));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
+	SSAO_upsample_Shader.setInt("depth_texture", 0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, SSAO_history_textures[current]);
+	SSAO_upsample_Shader.setInt("ssao_texture", 1);
+
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+
+	glBindVertexArray(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	previous_view_projection = view_projection;
+	ssao_history_uv_scale = uv_scale;
+	ssao_history_index = previous;
+	ssao_history_valid = true;
+	ssao_frame_index++;
 }
 
 void Renderer::createSSAOData()
 {
-	createSSAOKernel(8);
-	createSSAONoise();
+	ssao_width = render_target_width / XRE_SSAO_RESOLUTION_DIVISOR;
+	ssao_height = render_target_height / XRE_SSAO_RESOLUTION_DIVISOR;
 
-	glGenTextures(1, &random_rotation_texture);
-	glBindTexture(GL_TEXTURE_2D, random_rotation_texture);
+	createSSAOKernel(XRE_SSAO_KERNEL_SIZE);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 4, 4, 0, GL_RGB, GL_FLOAT, &ssao_noise[0]);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// Kernel is constant, upload it once and keep it bound to its binding point.
+	glGenBuffers(1, &ssao_kernel_UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, ssao_kernel_UBO);
+	glBufferData(GL_UNIFORM_BUFFER, ssao_kernel.size() * sizeof(glm::vec4), &ssao_kernel[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, XRE_UBO_BINDING_SSAO_KERNEL, ssao_kernel_UBO);
+
+	// Half resolution linear depth
+	glGenFramebuffers(1, &SSAODepthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, SSAODepthFramebuffer);
+
+	glGenTextures(1, &SSAO_linear_depth_texture);
+	glBindTexture(GL_TEXTURE_2D, SSAO_linear_depth_texture);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, ssao_width, ssao_height, 0, GL_RED, GL_FLOAT, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, SSAO_linear_depth_texture, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOGGER->log(ERROR, "Renderer : createSSAOData", "SSAO depth framebuffer is incomplete!");
+
+	// AO + linear depth history
+	glGenFramebuffers(2, SSAOHistoryFramebuffers);
+	glGenTextures(2, &SSAO_history_textures[0]);
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, SSAOHistoryFramebuffers[i]);
 
+		glBindTexture(GL_TEXTURE_2D, SSAO_history_textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, ssao_width, ssao_height, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, SSAO_history_textures[i], 0);
 
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			LOGGER->log(ERROR, "Renderer : createSSAOData", "SSAO history framebuffer is incomplete!");
+	}
+
+	// Full resolution result
 	glGenFramebuffers(1, &SSAOFrameBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, SSAOFrameBuffer);
 
 	glGenTextures(1, &SSAOFramebuffer_color);
 	glBindTexture(GL_TEXTURE_2D, SSAOFramebuffer_color);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, framebuffer_width, framebuffer_height, 0, GL_RED, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, render_target_width, render_target_height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, SSAOFramebuffer_color, 0);
 
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOGGER->log(ERROR, "Renderer : createSSAOData", "SSAO framebuffer is incomplete!");
+
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Renderer::createSSAOKernel(unsigned int num_samples)
 {
-	std::uniform_real_distribution<float> randomFloats(0.1f, 1.0f);
+	std::uniform_real_distribution<float> randomFloats(0.0f, 1.0f);
 	std::default_random_engine generator;
 
 	for (unsigned i = 0; i < num_samples; ++i)
@@ -1313,23 +2850,181 @@ void Renderer::createSSAOKernel(unsigned int num_samples)
 		sample = glm::normalize(sample);
 		sample *= randomFloats(generator);
 
+		// cluster samples towards the origin
 		float scale = (float)i / num_samples;
 		scale = 0.1f + (scale * scale) * 0.9f;
-		ssao_kernel.push_back(sample);
+		sample *= scale;
+
+		// std140 pads vec3 array elements to vec4
+		ssao_kernel.push_back(glm::vec4(sample, 0.0f));
 	}
 }
 
-void Renderer::createSSAONoise()
+void Renderer::DepthPyramidPass()
 {
-	std::uniform_real_distribution<float> randomFloats(0.1f, 1.0f);
-	std::default_random_engine generator;
+	const glm::mat4& projection = *camera_projection_matrix;
+
+	depth_pyramid_Shader.use();
+	depth_pyramid_Shader.setVec2("depth_params", glm::vec2(projection[2][2], projection[3][2]));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
+	depth_pyramid_Shader.setInt("depth_texture", 0);
 
-	for (unsigned int i = 0; i < 16; ++i)
+	unsigned int level_width = render_width, level_height = render_height;
+	unsigned int source_width = render_width, source_height = render_height;
+	for (unsigned int level = 0; level < depth_pyramid_levels; level++)
 	{
-		glm::vec3 noise(randomFloats(generator) * 2.0 - 1.0,
-			randomFloats(generator) * 2.0 - 1.0,
-			0.0);
+		depth_pyramid_Shader.setInt("level", level);
+		depth_pyramid_Shader.setVec2("source_size", glm::vec2(source_width, source_height));
+		depth_pyramid_Shader.setVec2("destination_size", glm::vec2(level_width, level_height));
+
+		glBindImageTexture(0, DepthPyramid_texture, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+		glBindImageTexture(1, DepthPyramid_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+
+		glDispatchCompute((level_width + 7) / 8, (level_height + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		source_width = level_width;
+		source_height = level_height;
+		level_width = level_width > 1 ? level_width / 2 : 1;
+		level_height = level_height > 1 ? level_height / 2 : 1;
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	depth_pyramid_size = glm::vec2(render_width, render_height);
+}
+
+void Renderer::GTAOPass()
+{
+	const glm::mat4& projection = *camera_projection_matrix;
+
+	GTAOShader.use();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, DepthPyramid_texture);
+	GTAOShader.setInt("depth_pyramid", 0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_normal);
+	GTAOShader.setInt("normal_texture", 1);
+
+	GTAOShader.setMat4("view", *camera_view_matrix);
+	GTAOShader.setMat4("inv_view", glm::inverse(*camera_view_matrix));
+	GTAOShader.setVec2("proj_params", glm::vec2(1.0f / projection[0][0], 1.0f / projection[1][1]));
+	GTAOShader.setFloat("projection_scale", 0.5f * render_height * projection[1][1]);
+	GTAOShader.setFloat("far_plane", projection[3][2] / (1.0f + projection[2][2]));
+	GTAOShader.setInt("max_pyramid_level", depth_pyramid_levels - 1);
+	GTAOShader.setVec2("screen_size", glm::vec2(render_width, render_height));
+	GTAOShader.setUInt("frame_index", gtao_frame_index++);
+
+	glBindImageTexture(0, GTAO_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+	glDispatchCompute((render_width + 7) / 8, (render_height + 7) / 8, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void Renderer::createGTAOData()
+{
+	depth_pyramid_levels = 1;
+	for (unsigned int size = std::max(render_target_width, render_target_height); size > 1; size /= 2)
+		depth_pyramid_levels++;
+
+	glGenTextures(1, &DepthPyramid_texture);
+	glBindTexture(GL_TEXTURE_2D, DepthPyramid_texture);
+
+	glTexStorage2D(GL_TEXTURE_2D, depth_pyramid_levels, GL_RG32F, render_target_width, render_target_height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &GTAO_texture);
+	glBindTexture(GL_TEXTURE_2D, GTAO_texture);
+
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, render_target_width, render_target_height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::createTAAFramebuffers()
+{
+	glGenFramebuffers(2, TAAFramebuffers);
+	glGenTextures(2, &TAA_history_textures[0]);
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, TAAFramebuffers[i]);
+
+		glBindTexture(GL_TEXTURE_2D, TAA_history_textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TAA_history_textures[i], 0);
 
-		ssao_noise.push_back(noise);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+		{
+			LOGGER->log(INFO, "Render System : createFramebuffer", "TAA Framebuffer complete.");
+		}
+		else
+		{
+			LOGGER->log(ERROR, "Render System : createFramebuffer", "TAA Framebuffer incomplete!");
+		}
 	}
-}
\ No newline at end of file
+
+	taa_resolved_texture = TAA_history_textures[0];
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::TAAResolvePass()
+{
+	unsigned int current = taa_history_index, previous = !taa_history_index;
+	const glm::mat4 unjittered_view_projection = *camera_unjittered_projection_matrix * *camera_view_matrix;
+
+	glDisable(GL_DEPTH_TEST);
+	glViewport(0, 0, framebuffer_width, framebuffer_height);
+	glBindFramebuffer(GL_FRAMEBUFFER, TAAFramebuffers[current]);
+
+	TAAShader.use();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, DeferredFinal_primary_texture);
+	TAAShader.setInt("color_texture", 0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_velocity);
+	TAAShader.setInt("velocity_texture", 1);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, DeferredGbuffer_depth);
+	TAAShader.setInt("depth_texture", 2);
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, TAA_history_textures[previous]);
+	TAAShader.setInt("history_texture", 3);
+
+	TAAShader.setVec2("jitter", *camera_jitter);
+	TAAShader.setVec2("render_size", glm::vec2(render_width, render_height));
+	TAAShader.setMat4("reprojection_matrix", previous_unjittered_view_projection * glm::inverse(unjittered_view_projection));
+	TAAShader.setBool("history_valid", taa_history_valid);
+
+	glBindVertexArray(quadVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindVertexArray(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	taa_resolved_texture = TAA_history_textures[current];
+	taa_history_index = previous;
+	taa_history_valid = true;
+}
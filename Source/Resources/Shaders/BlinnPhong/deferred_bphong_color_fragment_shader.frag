@@ -49,28 +49,31 @@ uniform sampler2D directional_shadow_depth_map;
 uniform samplerCube point_shadow_depth_map[MAX_POINT_SHADOWS];
 // -----------------------
 
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[MAX_POINT_LIGHTS]; // I forgot to mentiom 'uniform' and kept wandering for an hour why the screen would render black.
-uniform mat4 directional_light_space_matrix;
-uniform bool directional_lighting_enabled;
-uniform int N_POINT;
-uniform float near;
-uniform float far;
-uniform mat4 inv_projection;
-uniform mat4 inv_view;
-uniform int use_ssao;
-uniform float positive_exponent;
-uniform float negative_exponent;
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
+
+// Renderer::updateLightUniforms, the same block in every program
+layout (std140, binding = 2) uniform Lights
+{
+	int N_POINT;
+	bool directional_lighting_enabled;
+	DirectionalLight directionalLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+uniform int ao_mode; // 0 : disabled, 1 : SSAO, 2 : GTAO
+uniform vec2 uv_scale = vec2(1.0); // render viewport / allocated G-buffer size (dynamic resolution)
+
+// TexCoords span the render viewport, the G-buffer textures are only filled up to uv_scale
+vec2 GBufferCoords;
 
 // -----------------------
 
 uniform float shininess = 128.0;
-uniform vec3 camera_pos;
 
 uniform sampler2D diffuse_texture;
-uniform sampler2D depth_texture;
-uniform sampler2D normal_texture;
-uniform sampler2D ssao_texture;
+uniform sampler2D depth_texture; // hardware depth
+uniform sampler2D normal_texture; // octahedral normal, unused, flags
+uniform sampler2D ao_texture; // SSAO : r, GTAO : a
 
 float linstep(float mi, float ma, float v)
 {
@@ -243,9 +246,19 @@ vec3 TangentToWorldNormal(vec3 model_normal, vec3 normal_from_texture)
 	return normalize(TBN * normal_from_texture);
 }
 
+// Octahedral normal decoding, see the fill shader for the encoding
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
 vec3 ScreenToWorldPos()
 {
-	float z = texture(depth_texture, TexCoords).r * 2.0 - 1.0;
+	float z = texture(depth_texture, GBufferCoords).r * 2.0 - 1.0;
 
 	vec4 clipSpacePosition = vec4(TexCoords * 2.0 - 1.0, z, 1.0);
 	vec4 viewSpacePosition = inv_projection * clipSpacePosition;
@@ -257,17 +270,34 @@ vec3 ScreenToWorldPos()
 
 void main()
 {
+	GBufferCoords = TexCoords * uv_scale;
+
+	vec4 color_sample = texture(diffuse_texture, GBufferCoords);
+	vec4 normal_sample = texture(normal_texture, GBufferCoords);
+
+	// Background, nothing was rasterized here
+	if(int(normal_sample.a * 3.0 + 0.5) == 0)
+	{
+		FragColor = color_sample.rgb;
+		BrightColor = vec3(0.0);
+		return;
+	}
+
 	vec3 color = vec3(0.0);
 
-	vec3 diffuse_texture_color = texture(diffuse_texture, TexCoords).rgb;
-	float specular_texture_value = texture(diffuse_texture, TexCoords).a;
+	vec3 diffuse_texture_color = color_sample.rgb;
+	float specular_texture_value = color_sample.a;
 	FragPos = ScreenToWorldPos();
-	vec3 normal = normalize(texture(normal_texture, TexCoords).rgb * 2.0 - 1.0);
+	vec3 normal = DecodeNormal(normal_sample.rg);
 	float ssao = 1.0;
 
-	if(use_ssao == 1)
+	if(ao_mode == 1)
+	{
+		ssao = texture(ao_texture, GBufferCoords).r;
+	}
+	else if(ao_mode == 2)
 	{
-		ssao = texture(ssao_texture, TexCoords).r;
+		ssao = texture(ao_texture, GBufferCoords).a;
 	}
 
 	FragPosLightSpace = directional_light_space_matrix * vec4(FragPos,1.0);
@@ -278,7 +308,7 @@ void main()
 	if(directional_lighting_enabled)
 	{  
 		lightdir = directionalLight.position;
-		viewdir = camera_pos - FragPos;
+		viewdir = camera_position - FragPos;
 
 		color += max(CalcDirectional(diffuse_texture_color, specular_texture_value, normal, viewdir, lightdir, FragPos),vec3(0.0)) * ssao;
 	}
@@ -286,7 +316,7 @@ void main()
 	for(int i=0; i<N_POINT; ++i)
 	{
 		lightdir = pointLights[i].position - FragPos;
-		viewdir = camera_pos - FragPos;
+		viewdir = camera_position - FragPos;
 
 		color += max(CalcPoint(pointLights[i],diffuse_texture_color, specular_texture_value, normal, FragPos, viewdir, lightdir, i),vec3(0.0)) * ssao;
 	}
@@ -9,6 +9,7 @@ layout (location = 0) out vec3 FragColor;
 layout (location = 1) out vec3 BrightColor;
 
 struct DirectionalLight {
+	vec3 position;
 	vec3 direction;
 	vec3 color;
 };
@@ -29,11 +30,17 @@ in vec4 FragPosLightSpace;
 
 //-------------------------
 
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
+
+// Renderer::updateLightUniforms, the same block in every program
+layout (std140, binding = 2) uniform Lights
+{
+	int N_POINT;
+	bool directional_lighting_enabled;
+	DirectionalLight directionalLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+};
 
-uniform int N_POINT;
-uniform bool directional_lighting_enabled;
 //-------------------------
 
 uniform sampler2D texture_diffuse;
@@ -47,12 +54,6 @@ uniform samplerCube point_shadow_depth_map[MAX_POINT_SHADOWS];
 // ------------------------------------------------
 
 uniform float shininess;
-uniform vec3 camera_pos;
-uniform float near;
-uniform float far;
-uniform vec3 directional_light_position;
-uniform float positive_exponent;
-uniform float negative_exponent;
 
 // Tangent Space Data
 
@@ -61,6 +62,13 @@ in vec3 camera_position_tspace;
 in vec3 frag_pos_tspace;
 
 
+// Normal maps are BC5, only xy is stored and z is rebuilt from the unit length.
+vec3 UnpackNormalMap(vec2 xy)
+{
+	xy = xy * 2.0 - 1.0;
+	return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
+
 //-------------------------
 vec3 BloomThresholdFilter(vec3 in_color, float threshold)
 {
@@ -152,7 +160,7 @@ vec3 CalcDirectional(vec3 diffuse_texture_color,vec3 specular_texture_color,vec3
 	//bias = max(0.001 * (1.0 - dot(normalize(fragment_normal), normalize(-directionalLight.direction))), 0.0001);
 
 	float directional_shadow = 0.0;
-	directional_shadow = ReduceLightBleeding(CheckDirectionalShadow(bias, directional_light_position, FragPos), 0.1);
+	directional_shadow = ReduceLightBleeding(CheckDirectionalShadow(bias, directionalLight.position, FragPos), 0.1);
 
 	vec3 ambient = directionalLight.color * diffuse_texture_color; //ambient
 	
@@ -230,7 +238,7 @@ void main()
 	}
 
 	vec3 speculartexture_sample = vec3(texture(texture_specular, TexCoords).r);	
-	vec3 tNormal = texture(texture_normal, TexCoords).rgb * 2.0 - 1.0;
+	vec3 tNormal = UnpackNormalMap(texture(texture_normal, TexCoords).rg);
 
 	vec3 viewdir = normalize(camera_position_tspace - frag_pos_tspace);
 
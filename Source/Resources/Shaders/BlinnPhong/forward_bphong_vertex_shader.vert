@@ -1,51 +1,75 @@
 #version 440 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;			// xyz : quantized position, w : bitangent sign
+layout (location = 1) in vec2 aNormal;		// octahedral
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangents;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec2 aTangent;		// octahedral
 
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 vNormal;
 out vec4 FragPosLightSpace;
 
-uniform mat4 view;
-uniform mat4 model;
-uniform mat4 projection;
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
+
 uniform mat4 point_light_space_projection;
-uniform mat4 directional_light_space_matrix;
+
+invariant gl_Position; // matches the depth pre-pass
 
 
 // Tangent Space Data
 mat3 TBN;
 
-uniform vec3 camera_position_vertex;
 uniform vec3 light_position_vertex[6];
 
 out vec3 light_pos_tspace[6];
 out vec3 camera_position_tspace;
 out vec3 frag_pos_tspace;
 
+// Objects storage block, object_id, DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_OBJECTS)
+
+// Renderer::buildInstanceGroups : instanced draws read their matrices from the instance buffer
+struct Instance
+{
+	mat4 model;
+	mat4 previous_model;
+};
+
+layout (std430, binding = 5) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+uniform bool instanced;
+uniform uint instance_offset;
+
+mat4 ModelMatrix()
+{
+	return instanced ? instances[instance_offset + gl_InstanceID].model : objects[object_id].model;
+}
+
 // ------------------
 
 void main()
 {
+	mat4 model_matrix = ModelMatrix();
+
 	//----------------------------------------------------------------------
 
-	FragPos = vec3(model * vec4(aPos,1.0));
+	// same expression as the depth pre-pass, so that both write the same depth
+	vec4 world_position = model_matrix * vec4(DecodePosition(aPos), 1.0);
+	FragPos = vec3(world_position);
     TexCoords = aTexCoords;
     FragPosLightSpace = directional_light_space_matrix * vec4(FragPos,1.0);
 
 	//----------------------------------------------------------------------
 
-	mat3 normalMatrix = transpose(inverse(mat3(model)));
-	vec3 T = normalize(normalMatrix * aTangents);
-	vec3 N = normalize(normalMatrix * aNormal);
+	mat3 normalMatrix = instanced ? transpose(inverse(mat3(model_matrix))) : mat3(objects[object_id].normal_matrix);
+	vec3 T = normalize(normalMatrix * DecodeOctahedral(aTangent));
+	vec3 N = normalize(normalMatrix * DecodeOctahedral(aNormal));
 
 	T = normalize(T - dot(T, N) * N);
 
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * (aPos.w * 2.0 - 1.0);
 
 	mat3 TBN = transpose(mat3(T, B, N));
 
@@ -54,8 +78,8 @@ void main()
 		light_pos_tspace[i] = TBN * light_position_vertex[i];
 	}
 
-	camera_position_tspace = TBN * camera_position_vertex;
+	camera_position_tspace = TBN * camera_position;
 	frag_pos_tspace = TBN * FragPos;
 
-	gl_Position = projection * view * vec4(FragPos, 1.0);
+	gl_Position = projection * view * world_position;
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#version 440 core
+
+// 13-tap downsample (Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare").
+// The source is always sampled at lod 0; the renderer moves GL_TEXTURE_BASE_LEVEL to the mip being read.
+
+layout (location = 0) out vec3 out_1;
+
+in vec2 TexCoords;
+
+uniform sampler2D source_texture;
+uniform vec2 source_uv_scale = vec2(1.0); // the first source is only filled up to the render viewport
+uniform bool karis_average; // only for the first downsample, keeps single bright texels from flickering
+
+float KarisWeight(vec3 c)
+{
+	float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));
+	return 1.0 / (1.0 + luma);
+}
+
+vec3 Fetch(vec2 offset, vec2 texel)
+{
+	return textureLod(source_texture, min(TexCoords * source_uv_scale + offset * texel, source_uv_scale), 0).rgb;
+}
+
+void main()
+{
+	vec2 texel = 1.0 / textureSize(source_texture, 0);
+
+	// a - b - c
+	// - j - k -
+	// d - e - f
+	// - l - m -
+	// g - h - i
+	vec3 a = Fetch(vec2(-2.0,  2.0), texel);
+	vec3 b = Fetch(vec2( 0.0,  2.0), texel);
+	vec3 c = Fetch(vec2( 2.0,  2.0), texel);
+
+	vec3 d = Fetch(vec2(-2.0,  0.0), texel);
+	vec3 e = Fetch(vec2( 0.0,  0.0), texel);
+	vec3 f = Fetch(vec2( 2.0,  0.0), texel);
+
+	vec3 g = Fetch(vec2(-2.0, -2.0), texel);
+	vec3 h = Fetch(vec2( 0.0, -2.0), texel);
+	vec3 i = Fetch(vec2( 2.0, -2.0), texel);
+
+	vec3 j = Fetch(vec2(-1.0,  1.0), texel);
+	vec3 k = Fetch(vec2( 1.0,  1.0), texel);
+	vec3 l = Fetch(vec2(-1.0, -1.0), texel);
+	vec3 m = Fetch(vec2( 1.0, -1.0), texel);
+
+	if(karis_average)
+	{
+		vec3 g0 = (a + b + d + e) * 0.25;
+		vec3 g1 = (b + c + e + f) * 0.25;
+		vec3 g2 = (d + e + g + h) * 0.25;
+		vec3 g3 = (e + f + h + i) * 0.25;
+		vec3 g4 = (j + k + l + m) * 0.25;
+
+		float w0 = KarisWeight(g0) * 0.125;
+		float w1 = KarisWeight(g1) * 0.125;
+		float w2 = KarisWeight(g2) * 0.125;
+		float w3 = KarisWeight(g3) * 0.125;
+		float w4 = KarisWeight(g4) * 0.5;
+
+		out_1 = (g0 * w0 + g1 * w1 + g2 * w2 + g3 * w3 + g4 * w4) / (w0 + w1 + w2 + w3 + w4);
+	}
+	else
+	{
+		out_1  = e * 0.125;
+		out_1 += (a + c + g + i) * 0.03125;
+		out_1 += (b + d + f + h) * 0.0625;
+		out_1 += (j + k + l + m) * 0.125;
+	}
+
+	out_1 = max(out_1, vec3(0.0001));
+}
@@ -0,0 +1,32 @@
+#version 440 core
+
+// 3x3 tent upsample. The result is additively blended onto the next larger mip.
+
+layout (location = 0) out vec3 out_1;
+
+in vec2 TexCoords;
+
+uniform sampler2D source_texture;
+uniform float filter_radius;
+
+void main()
+{
+	vec2 r = filter_radius / textureSize(source_texture, 0);
+
+	vec3 a = textureLod(source_texture, TexCoords + vec2(-r.x,  r.y), 0).rgb;
+	vec3 b = textureLod(source_texture, TexCoords + vec2( 0.0,  r.y), 0).rgb;
+	vec3 c = textureLod(source_texture, TexCoords + vec2( r.x,  r.y), 0).rgb;
+
+	vec3 d = textureLod(source_texture, TexCoords + vec2(-r.x,  0.0), 0).rgb;
+	vec3 e = textureLod(source_texture, TexCoords, 0).rgb;
+	vec3 f = textureLod(source_texture, TexCoords + vec2( r.x,  0.0), 0).rgb;
+
+	vec3 g = textureLod(source_texture, TexCoords + vec2(-r.x, -r.y), 0).rgb;
+	vec3 h = textureLod(source_texture, TexCoords + vec2( 0.0, -r.y), 0).rgb;
+	vec3 i = textureLod(source_texture, TexCoords + vec2( r.x, -r.y), 0).rgb;
+
+	out_1  = e * 4.0;
+	out_1 += (b + d + f + h) * 2.0;
+	out_1 += (a + c + g + i);
+	out_1 *= 1.0 / 16.0;
+}
@@ -1,44 +1,116 @@
 #version 440 core
 
-layout (location = 0) out vec4 FragColorOut;
-layout (location = 1) out vec3 FragNormalOut;
-layout (location = 2) out float DepthOut;
-layout (location = 3) out vec3 MOR; // Metallic, Occlusion, Roughness
+layout (location = 0) out vec4 FragColorOut;		// albedo, metallic
+layout (location = 1) out vec4 FragNormalOut;		// octahedral normal, roughness, flags
+layout (location = 2) out float OcclusionOut;
+layout (location = 3) out vec2 VelocityOut;			// uv space, current - previous
+
+// Depth is not written out, the lighting pass reconstructs position from the depth attachment.
 
 in vec2 TexCoords;
 
 in vec3 object_normal, object_tangent;
+in float bitangent_sign;
+in vec4 current_clip_position, previous_clip_position;
 
 //-------------------------
 
-uniform sampler2D texture_diffuse;
-uniform sampler2D texture_normal;
+// xre::MaterialTextures : a table entry per material slot, a bindless handle or a texture array and layer.
+// Without it the textures of each draw are bound to the named samplers.
+#if defined(XRE_MATERIAL_TEXTURES_BINDLESS) || defined(XRE_MATERIAL_TEXTURES_ARRAYS)
+layout (std430, binding = 6) readonly buffer MaterialTextures
+{
+	uvec2 material_textures[]; // material_id * 5 + slot
+};
+
+flat in uint material_id; // Renderer::updateObjectData, through the vertex shader
+
+#ifdef XRE_MATERIAL_TEXTURES_ARRAYS
+uniform sampler2DArray material_arrays[16];
+#endif
+
+// Slots whose texture found no room for a copy, bound by the draw.
+#define MATERIAL_BOUND_ENTRY 0xFFFFFFFFu
+uniform sampler2D material_bound[5];
 
+#define MATERIAL_DIFFUSE 0u
+#define MATERIAL_SPECULAR 1u
+#define MATERIAL_NORMAL 2u
+#define MATERIAL_ROUGHNESS 3u
+#define MATERIAL_OCCLUSION 4u
+
+vec4 SampleMaterial(uint slot, vec2 uv)
+{
+	uvec2 entry = material_textures[material_id * 5u + slot];
+	if (entry == uvec2(MATERIAL_BOUND_ENTRY))
+	{
+		return texture(material_bound[slot], uv);
+	}
+#ifdef XRE_MATERIAL_TEXTURES_BINDLESS
+	return texture(sampler2D(entry), uv);
+#else
+	return texture(material_arrays[entry.x], vec3(uv, float(entry.y)));
+#endif
+}
+#else
+uniform sampler2D texture_diffuse;
 uniform sampler2D texture_specular; // Its actually texture_metallic.
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_normal;
 uniform sampler2D texture_roughness;
+uniform sampler2D texture_occlusion;
 
-uniform vec3 camera_position;
+#define MATERIAL_DIFFUSE texture_diffuse
+#define MATERIAL_SPECULAR texture_specular
+#define MATERIAL_NORMAL texture_normal
+#define MATERIAL_ROUGHNESS texture_roughness
+#define MATERIAL_OCCLUSION texture_occlusion
+#define SampleMaterial(slot, uv) texture(slot, uv)
+#endif
+
+// 2 bit flags in the normal alpha, stored as flags / 3.0
+const float GBUFFER_FLAG_SURFACE = 1.0 / 3.0;
+
+// Normal maps are BC5, only xy is stored and z is rebuilt from the unit length.
+vec3 UnpackNormalMap(vec2 xy)
+{
+	xy = xy * 2.0 - 1.0;
+	return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
 
 vec3 TangentToWorldNormal(vec3 normal_from_texture)
 {
-    vec3 B  = normalize(cross(object_normal, object_tangent));
+    vec3 B  = normalize(cross(object_normal, object_tangent)) * bitangent_sign;
     mat3 TBN = mat3(object_tangent, B, object_normal);
 
 	return normalize(TBN * normal_from_texture);
 }
 
+// Octahedral normal encoding (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors")
+vec2 OctWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
+}
+
 void main()
 {
-	vec4 diffuse_color = texture(texture_diffuse, TexCoords);
+	vec4 diffuse_color = SampleMaterial(MATERIAL_DIFFUSE, TexCoords);
 
 	if(diffuse_color.a <0.8)
 	{
 		discard;
 	}
 
-	FragColorOut = vec4(diffuse_color.rgb, 1.0);
-	FragNormalOut = TangentToWorldNormal(normalize(texture(texture_normal, TexCoords).xyz * 2.0 - 1.0)) * 0.5 + 0.5;
-	DepthOut = gl_FragCoord.z;
-	MOR = vec3(texture(texture_specular, TexCoords).r, texture(texture_occlusion, TexCoords).r, texture(texture_roughness, TexCoords).r);
+	vec3 normal = TangentToWorldNormal(UnpackNormalMap(SampleMaterial(MATERIAL_NORMAL, TexCoords).rg));
+
+	FragColorOut = vec4(diffuse_color.rgb, SampleMaterial(MATERIAL_SPECULAR, TexCoords).r);
+	FragNormalOut = vec4(EncodeNormal(normal), SampleMaterial(MATERIAL_ROUGHNESS, TexCoords).r, GBUFFER_FLAG_SURFACE);
+	OcclusionOut = SampleMaterial(MATERIAL_OCCLUSION, TexCoords).r;
+	VelocityOut = (current_clip_position.xy / current_clip_position.w - previous_clip_position.xy / previous_clip_position.w) * 0.5;
 }
\ No newline at end of file
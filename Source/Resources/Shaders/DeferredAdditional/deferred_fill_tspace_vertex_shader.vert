@@ -1,10 +1,9 @@
 #version 440 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;			// xyz : quantized position, w : bitangent sign
+layout (location = 1) in vec2 aNormal;		// octahedral
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangents;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec2 aTangent;		// octahedral
 
 
 uniform mat4 view;
@@ -25,23 +24,25 @@ out vec3 light_pos_tspace_4;
 out vec3 light_pos_tspace_5;
 out vec3 model_normal;
 
+// DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_POSITION_UNIFORMS)
+
 void main()
 {	
 	// Tangent Space Calculation
 
 	mat3 normalMatrix = transpose(inverse(mat3(model)));
-	vec3 T = normalize(normalMatrix * aTangents);
-	vec3 N = normalize(normalMatrix * aNormal);
+	vec3 T = normalize(normalMatrix * DecodeOctahedral(aTangent));
+	vec3 N = normalize(normalMatrix * DecodeOctahedral(aNormal));
 
 	T = normalize(T - dot(T, N) * N);
 
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * (aPos.w * 2.0 - 1.0);
 
 	mat3 TBN = transpose(mat3(T, B, N));
 
 	//----------------------------------------------------------------------
 
-	vec3 FragPos = vec3(model * vec4(aPos,1.0));
+	vec3 FragPos = vec3(model * vec4(DecodePosition(aPos), 1.0));
 	
 	light_pos_tspace_0 = TBN * light_position_vertex[0];
 	light_pos_tspace_1 = TBN * light_position_vertex[1];
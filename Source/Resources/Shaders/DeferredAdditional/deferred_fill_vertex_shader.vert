@@ -1,34 +1,71 @@
 #version 440 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;			// xyz : quantized position, w : bitangent sign
+layout (location = 1) in vec2 aNormal;		// octahedral
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec2 aTangent;		// octahedral
 
 out vec2 TexCoords;
 
 out vec3 object_normal, object_tangent;
+out float bitangent_sign;
+out vec4 current_clip_position, previous_clip_position; // unjittered, for motion vectors
+flat out uint material_id;
 
-uniform mat4 view;
-uniform mat4 model;
-uniform mat4 projection;
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
+
+invariant gl_Position; // matches the depth pre-pass
+
+// Objects storage block, object_id, DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_OBJECTS)
+
+// Renderer::buildInstanceGroups : instanced draws read their matrices from the instance buffer
+struct Instance
+{
+	mat4 model;
+	mat4 previous_model;
+};
+
+layout (std430, binding = 5) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+uniform bool instanced;
+uniform uint instance_offset;
+
+mat4 ModelMatrix()
+{
+	return instanced ? instances[instance_offset + gl_InstanceID].model : objects[object_id].model;
+}
+
+mat4 PreviousModelMatrix()
+{
+	return instanced ? instances[instance_offset + gl_InstanceID].previous_model : objects[object_id].previous_model;
+}
 
 // ------------------
 
 void main()
 {	
-	mat3 normalMatrix = transpose(inverse(mat3(model)));
-	mat3 normalMatrix_view = mat3(model);
+	mat4 model_matrix = ModelMatrix();
+	material_id = objects[object_id].material_id;
+	mat3 normalMatrix = instanced ? transpose(inverse(mat3(model_matrix))) : mat3(objects[object_id].normal_matrix);
 
-	object_tangent = normalize(vec3(normalMatrix * aTangent));
-	object_normal = normalize(vec3(normalMatrix * aNormal));
+	object_tangent = normalize(vec3(normalMatrix * DecodeOctahedral(aTangent)));
+	object_normal = normalize(vec3(normalMatrix * DecodeOctahedral(aNormal)));
 	object_tangent = normalize(object_tangent - dot(object_tangent, object_normal) * object_normal);
+	bitangent_sign = aPos.w * 2.0 - 1.0;
 
 	//----------------------------------------------------------------------
 
     TexCoords = aTexCoords;
 
 	//----------------------------------------------------------------------
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = DecodePosition(aPos);
+	vec4 world_position = model_matrix * vec4(position, 1.0);
+
+	current_clip_position = unjittered_view_projection * world_position;
+	previous_clip_position = previous_view_projection * PreviousModelMatrix() * vec4(position, 1.0);
+
+	gl_Position = projection * view * world_position;
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#version 440 core
+
+// Depth only, discards with the same cutoff as the color pass that follows.
+
+in vec2 TexCoords;
+
+// xre::MaterialTextures : a table entry per material slot, a bindless handle or a texture array and layer.
+// Without it the textures of each draw are bound to the named samplers.
+#if defined(XRE_MATERIAL_TEXTURES_BINDLESS) || defined(XRE_MATERIAL_TEXTURES_ARRAYS)
+layout (std430, binding = 6) readonly buffer MaterialTextures
+{
+	uvec2 material_textures[]; // material_id * 5 + slot
+};
+
+flat in uint material_id; // Renderer::updateObjectData, through the vertex shader
+
+#ifdef XRE_MATERIAL_TEXTURES_ARRAYS
+uniform sampler2DArray material_arrays[16];
+#endif
+
+// Slots whose texture found no room for a copy, bound by the draw.
+#define MATERIAL_BOUND_ENTRY 0xFFFFFFFFu
+uniform sampler2D material_bound[5];
+
+#define MATERIAL_DIFFUSE 0u
+
+vec4 SampleMaterial(uint slot, vec2 uv)
+{
+	uvec2 entry = material_textures[material_id * 5u + slot];
+	if (entry == uvec2(MATERIAL_BOUND_ENTRY))
+	{
+		return texture(material_bound[slot], uv);
+	}
+#ifdef XRE_MATERIAL_TEXTURES_BINDLESS
+	return texture(sampler2D(entry), uv);
+#else
+	return texture(material_arrays[entry.x], vec3(uv, float(entry.y)));
+#endif
+}
+#else
+uniform sampler2D texture_diffuse;
+
+#define MATERIAL_DIFFUSE texture_diffuse
+#define SampleMaterial(slot, uv) texture(slot, uv)
+#endif
+
+uniform float alpha_cutoff;
+
+void main()
+{
+	if(SampleMaterial(MATERIAL_DIFFUSE, TexCoords).a < alpha_cutoff)
+	{
+		discard;
+	}
+}
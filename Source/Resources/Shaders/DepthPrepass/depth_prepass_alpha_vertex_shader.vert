@@ -0,0 +1,45 @@
+#version 440 core
+
+// Alpha tested variant, also passes the texture coordinates.
+
+layout (location = 0) in vec4 aPos; // xyz : quantized position, w : bitangent sign
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+flat out uint material_id;
+
+
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
+
+invariant gl_Position;
+
+// Objects storage block, object_id, DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_OBJECTS)
+
+// Renderer::buildInstanceGroups : instanced draws read their matrices from the instance buffer
+struct Instance
+{
+	mat4 model;
+	mat4 previous_model;
+};
+
+layout (std430, binding = 5) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+uniform bool instanced;
+uniform uint instance_offset;
+
+mat4 ModelMatrix()
+{
+	return instanced ? instances[instance_offset + gl_InstanceID].model : objects[object_id].model;
+}
+
+void main()
+{
+	TexCoords = aTexCoords;
+	material_id = objects[object_id].material_id;
+
+	vec4 world_position = ModelMatrix() * vec4(DecodePosition(aPos), 1.0);
+	gl_Position = projection * view * world_position;
+}
@@ -0,0 +1,7 @@
+#version 440 core
+
+// Depth only, no color attachments are written.
+
+void main()
+{
+}
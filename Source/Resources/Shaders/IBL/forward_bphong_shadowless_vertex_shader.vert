@@ -1,7 +1,7 @@
 #version 440 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;			// xyz : quantized position, w : bitangent sign
+layout (location = 1) in vec2 aNormal;		// octahedral
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
@@ -16,15 +16,17 @@ uniform mat4 directional_light_space_matrix;
 
 out vec3 normal;
 
+// DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_POSITION_UNIFORMS)
+
 // ------------------
 
 void main()
 {
 	//----------------------------------------------------------------------
 
-	FragPos = vec3(model * vec4(aPos,1.0));
+	FragPos = vec3(model * vec4(DecodePosition(aPos), 1.0));
     TexCoords = aTexCoords;
-	normal = aNormal;
+	normal = DecodeOctahedral(aNormal);
 	FragPosLightSpace = directional_light_space_matrix * vec4(FragPos,1.0);
 	//----------------------------------------------------------------------
 
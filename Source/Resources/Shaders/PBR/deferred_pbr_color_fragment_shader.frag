@@ -1,6 +1,6 @@
 #version 440 core
 
-#define MAX_POINT_LIGHTS 3
+#define MAX_POINT_LIGHTS 20
 #define MAX_POINT_SHADOWS 3
 #define MIN_VARIANCE 0.00001
 #define LIGHT_BLEED_REDUCTION_AMOUNT 1.0
@@ -49,19 +49,24 @@ in vec3 view_ray;
 
 // -----------------------
 
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
+// Frame uniform block : Renderer::shaderPreamble(SHADER_PREAMBLE_FRAME)
 
-uniform mat4 directional_light_space_matrix;
-uniform bool directional_lighting_enabled;
-
-uniform int N_POINT;
+// Renderer::updateLightUniforms, the same block in every program
+layout (std140, binding = 2) uniform Lights
+{
+	int N_POINT;
+	bool directional_lighting_enabled;
+	DirectionalLight directionalLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+};
 
 // -----------------------
 
-uniform float near;
-uniform float far;
-uniform int use_ssao;
+uniform int ao_mode; // 0 : disabled, 1 : SSAO, 2 : GTAO
+uniform vec2 uv_scale = vec2(1.0); // render viewport / allocated G-buffer size (dynamic resolution)
+
+// TexCoords span the render viewport, the G-buffer textures are only filled up to uv_scale
+vec2 GBufferCoords;
 
 // -----------------------
 
@@ -71,18 +76,11 @@ uniform samplerCube point_shadow_depth_map[MAX_POINT_SHADOWS];
 
 // -----------------------
 
-uniform vec3 camera_pos;
-uniform vec3 camera_look_direction;
-uniform mat4 inv_projection;
-uniform mat4 inv_view;
-
 uniform sampler2D diffuse_texture; //albedo
-uniform sampler2D normal_texture;
-uniform sampler2D depth_texture;
-uniform sampler2D ssao_texture;
-uniform sampler2D mor_texture; // Metallic, Occlusion, Roughness
-uniform float positive_exponent;
-uniform float negative_exponent;
+uniform sampler2D normal_texture; // octahedral normal, roughness, flags
+uniform sampler2D depth_texture; // hardware depth
+uniform sampler2D ao_texture; // SSAO : r, GTAO : rgb bent normal, a visibility
+uniform sampler2D occlusion_texture;
 // -----------------------
 
 const float PI = 3.14159265359;
@@ -301,9 +299,19 @@ vec3 CalcPoint(int index, vec3 FPos, vec3 V, vec3 N, vec3 mor, vec3 F0, vec3 alb
 	return Lo;
 }
 
+// Octahedral normal decoding, see the fill shader for the encoding
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
 vec3 ScreenToWorldPos()
 {
-	float z = texture(depth_texture, TexCoords).r * 2.0 - 1.0;
+	float z = texture(depth_texture, GBufferCoords).r * 2.0 - 1.0;
 
 	vec4 clipSpacePosition = vec4(TexCoords * 2.0 - 1.0, z, 1.0);
 	vec4 viewSpacePosition = inv_projection * clipSpacePosition;
@@ -349,26 +357,46 @@ vec3 ParallaxCorrect(vec3 position, vec3 viewdir, vec3 direction, vec3 light_pro
 
 void main()
 {
+	GBufferCoords = TexCoords * uv_scale;
+
+	vec4 color_sample = texture(diffuse_texture, GBufferCoords);
+	vec4 normal_sample = texture(normal_texture, GBufferCoords);
+
+	// Background, nothing was rasterized here
+	if(int(normal_sample.a * 3.0 + 0.5) == 0)
+	{
+		FragColor = color_sample.rgb;
+		BrightColor = vec3(0.0);
+		return;
+	}
+
 	vec3 color = vec3(0.0);
-	vec3 albedo = pow(texture(diffuse_texture, TexCoords).rgb, vec3(2.0));
-	vec3 mor = texture(mor_texture, TexCoords).rgb;
-	vec3 normal = normalize(texture(normal_texture, TexCoords).xyz * 2.0 - 1.0);
+	vec3 albedo = pow(color_sample.rgb, vec3(2.0));
+	vec3 mor = vec3(color_sample.a, texture(occlusion_texture, GBufferCoords).r, normal_sample.b); // Metallic, Occlusion, Roughness
+	vec3 normal = DecodeNormal(normal_sample.rg);
 	float ssao = 1.0;
+	vec3 bent_normal = normal;
 	vec3 irradiance;
 	vec3 ambient;
 	vec3 specular;
 	vec3 specularIrradiance;
 	vec2 envBRDF;
 
-	if(use_ssao == 1)
+	if(ao_mode == 1)
+	{
+		ssao = texture(ao_texture, GBufferCoords).r;
+	}
+	else if(ao_mode == 2)
 	{
-		ssao = texture(ssao_texture, TexCoords).r;
+		vec4 gtao = texture(ao_texture, GBufferCoords);
+		ssao = gtao.a;
+		bent_normal = normalize(gtao.rgb * 2.0 - 1.0);
 	}
 
 	FragPos = ScreenToWorldPos();
 	FragPosLightSpace = directional_light_space_matrix * vec4(FragPos,1.0);
 
-	vec3 viewdir = normalize(camera_pos - FragPos);
+	vec3 viewdir = normalize(camera_position - FragPos);
 
 	
 	vec3 F0 = vec3(0.04);
@@ -380,7 +408,7 @@ void main()
 	
 	int closest_probe_index = FindClosestProbe(FragPos);
 	
-	irradiance = texture(diffuse_irradiance_light_probe_cubemaps, vec4(normal, closest_probe_index)).rgb;
+	irradiance = texture(diffuse_irradiance_light_probe_cubemaps, vec4(bent_normal, closest_probe_index)).rgb;
 
 	vec3 diffuse = irradiance * albedo;
 
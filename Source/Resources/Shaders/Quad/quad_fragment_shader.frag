@@ -6,6 +6,8 @@ in vec2 TexCoords;
 
 uniform sampler2D screenTexture;
 uniform sampler2D bloomTexture;
+uniform float bloom_strength = 1.0;
+uniform vec2 uv_scale = vec2(1.0); // screenTexture may only be filled up to the dynamic resolution viewport
 
 uniform bool gamma_correct = true;
 uniform float gamma = 2.2;
@@ -26,10 +28,10 @@ vec3 applyGammaCorrection(vec3 in_color)
 
 void main()
 {	
-	color_sample = texture(screenTexture, TexCoords).rgb;
+	color_sample = texture(screenTexture, TexCoords * uv_scale).rgb;
 	vec3 bloomColor = texture(bloomTexture, TexCoords).rgb;
 
-	color_sample += bloomColor;
+	color_sample += bloomColor * bloom_strength;
 
 	// HDR
 	out_color = HDRtoLDR(color_sample);
@@ -0,0 +1,29 @@
+#version 440 core
+
+// Reduces the full resolution depth attachment to a half resolution linear (view space) depth.
+// The closest of each 2x2 footprint is kept so thin foreground edges survive the downsample.
+
+layout (location = 0) out float LinearDepthOut;
+
+in vec2 TexCoords;
+
+uniform sampler2D depth_texture;
+uniform vec2 depth_params; // projection[2][2], projection[3][2]
+
+float LinearizeDepth(float depth)
+{
+	return depth_params.y / ((depth * 2.0 - 1.0) + depth_params.x);
+}
+
+void main()
+{
+	ivec2 full_res_size = textureSize(depth_texture, 0);
+	ivec2 texel = min(ivec2(gl_FragCoord.xy) * 2, full_res_size - ivec2(2));
+
+	float d0 = texelFetch(depth_texture, texel, 0).r;
+	float d1 = texelFetch(depth_texture, texel + ivec2(1, 0), 0).r;
+	float d2 = texelFetch(depth_texture, texel + ivec2(0, 1), 0).r;
+	float d3 = texelFetch(depth_texture, texel + ivec2(1, 1), 0).r;
+
+	LinearDepthOut = LinearizeDepth(min(min(d0, d1), min(d2, d3)));
+}
@@ -1,67 +1,124 @@
 #version 440 core
 
-# define NUM_SAMPLES 8
+// Half resolution SSAO with temporal accumulation.
+// Each frame takes NUM_SAMPLES samples with a per-pixel, per-frame rotation and blends the result
+// into the reprojected history, so the effective sample count grows over several frames.
 
-out float FragColor;
+#define NUM_SAMPLES 8
+
+layout (location = 0) out vec2 FragColor; // r : ambient occlusion, g : linear depth
 
 in vec2 TexCoords;
 
-uniform sampler2D depth_texture;
-uniform sampler2D normal_texture;
-uniform sampler2D noise_texture;
+layout (std140, binding = 0) uniform SSAOKernel
+{
+	vec4 kernel[NUM_SAMPLES];
+};
+
+uniform sampler2D linear_depth_texture;
+uniform sampler2D normal_texture; // octahedral world normal
+uniform sampler2D history_texture;
 
-uniform vec3 kernel[NUM_SAMPLES];
 uniform mat4 projection;
 uniform mat4 view;
+uniform mat4 inv_view;
+uniform mat4 previous_view_projection;
+uniform vec2 proj_params; // 1.0 / projection[0][0], 1.0 / projection[1][1]
+
 uniform float radius = 0.25;
-uniform float bias = 0.1;
-uniform mat4 inv_projection;
+uniform float bias = 0.025;
+uniform float far_plane;
+uniform uint frame_index;
+uniform bool history_valid;
+uniform float history_weight = 0.9;
 
-const vec2 noiseScale = textureSize(depth_texture, 0) / 4.0;
+// Render viewport / allocated size, for this frame and for the frame the history was written in
+uniform vec2 uv_scale = vec2(1.0);
+uniform vec2 history_uv_scale = vec2(1.0);
 
+const float PI = 3.14159265359;
 
-vec3 ScreenToViewPos(vec2 coords)
+vec3 ViewPosFromLinearDepth(vec2 coords, float linear_depth)
 {
-	float z = texture(depth_texture, coords).r * 2.0 - 1.0;
-
-	vec4 clipSpacePosition = vec4(coords * 2.0 - 1.0, z, 1.0);
-	vec4 viewSpacePosition = inv_projection * clipSpacePosition;
-
-	viewSpacePosition /= viewSpacePosition.w;
+	return vec3((coords * 2.0 - 1.0) * proj_params * linear_depth, -linear_depth);
+}
 
-	return viewSpacePosition.xyz;
+// Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare"
+float InterleavedGradientNoise(vec2 pixel, uint frame)
+{
+	pixel += 5.588238 * float(frame % 64u);
+	return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
 }
 
-void main()
+vec3 DecodeNormal(vec2 f)
 {
-    vec3 FragPos = ScreenToViewPos(TexCoords).xyz;
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
 
-	vec3 normal = mat3(view) * texture(normal_texture, TexCoords).xyz;
-	vec3 noise = texture(noise_texture, TexCoords * noiseScale).rgb;
+float ComputeOcclusion(vec3 frag_pos, vec3 normal)
+{
+	float angle = InterleavedGradientNoise(gl_FragCoord.xy, frame_index) * 2.0 * PI;
+	vec3 random_vec = vec3(cos(angle), sin(angle), 0.0);
 
-	vec3 T = normalize(noise - normal * dot(noise, normal));
+	vec3 T = normalize(random_vec - normal * dot(random_vec, normal));
 	vec3 B = cross(normal, T);
-
-	mat3 TBN = mat3(T,B,normal);
+	mat3 TBN = mat3(T, B, normal);
 
 	float occlusion = 0.0;
-	float sample_depth;
 	for(int i=0; i<NUM_SAMPLES; ++i)
 	{
-		vec3 kernel_sample = TBN * kernel[i];
-		kernel_sample = FragPos + kernel_sample * radius;
+		vec3 kernel_sample = frag_pos + (TBN * kernel[i].xyz) * radius;
+
+		vec4 offset = projection * vec4(kernel_sample, 1.0);
+		offset.xy = (offset.xy / offset.w) * 0.5 + 0.5;
+
+		float scene_depth = textureLod(linear_depth_texture, min(offset.xy, vec2(1.0)) * uv_scale, 0).r;
+
+		float range_check = smoothstep(0.0, 1.0, radius / abs(-frag_pos.z - scene_depth));
+		occlusion += (scene_depth <= -kernel_sample.z - bias ? 1.0 : 0.0) * range_check;
+	}
+
+	return pow(1.0 - occlusion / NUM_SAMPLES, 2.0);
+}
+
+void main()
+{
+	float linear_depth = textureLod(linear_depth_texture, TexCoords * uv_scale, 0).r;
+
+	if(linear_depth >= far_plane * 0.999)
+	{
+		FragColor = vec2(1.0, linear_depth);
+		return;
+	}
 
-		vec4 offset = vec4(kernel_sample, 1.0);
-		offset = projection * offset;
-		offset.xyz /= offset.w;
-		offset.xyz = offset.xyz * 0.5 + 0.5;
+	vec3 frag_pos = ViewPosFromLinearDepth(TexCoords, linear_depth);
+	vec3 normal = normalize(mat3(view) * DecodeNormal(texture(normal_texture, TexCoords * uv_scale).rg));
 
-		sample_depth = ScreenToViewPos(offset.xy).z;
+	float ao = ComputeOcclusion(frag_pos, normal);
 
-		float rangeCheck = smoothstep(0.0, 1.0, radius/abs(FragPos.z - sample_depth));
-		occlusion += (sample_depth >= kernel_sample.z + bias ? 1.0 : 0.0) * rangeCheck;
+	// Reprojection
+	if(history_valid)
+	{
+		vec4 world_pos = inv_view * vec4(frag_pos, 1.0);
+		vec4 previous_clip = previous_view_projection * world_pos;
+		vec2 previous_uv = (previous_clip.xy / previous_clip.w) * 0.5 + 0.5;
+
+		if(all(greaterThanEqual(previous_uv, vec2(0.0))) && all(lessThanEqual(previous_uv, vec2(1.0))))
+		{
+			vec2 history = textureLod(history_texture, previous_uv * history_uv_scale, 0).rg;
+
+			// Reject history that belonged to a different surface (disocclusion).
+			float depth_similarity = abs(history.g - previous_clip.w) / previous_clip.w;
+			if(depth_similarity < 0.05)
+			{
+				ao = mix(ao, history.r, history_weight);
+			}
+		}
 	}
 
-	occlusion = (occlusion / (NUM_SAMPLES));
-	FragColor = pow(1.0 - occlusion, 2.0);
-}
\ No newline at end of file
+	FragColor = vec2(ao, linear_depth);
+}
@@ -0,0 +1,57 @@
+#version 440 core
+
+// Depth aware (bilateral) upsample of the half resolution SSAO history to full resolution.
+// The 4x4 low resolution neighbourhood also removes what is left of the per-pixel noise.
+
+layout (location = 0) out float FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D depth_texture;	// full resolution, non-linear
+uniform sampler2D ssao_texture;		// half resolution, r : ambient occlusion, g : linear depth
+uniform vec2 depth_params;
+uniform float far_plane;
+uniform vec2 uv_scale = vec2(1.0);	// render viewport / allocated size
+uniform vec2 ssao_size;				// half resolution viewport the ssao was rendered into
+
+float LinearizeDepth(float depth)
+{
+	return depth_params.y / ((depth * 2.0 - 1.0) + depth_params.x);
+}
+
+void main()
+{
+	float full_res_depth = LinearizeDepth(texture(depth_texture, TexCoords * uv_scale).r);
+
+	if(full_res_depth >= far_plane * 0.999)
+	{
+		FragColor = 1.0;
+		return;
+	}
+
+	vec2 low_res_coords = TexCoords * ssao_size - 0.5;
+	ivec2 base = ivec2(floor(low_res_coords));
+	vec2 f = fract(low_res_coords);
+
+	float ao = 0.0;
+	float total_weight = 0.0;
+
+	for(int y=-1; y<=2; y++)
+	{
+		for(int x=-1; x<=2; x++)
+		{
+			ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), ivec2(ssao_size) - 1);
+			vec2 s = texelFetch(ssao_texture, texel, 0).rg;
+
+			vec2 d = vec2(x, y) - f;
+			float spatial_weight = exp(-dot(d, d) * 0.5);
+			float depth_weight = 1.0 / (0.001 + abs(full_res_depth - s.g) / full_res_depth);
+
+			float w = spatial_weight * depth_weight;
+			ao += s.r * w;
+			total_weight += w;
+		}
+	}
+
+	FragColor = total_weight > 0.0 ? ao / total_weight : 1.0;
+}
@@ -1,6 +1,6 @@
 #version 440 core
 
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos; // xyz : quantized position, w : bitangent sign
 
 uniform float farPlane;
 uniform mat4 model;
@@ -10,9 +10,11 @@ uniform bool back;
 out vec4 FragWorldPos;
 out float far;
 
+// DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_POSITION_UNIFORMS)
+
 void main()
 {
-	FragWorldPos = model * vec4(aPos, 1.0);
+	FragWorldPos = model * vec4(DecodePosition(aPos), 1.0);
 	gl_Position = light_view * FragWorldPos;
 
 	highp float L = -gl_Position.z;
@@ -1,10 +1,10 @@
 #version 440 core
 
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos; // xyz : quantized position, w : bitangent sign
 
-uniform mat4 model;
+// Objects storage block, object_id, DecodePosition and DecodeOctahedral : Renderer::shaderPreamble(SHADER_PREAMBLE_OBJECTS)
 
 void main()
 {
-	gl_Position = model * vec4(aPos,1.0);
+	gl_Position = objects[object_id].model * vec4(DecodePosition(aPos), 1.0);
 } 
\ No newline at end of file
@@ -0,0 +1,158 @@
+#version 440 core
+
+// Temporal anti-aliasing / upscaling resolve.
+// Runs at output resolution. The jittered render resolution samples around each output pixel are
+// reconstructed with a Blackman-Harris approximation and blended into the reprojected history,
+// which is clipped against the YCoCg neighbourhood of the current frame to reject stale colors.
+
+layout (location = 0) out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D color_texture;		// render resolution viewport of a larger target, HDR
+uniform sampler2D velocity_texture;		// render resolution viewport, uv space, current - previous
+uniform sampler2D depth_texture;		// render resolution viewport, non-linear
+uniform sampler2D history_texture;		// output resolution
+
+uniform vec2 jitter;					// render target pixels
+uniform vec2 render_size;				// current render viewport, changes with dynamic resolution
+uniform mat4 reprojection_matrix;		// previous view projection * inverse(current view projection), unjittered
+uniform bool history_valid;
+
+uniform float min_blend_factor = 0.03;
+uniform float max_blend_factor = 0.12;
+
+vec3 RGBToYCoCg(vec3 c)
+{
+	return vec3(
+		 0.25 * c.r + 0.5 * c.g + 0.25 * c.b,
+		 0.5  * c.r             - 0.5  * c.b,
+		-0.25 * c.r + 0.5 * c.g - 0.25 * c.b);
+}
+
+vec3 YCoCgToRGB(vec3 c)
+{
+	return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+// 5 tap Catmull-Rom, keeps the history sharp under motion
+vec3 SampleHistory(vec2 uv)
+{
+	vec2 texture_size = textureSize(history_texture, 0);
+	vec2 sample_position = uv * texture_size;
+	vec2 texel_position_1 = floor(sample_position - 0.5) + 0.5;
+	vec2 f = sample_position - texel_position_1;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+	vec2 w12 = w1 + w2;
+	vec2 texel_position_0 = (texel_position_1 - 1.0) / texture_size;
+	vec2 texel_position_3 = (texel_position_1 + 2.0) / texture_size;
+	vec2 texel_position_12 = (texel_position_1 + w2 / w12) / texture_size;
+
+	vec3 result = vec3(0.0);
+	result += textureLod(history_texture, vec2(texel_position_12.x, texel_position_0.y), 0).rgb * w12.x * w0.y;
+	result += textureLod(history_texture, vec2(texel_position_0.x, texel_position_12.y), 0).rgb * w0.x * w12.y;
+	result += textureLod(history_texture, texel_position_12, 0).rgb * w12.x * w12.y;
+	result += textureLod(history_texture, vec2(texel_position_3.x, texel_position_12.y), 0).rgb * w3.x * w12.y;
+	result += textureLod(history_texture, vec2(texel_position_12.x, texel_position_3.y), 0).rgb * w12.x * w3.y;
+
+	float total_weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+
+	return max(result / total_weight, vec3(0.0));
+}
+
+float Luminance(vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+	ivec2 render_size_i = ivec2(render_size);
+
+	// Position of this output pixel in the jittered render target, in pixels. Camera::UpdateCamera moves the image
+	// by +jitter, so the texel at c holds the unjittered scene at c - jitter and this pixel's content sits at + jitter.
+	vec2 sample_position = TexCoords * render_size + jitter;
+	ivec2 center_texel = ivec2(floor(sample_position));
+
+	vec3 reconstructed = vec3(0.0);
+	float reconstruction_weight = 0.0;
+	float max_sample_weight = 0.0;
+
+	vec3 m1 = vec3(0.0), m2 = vec3(0.0);
+	vec3 neighbourhood_min = vec3(1e10), neighbourhood_max = vec3(-1e10);
+
+	float closest_depth = 1.0;
+	ivec2 closest_texel = center_texel;
+
+	for(int y = -1; y <= 1; y++)
+	{
+		for(int x = -1; x <= 1; x++)
+		{
+			ivec2 texel = clamp(center_texel + ivec2(x, y), ivec2(0), render_size_i - 1);
+			vec3 c = texelFetch(color_texture, texel, 0).rgb;
+
+			vec2 d = vec2(texel) + 0.5 - sample_position;
+			float w = exp(-2.29 * dot(d, d));
+			reconstructed += c * w;
+			reconstruction_weight += w;
+			max_sample_weight = max(max_sample_weight, w);
+
+			vec3 ycocg = RGBToYCoCg(c);
+			m1 += ycocg;
+			m2 += ycocg * ycocg;
+			neighbourhood_min = min(neighbourhood_min, ycocg);
+			neighbourhood_max = max(neighbourhood_max, ycocg);
+
+			// Velocity dilation : take motion from the closest surface so edges move with the foreground
+			float depth = texelFetch(depth_texture, texel, 0).r;
+			if(depth < closest_depth)
+			{
+				closest_depth = depth;
+				closest_texel = texel;
+			}
+		}
+	}
+
+	vec3 current = reconstructed / max(reconstruction_weight, 0.0001);
+
+	vec2 velocity = texelFetch(velocity_texture, closest_texel, 0).rg;
+	if(closest_depth >= 1.0)
+	{
+		// Nothing was rasterized here, only the camera moved
+		vec4 previous_clip = reprojection_matrix * vec4(TexCoords * 2.0 - 1.0, 1.0, 1.0);
+		velocity = TexCoords - (previous_clip.xy / previous_clip.w * 0.5 + 0.5);
+	}
+
+	vec2 history_uv = TexCoords - velocity;
+
+	if(!history_valid || any(lessThan(history_uv, vec2(0.0))) || any(greaterThan(history_uv, vec2(1.0))))
+	{
+		FragColor = vec4(current, 1.0);
+		return;
+	}
+
+	// Variance clipping, bounded by the neighbourhood extents
+	vec3 mean = m1 / 9.0;
+	vec3 sigma = sqrt(abs(m2 / 9.0 - mean * mean));
+	vec3 box_min = max(neighbourhood_min, mean - 1.25 * sigma);
+	vec3 box_max = min(neighbourhood_max, mean + 1.25 * sigma);
+
+	vec3 history = RGBToYCoCg(SampleHistory(history_uv));
+	history = YCoCgToRGB(clamp(history, box_min, box_max));
+
+	// Samples landing close to this output pixel are trusted more
+	float blend_factor = mix(min_blend_factor, max_blend_factor, max_sample_weight);
+
+	// Luminance weighting keeps bright fireflies from dominating the average
+	float current_weight = blend_factor / (1.0 + Luminance(current));
+	float history_weight = (1.0 - blend_factor) / (1.0 + Luminance(history));
+
+	vec3 result = (current * current_weight + history * history_weight) / (current_weight + history_weight);
+
+	FragColor = vec4(result, 1.0);
+}
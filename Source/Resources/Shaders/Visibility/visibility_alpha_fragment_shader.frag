@@ -0,0 +1,23 @@
+#version 440 core
+
+// Alpha tested variant, discards with the same cutoff as the deferred fill shaders.
+
+#define TRIANGLE_BITS 23
+
+layout (location = 0) out uint VisibilityOut;
+
+in vec2 TexCoords;
+
+uniform uint draw_id;
+uniform sampler2D texture_diffuse;
+uniform float alpha_cutoff;
+
+void main()
+{
+	if(texture(texture_diffuse, TexCoords).a < alpha_cutoff)
+	{
+		discard;
+	}
+
+	VisibilityOut = (draw_id << TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
@@ -0,0 +1,14 @@
+#version 440 core
+
+// Visibility buffer : draw index in the high bits, triangle index in the low bits. Nothing else is written.
+
+#define TRIANGLE_BITS 23
+
+layout (location = 0) out uint VisibilityOut;
+
+uniform uint draw_id;
+
+void main()
+{
+	VisibilityOut = (draw_id << TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <chrono>
 #include <filesystem>
+#include <cmath>
 #include <assimp/version.h>
 
 // Custom
@@ -12,6 +13,7 @@
 #include <camera.h>
 #include <lights.h>
 #include <renderer.h>
+#include <static_batcher.h>
 
 // Essentials
 #include <glad/glad.h>
@@ -93,16 +95,24 @@ int main()
 
 	xre::RENDER_PIPELINE rendering_pipeline = xre::RENDER_PIPELINE::DEFERRED;
 	xre::LIGHTING_MODE lighting_mode = xre::LIGHTING_MODE::PBR; // PBR works with deferred only.
+	float render_scale = 0.67f; // Deferred only, TAA upscales to SCR_WIDTH x SCR_HEIGHT. Starting point when dynamic resolution is on.
+	bool dynamic_resolution = true;
 
 	xre::Renderer* renderer = xre::Renderer::renderer(SCR_WIDTH, SCR_HEIGHT,
 		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
 		1.0f, 100.0f, 512, 512,
-		rendering_pipeline, lighting_mode);
+		rendering_pipeline, lighting_mode,
+		render_scale);
 
 	// Camera
 	xre::Camera camera(window, glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 60.0f, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f, SCR_WIDTH, SCR_HEIGHT);
 	xre::CameraMatrix cm;
 
+	if (rendering_pipeline == xre::RENDER_PIPELINE::DEFERRED || rendering_pipeline == xre::RENDER_PIPELINE::VISIBILITY)
+	{
+		renderer->setDynamicResolution(dynamic_resolution, 16.0f, 0.5f);
+	}
+
 	// Lights setup
 	//xre::DirectionalLight directional_light = xre::DirectionalLight(glm::vec3(0.0f, 50.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), 30.0f, "directionalLight");
 
@@ -121,7 +131,8 @@ int main()
 	std::unique_ptr<xre::Shader> sponza_shader = std::make_unique<xre::Shader>
 	(
 		"./Source/Resources/Shaders/BlinnPhong/forward_bphong_vertex_shader.vert",
-		"./Source/Resources/Shaders/BlinnPhong/forward_bphong_fragment_shader.frag"
+		"./Source/Resources/Shaders/BlinnPhong/forward_bphong_fragment_shader.frag",
+		nullptr, xre::Renderer::shaderPreamble(xre::SHADER_PREAMBLE_FRAME | xre::SHADER_PREAMBLE_OBJECTS)
 	);
 	
 	sponza.translate(glm::vec3(0.0, 0.0, 0.0));
@@ -133,7 +144,18 @@ int main()
 	// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 	// Push objects to draw queue
-	sponza.draw(*sponza_shader, "sponza");
+	// The deferred pipeline draws sponza merged by material. The forward shader takes its model matrix
+	// from above and the visibility pipeline cannot draw batches, both keep the model.
+	xre::StaticBatcher static_batcher;
+	if (rendering_pipeline == xre::RENDER_PIPELINE::DEFERRED && static_batcher.add(sponza))
+	{
+		static_batcher.build();
+		static_batcher.draw(*sponza_shader, "sponza");
+	}
+	else
+	{
+		sponza.draw(*sponza_shader, "sponza");
+	}
 	// ----------------------------------------
 	while (!glfwWindowShouldClose(window))
 	{
@@ -145,19 +167,21 @@ int main()
 		//point_light_1.m_position = glm::vec3(8.0f, 2.0f, 0.0f) + glm::vec3(3.0 * glm::cos(glm::radians(glfwGetTime() * 20.0)), 0.0, 0.0);
 		//point_light_2.m_position = glm::vec3(-8.0f, 2.0f, 0.0f) + glm::vec3(3.0 * glm::cos(glm::radians(glfwGetTime() * 20.0)), 0.0, 0.0);
 
+		if (rendering_pipeline == xre::RENDER_PIPELINE::DEFERRED || rendering_pipeline == xre::RENDER_PIPELINE::VISIBILITY)
+		{
+			// The render size follows the GPU frame time when dynamic resolution is on. Without TAA nothing resolves the jitter.
+			float scale = (float)renderer->getRenderWidth() / SCR_WIDTH;
+			camera.SetJitter(renderer->getTemporalAntiAliasing(), renderer->getRenderWidth(), renderer->getRenderHeight(), (unsigned int)std::ceil(8.0f / (scale * scale)));
+		}
+
 		cm = camera.UpdateCamera(4.0f * delta_time.count(), 20.0f * delta_time.count());
-		renderer->setCameraMatrices(&cm.view, &cm.projection, &camera.position, &camera.front);
+		renderer->setCameraMatrices(&cm.view, &cm.projection, &camera.position, &camera.front, &cm.unjittered_projection, &cm.jitter);
 
 		if (rendering_pipeline == xre::RENDER_PIPELINE::FORWARD)
 		{
+			// camera and shadow constants come from the renderer's frame uniform block, the model matrix from its object buffer
 			sponza_shader->use();
-			sponza_shader->setMat4("view", cm.view);
-			sponza_shader->setMat4("projection", cm.projection);
-			sponza_shader->setMat4("model", sponza.model_matrix);
-			sponza_shader->setVec3("camera_position_vertex", camera.position);
 			sponza_shader->setFloat("shininess", 128);
-			sponza_shader->setFloat("positive_exponent", 20.0f);
-			sponza_shader->setFloat("negative_exponent", 80.0f);
 		}
 
 		// Draw to screen
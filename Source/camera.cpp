@@ -8,13 +8,26 @@
 
 using namespace xre;
 
+static float Halton(unsigned int index, unsigned int base)
+{
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0)
+	{
+		fraction /= base;
+		result += fraction * (index % base);
+		index /= base;
+	}
+	return result;
+}
+
 Camera::Camera(GLFWwindow* window, glm::vec3 cameraPosition, glm::vec3 cameraFront, glm::vec3 globalUp, float fov, float aspectRatio, float near, float far, float scr_width, float scr_height)
 {
 	position = cameraPosition;
 	front = cameraFront;
 	worldUp = globalUp;
 
-	m_cm = { glm::mat4(1.0f), glm::mat4(1.0f) };
+	m_cm = { glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f), glm::vec2(0.0f) };
 
 	Camera::m_window = window;
 	Camera::m_fov = fov;
@@ -35,7 +48,7 @@ Camera::Camera(GLFWwindow* window, float fov, float aspectRatio, float near, flo
 	yaw = eulerValues.y;
 	roll = eulerValues.z;
 
-	m_cm = { glm::mat4(1.0f), glm::mat4(1.0f) };
+	m_cm = { glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f), glm::vec2(0.0f) };
 
 	Camera::m_window = window;
 	Camera::m_fov = fov;
@@ -106,6 +119,21 @@ CameraMatrix Camera::UpdateCamera(float movementSpeed, float rotationSpeed,
 	m_projection = glm::perspective(glm::radians(m_fov), m_aspectRatio, m_near, m_far);
 	m_view = glm::lookAt(position, position + front, up);
 
+	m_cm.unjittered_projection = m_projection;
+	m_cm.jitter = glm::vec2(0.0f);
+
+	if (m_jitter_enabled)
+	{
+		// 1-based so the sequence never starts at (0, 0)
+		m_jitter_index = (m_jitter_index % m_jitter_phase_count) + 1;
+		m_cm.jitter = glm::vec2(Halton(m_jitter_index, 2), Halton(m_jitter_index, 3)) - glm::vec2(0.5f);
+
+		// The image moves by +jitter pixels : clip.w is -z_view, so the z column term is subtracted to add to ndc.
+		// A texel center c then holds the scene at c - jitter, the TAA resolve samples around pixel + jitter.
+		m_projection[2][0] -= 2.0f * m_cm.jitter.x / m_render_width;
+		m_projection[2][1] -= 2.0f * m_cm.jitter.y / m_render_height;
+	}
+
 	m_cm.projection = m_projection;
 	m_cm.view = m_view;
 
@@ -132,4 +160,16 @@ glm::vec3 Camera::GetMouseClickDirection()
 	glm::vec3 ray_world = glm::normalize(glm::vec3(ray_world4.x, ray_world4.y, ray_world4.z));
 
 	return ray_world;
+}
+
+void Camera::SetJitter(bool enabled, unsigned int render_width, unsigned int render_height, unsigned int phase_count)
+{
+	// Only restart the sequence when jitter is switched on, so the render size can be updated every frame
+	if (enabled && !m_jitter_enabled)
+		m_jitter_index = 0;
+
+	m_jitter_enabled = enabled;
+	m_render_width = (float)render_width;
+	m_render_height = (float)render_height;
+	m_jitter_phase_count = phase_count > 0 ? phase_count : 1;
 }
\ No newline at end of file
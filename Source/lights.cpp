@@ -15,7 +15,7 @@ static auto LOGGER = LogModule::getLoggerInstance();
 
 #pragma region Light
 Light::Light()
-	: m_position(glm::vec3(0.0f)), m_color(glm::vec3(0.0f)), m_direction(glm::vec3(0.0f)), m_intensityMultiplier(0) {}
+	: m_position(glm::vec3(0.0f)), m_color(glm::vec3(0.0f)), m_direction(glm::vec3(0.0f)), m_intensityMultiplier(0), m_dirty(true) {}
 
 void Light::Translate(const glm::vec3& vector)
 {
@@ -29,6 +29,21 @@ void Light::SetDirection(const glm::vec3& direction)
 
 void Light::SetShaderAttrib(const std::string& lightuniform, const Shader& shader)
 {}
+
+const std::vector<std::string>& Light::uniformNames(const std::string& lightuniform, const char* const* members, unsigned int member_count)
+{
+	if (lightuniform != m_uniform_prefix || m_uniform_names.size() != member_count)
+	{
+		m_uniform_prefix = lightuniform;
+		m_uniform_names.clear();
+		for (unsigned int i = 0; i < member_count; i++)
+		{
+			m_uniform_names.push_back(lightuniform + members[i]);
+		}
+	}
+
+	return m_uniform_names;
+}
 #pragma endregion
 
 #pragma region DirectionalLight
@@ -55,13 +70,17 @@ DirectionalLight::DirectionalLight()
 void DirectionalLight::SetDirection(const glm::vec3& direction)
 {
 	m_direction = direction;
+	m_dirty = true;
 }
 
 void  DirectionalLight::SetShaderAttrib(const std::string& lightuniform, const Shader& shader)
 {
-	shader.setVec3(lightuniform + ".position", m_position);
-	shader.setVec3(lightuniform + ".direction", m_direction);
-	shader.setVec3(lightuniform + ".color", m_color * m_intensityMultiplier);
+	static const char* const members[] = { ".position", ".direction", ".color" };
+	const std::vector<std::string>& names = uniformNames(lightuniform, members, 3);
+
+	shader.setVec3(names[0], m_position);
+	shader.setVec3(names[1], m_direction);
+	shader.setVec3(names[2], m_color * m_intensityMultiplier);
 }
 #pragma endregion
 
@@ -82,15 +101,19 @@ PointLight::PointLight(const glm::vec3& position, const glm::vec3& color, const
 void PointLight::Translate(const glm::vec3& vector)
 {
 	m_position += vector;
+	m_dirty = true;
 }
 
 void PointLight::SetShaderAttrib(const std::string& lightuniform, const Shader& shader)
 {
-	shader.setVec3(lightuniform + ".position", m_position);
-	shader.setVec3(lightuniform + ".color", m_color * m_intensityMultiplier);
-	shader.setFloat(lightuniform + ".kc", m_constantFalloff);
-	shader.setFloat(lightuniform + ".kl", m_linearFalloff);
-	shader.setFloat(lightuniform + ".kq", m_quadraticFalloff);
+	static const char* const members[] = { ".position", ".color", ".kc", ".kl", ".kq" };
+	const std::vector<std::string>& names = uniformNames(lightuniform, members, 5);
+
+	shader.setVec3(names[0], m_position);
+	shader.setVec3(names[1], m_color * m_intensityMultiplier);
+	shader.setFloat(names[2], m_constantFalloff);
+	shader.setFloat(names[3], m_linearFalloff);
+	shader.setFloat(names[4], m_quadraticFalloff);
 }
 #pragma endregion
 
@@ -112,27 +135,33 @@ SpotLight::SpotLight(const glm::vec3& position, const glm::vec3& direction, cons
 void SpotLight::Translate(const glm::vec3& vector)
 {
 	Light::m_position += vector;
+	m_dirty = true;
 }
 
 void SpotLight::SetDirection(const glm::vec3& direction)
 {
 	Light::m_direction = direction;
+	m_dirty = true;
 }
 
 void SpotLight::SetPosition(const glm::vec3& position)
 {
 	Light::m_position = position;
+	m_dirty = true;
 }
 
 void SpotLight::SetShaderAttrib(const std::string& lightuniform, const Shader& shader)
 {
-	shader.setVec3(lightuniform + ".position", Light::m_position);
-	shader.setVec3(lightuniform + ".direction", Light::m_direction);
-	shader.setVec3(lightuniform + ".color", m_color * m_intensityMultiplier);
-	shader.setFloat(lightuniform + ".kc", m_constantFalloff);
-	shader.setFloat(lightuniform + ".kl", m_linearFalloff);
-	shader.setFloat(lightuniform + ".kq", m_quadraticFalloff);
-	shader.setFloat(lightuniform + ".innercutoff", m_innerCutOff);
-	shader.setFloat(lightuniform + ".outercutoff", m_outerCutOff);
+	static const char* const members[] = { ".position", ".direction", ".color", ".kc", ".kl", ".kq", ".innercutoff", ".outercutoff" };
+	const std::vector<std::string>& names = uniformNames(lightuniform, members, 8);
+
+	shader.setVec3(names[0], Light::m_position);
+	shader.setVec3(names[1], Light::m_direction);
+	shader.setVec3(names[2], m_color * m_intensityMultiplier);
+	shader.setFloat(names[3], m_constantFalloff);
+	shader.setFloat(names[4], m_linearFalloff);
+	shader.setFloat(names[5], m_quadraticFalloff);
+	shader.setFloat(names[6], m_innerCutOff);
+	shader.setFloat(names[7], m_outerCutOff);
 }
 #pragma endregion
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <map>
 #include <tuple>
 #include <string>
+#include <mutex>
 
 
 using namespace xre;
@@ -21,6 +22,8 @@ void LogModule::printLogMessage(const std::string& m1, const std::string& m2, co
 {
 	std::string log_message = m1 + " :: " + m2 + " :: " + m3;
 
+	std::lock_guard<std::mutex> lock(m_log_mutex);
+
 	int count;
 	std::map<std::string, int>::iterator element = m_log_string_count.find(log_message);
 	if (element == m_log_string_count.end())
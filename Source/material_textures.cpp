@@ -0,0 +1,545 @@
+#include <material_textures.h>
+#include <texture_loader.h>
+#include <logger.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+// GL_ARB_bindless_texture, glad only loads the core profile
+typedef GLuint64(APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+static PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = NULL;
+static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeTextureHandleResident = NULL;
+static PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeTextureHandleNonResident = NULL;
+
+static const char* slot_names[XRE_MATERIAL_TEXTURE_SLOTS] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_roughness", "texture_occlusion" };
+// Same colors as the streaming placeholders of the model textures
+static const unsigned char slot_placeholders[XRE_MATERIAL_TEXTURE_SLOTS][4] = { { 128, 128, 128, 255 }, { 0, 0, 0, 255 }, { 128, 128, 255, 255 }, { 255, 255, 255, 255 }, { 255, 255, 255, 255 } };
+
+static void setSamplingParameters(GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAX_ANISOTROPY, 16);
+}
+
+// Format, size, complete levels and GPU memory of a streamed texture, all of its levels resident.
+static void sourceLayout(unsigned int texture_id, GLint& internal_format, GLint& width, GLint& height, int& levels, size_t& bytes)
+{
+	GLint max_level, compressed;
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+
+	int full_levels = 1;
+	while ((std::max(width, height) >> full_levels) > 0)
+	{
+		full_levels++;
+	}
+	levels = std::min(max_level + 1, full_levels);
+
+	bytes = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		GLint level_bytes = std::max(width >> level, 1) * std::max(height >> level, 1) * 4;
+		if (compressed)
+		{
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &level_bytes);
+		}
+		bytes += level_bytes;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void MaterialTextures::create(MATERIAL_TEXTURE_MODE max_mode)
+{
+	m_mode = max_mode;
+
+	if (m_mode == MATERIAL_TEXTURES_BINDLESS && !loadBindlessFunctions())
+	{
+		LOGGER->log(INFO, "MaterialTextures", "GL_ARB_bindless_texture is not supported, falling back to texture arrays.");
+		m_mode = MATERIAL_TEXTURES_ARRAYS;
+	}
+
+	if (m_mode == MATERIAL_TEXTURES_BOUND)
+	{
+		return;
+	}
+
+	glGenBuffers(1, &m_buffer);
+	createPlaceholders();
+
+	LOGGER->log(INFO, "MaterialTextures", m_mode == MATERIAL_TEXTURES_BINDLESS ? "Using bindless material textures." : "Using material texture arrays.");
+}
+
+bool MaterialTextures::loadBindlessFunctions()
+{
+	if (!glfwExtensionSupported("GL_ARB_bindless_texture"))
+	{
+		return false;
+	}
+
+	getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)glfwGetProcAddress("glGetTextureHandleARB");
+	makeTextureHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleResidentARB");
+	makeTextureHandleNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleNonResidentARB");
+
+	return getTextureHandle != NULL && makeTextureHandleResident != NULL && makeTextureHandleNonResident != NULL;
+}
+
+std::string MaterialTextures::shaderDefines() const
+{
+	switch (m_mode)
+	{
+	case MATERIAL_TEXTURES_BINDLESS:
+		// the extension directive has to come before the declarations of the shader preamble
+		return "#define XRE_MATERIAL_TEXTURES_BINDLESS\n#extension GL_ARB_bindless_texture : require\n";
+	case MATERIAL_TEXTURES_ARRAYS:
+		return "#define XRE_MATERIAL_TEXTURES_ARRAYS\n";
+	default:
+		return "";
+	}
+}
+
+void MaterialTextures::createPlaceholders()
+{
+	if (m_mode == MATERIAL_TEXTURES_BINDLESS)
+	{
+		glGenTextures(XRE_MATERIAL_TEXTURE_SLOTS, m_placeholders);
+		for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+		{
+			glBindTexture(GL_TEXTURE_2D, m_placeholders[slot]);
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, slot_placeholders[slot]);
+			setSamplingParameters(GL_TEXTURE_2D);
+
+			m_placeholder_handles[slot] = getTextureHandle(m_placeholders[slot]);
+			makeTextureHandleResident(m_placeholder_handles[slot]);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
+
+	TextureArray placeholders;
+	placeholders.internal_format = GL_RGBA8;
+	placeholders.width = placeholders.height = placeholders.levels = 1;
+	placeholders.layers = placeholders.capacity = XRE_MATERIAL_TEXTURE_SLOTS;
+
+	glGenTextures(1, &placeholders.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, placeholders.texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, 1, 1, XRE_MATERIAL_TEXTURE_SLOTS);
+	for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, slot_placeholders[slot]);
+	}
+	setSamplingParameters(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	m_arrays.push_back(placeholders);
+}
+
+unsigned int MaterialTextures::acquire(const std::vector<Texture>& textures)
+{
+	std::vector<unsigned int> slots(XRE_MATERIAL_TEXTURE_SLOTS, 0);
+	for (const Texture& texture : textures)
+	{
+		for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+		{
+			if (texture.type == slot_names[slot])
+			{
+				slots[slot] = texture.id;
+			}
+		}
+	}
+
+	auto material = m_material_ids.find(slots);
+	if (material != m_material_ids.end())
+	{
+		return material->second;
+	}
+
+	for (unsigned int texture_id : slots)
+	{
+		if (texture_id != 0 && m_textures.find(texture_id) == m_textures.end())
+		{
+			MaterialTexture& texture = m_textures[texture_id];
+			texture.last_used_frame = m_frame;
+			queue(texture_id, texture);
+		}
+	}
+
+	unsigned int material_id = (unsigned int)m_materials.size();
+	m_materials.push_back(slots);
+	m_material_ids.emplace(slots, material_id);
+	m_dirty = true;
+
+	return material_id;
+}
+
+bool MaterialTextures::stored(unsigned int texture_id) const
+{
+	auto element = m_textures.find(texture_id);
+	return element != m_textures.end() && element->second.ready;
+}
+
+void MaterialTextures::use(unsigned int material_id)
+{
+	if (!enabled() || material_id >= m_materials.size())
+	{
+		return;
+	}
+
+	for (unsigned int texture_id : m_materials[material_id])
+	{
+		if (texture_id == 0)
+		{
+			continue;
+		}
+
+		// a released copy is made again, failed textures keep the placeholder
+		MaterialTexture& texture = m_textures[texture_id];
+		texture.last_used_frame = m_frame;
+		if (!texture.ready && !texture.bound && !texture.queued && AsyncTextureLoader::loader()->residency(texture_id) != TEXTURE_FAILED)
+		{
+			queue(texture_id, texture);
+		}
+	}
+}
+
+void MaterialTextures::queue(unsigned int texture_id, MaterialTexture& texture)
+{
+	texture.queued = true;
+	m_waiting.push_back(texture_id);
+}
+
+void MaterialTextures::update()
+{
+	if (!enabled())
+	{
+		return;
+	}
+
+	AsyncTextureLoader* texture_loader = AsyncTextureLoader::loader();
+
+	for (auto& element : m_textures)
+	{
+		MaterialTexture& texture = element.second;
+		if (texture.ready && m_frame - texture.last_used_frame > XRE_MATERIAL_KEEP_FRAMES)
+		{
+			release(texture);
+			m_dirty = true;
+		}
+	}
+
+	// Only a few complete sources at a time, each one is copied and unpinned as soon as it is complete.
+	while (!m_waiting.empty() && m_pinned.size() < XRE_MATERIAL_MAX_PINNED_TEXTURES)
+	{
+		texture_loader->pin(m_waiting.front(), true);
+		m_pinned.push_back(m_waiting.front());
+		m_waiting.pop_front();
+	}
+
+	for (unsigned int i = 0; i < m_pinned.size();)
+	{
+		unsigned int texture_id = m_pinned[i];
+		bool failed = texture_loader->residency(texture_id) == TEXTURE_FAILED;
+		if (!failed && !texture_loader->complete(texture_id))
+		{
+			i++;
+			continue;
+		}
+
+		// failed textures keep the placeholder, the ones without room for a copy are bound by their draws
+		MaterialTexture& texture = m_textures[texture_id];
+		texture.queued = false;
+		texture.ready = !failed && makeReady(texture_id, texture);
+		texture.bound = !failed && !texture.ready;
+		texture_loader->pin(texture_id, false);
+
+		m_pinned.erase(m_pinned.begin() + i);
+		m_dirty = true;
+	}
+
+	texture_loader->setReservedBytes(m_copy_bytes);
+	m_frame++;
+
+	if (m_dirty)
+	{
+		upload();
+	}
+}
+
+bool MaterialTextures::makeReady(unsigned int texture_id, MaterialTexture& texture)
+{
+	if (m_mode == MATERIAL_TEXTURES_ARRAYS)
+	{
+		return copyToArray(texture_id, texture);
+	}
+
+	return copyToHandle(texture_id, texture);
+}
+
+void MaterialTextures::release(MaterialTexture& texture)
+{
+	if (m_mode == MATERIAL_TEXTURES_BINDLESS)
+	{
+		makeTextureHandleNonResident(texture.handle);
+		glDeleteTextures(1, &texture.copy);
+		m_copy_bytes -= texture.bytes;
+		texture.handle = 0;
+		texture.copy = 0;
+	}
+	else
+	{
+		// the array keeps its storage, the next texture of its bucket takes the layer
+		m_arrays[texture.array].free_layers.push_back(texture.layer);
+	}
+
+	texture.ready = false;
+}
+
+bool MaterialTextures::copyToHandle(unsigned int texture_id, MaterialTexture& texture)
+{
+	GLint internal_format, width, height;
+	int levels;
+	size_t bytes;
+	sourceLayout(texture_id, internal_format, width, height, levels, bytes);
+
+	unsigned int copy;
+	glGenTextures(1, &copy);
+	glBindTexture(GL_TEXTURE_2D, copy);
+	glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, width, height);
+	setSamplingParameters(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	for (int level = 0; level < levels; level++)
+	{
+		glCopyImageSubData(texture_id, GL_TEXTURE_2D, level, 0, 0, 0, copy, GL_TEXTURE_2D, level, 0, 0, 0,
+			std::max(width >> level, 1), std::max(height >> level, 1), 1);
+	}
+
+	texture.handle = getTextureHandle(copy);
+	if (texture.handle == 0)
+	{
+		LOGGER->log(WARN, "MaterialTextures", "No bindless handle for texture " + std::to_string(texture_id) + ", its draws bind it.");
+		glDeleteTextures(1, &copy);
+		return false;
+	}
+
+	makeTextureHandleResident(texture.handle);
+	texture.copy = copy;
+	texture.bytes = bytes;
+	m_copy_bytes += bytes;
+	return true;
+}
+
+bool MaterialTextures::copyToArray(unsigned int texture_id, MaterialTexture& texture)
+{
+	GLint internal_format, width, height;
+	int levels;
+	size_t bytes;
+	sourceLayout(texture_id, internal_format, width, height, levels, bytes);
+
+	// the placeholder array is never a bucket
+	unsigned int array_index = 1;
+	while (array_index < m_arrays.size())
+	{
+		const TextureArray& array = m_arrays[array_index];
+		if (array.internal_format == (GLenum)internal_format && array.width == width && array.height == height && array.levels == levels)
+		{
+			break;
+		}
+		array_index++;
+	}
+
+	if (array_index == m_arrays.size())
+	{
+		if (m_arrays.size() == XRE_MATERIAL_MAX_TEXTURE_ARRAYS)
+		{
+			LOGGER->log(WARN, "MaterialTextures", "Out of texture arrays, the draws of texture " + std::to_string(texture_id) + " bind it.");
+			return false;
+		}
+
+		TextureArray array;
+		array.internal_format = internal_format;
+		array.width = width;
+		array.height = height;
+		array.levels = levels;
+		array.capacity = XRE_MATERIAL_ARRAY_INITIAL_LAYERS;
+		array.layer_bytes = bytes;
+		m_copy_bytes += array.layer_bytes * array.capacity;
+
+		glGenTextures(1, &array.texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internal_format, width, height, array.capacity);
+		setSamplingParameters(GL_TEXTURE_2D_ARRAY);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		m_arrays.push_back(array);
+	}
+
+	TextureArray& array = m_arrays[array_index];
+	if (array.free_layers.empty() && array.layers == array.capacity)
+	{
+		growArray(array);
+		if (array.layers == array.capacity)
+		{
+			LOGGER->log(WARN, "MaterialTextures", "Texture array is full, the draws of texture " + std::to_string(texture_id) + " bind it.");
+			return false;
+		}
+	}
+
+	unsigned int layer;
+	if (!array.free_layers.empty())
+	{
+		layer = array.free_layers.back();
+		array.free_layers.pop_back();
+	}
+	else
+	{
+		layer = array.layers++;
+	}
+
+	for (int level = 0; level < levels; level++)
+	{
+		glCopyImageSubData(texture_id, GL_TEXTURE_2D, level, 0, 0, 0, array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+			std::max(width >> level, 1), std::max(height >> level, 1), 1);
+	}
+
+	texture.array = array_index;
+	texture.layer = layer;
+	return true;
+}
+
+void MaterialTextures::growArray(TextureArray& array)
+{
+	GLint max_layers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	unsigned int capacity = std::min(array.capacity * 2, (unsigned int)max_layers);
+	if (capacity <= array.capacity)
+	{
+		return;
+	}
+
+	unsigned int grown;
+	glGenTextures(1, &grown);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, grown);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internal_format, array.width, array.height, capacity);
+	setSamplingParameters(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	for (int level = 0; level < array.levels; level++)
+	{
+		glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, grown, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+			std::max(array.width >> level, 1), std::max(array.height >> level, 1), array.layers);
+	}
+
+	glDeleteTextures(1, &array.texture);
+	array.texture = grown;
+	m_copy_bytes += array.layer_bytes * (capacity - array.capacity);
+	array.capacity = capacity;
+}
+
+glm::uvec2 MaterialTextures::entry(unsigned int texture_id, unsigned int slot) const
+{
+	auto element = m_textures.find(texture_id);
+	bool ready = texture_id != 0 && element != m_textures.end() && element->second.ready;
+
+	if (texture_id != 0 && element != m_textures.end() && element->second.bound)
+	{
+		return glm::uvec2(XRE_MATERIAL_BOUND_ENTRY);
+	}
+
+	if (m_mode == MATERIAL_TEXTURES_BINDLESS)
+	{
+		GLuint64 handle = ready ? element->second.handle : m_placeholder_handles[slot];
+		return glm::uvec2((unsigned int)(handle & 0xFFFFFFFF), (unsigned int)(handle >> 32));
+	}
+
+	return ready ? glm::uvec2(element->second.array, element->second.layer) : glm::uvec2(0, slot);
+}
+
+void MaterialTextures::upload()
+{
+	m_dirty = false;
+	if (m_materials.empty())
+	{
+		return;
+	}
+
+	m_entries.resize(m_materials.size() * XRE_MATERIAL_TEXTURE_SLOTS);
+	m_bound_materials.assign(m_materials.size(), false);
+	for (unsigned int material = 0; material < m_materials.size(); material++)
+	{
+		for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+		{
+			glm::uvec2 material_entry = entry(m_materials[material][slot], slot);
+			m_entries[material * XRE_MATERIAL_TEXTURE_SLOTS + slot] = material_entry;
+			if (material_entry.x == XRE_MATERIAL_BOUND_ENTRY)
+			{
+				m_bound_materials[material] = true;
+			}
+		}
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_entries.size() * sizeof(glm::uvec2), m_entries.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MaterialTextures::bind(const Shader& shader) const
+{
+	if (!enabled())
+	{
+		return;
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, XRE_SSBO_BINDING_MATERIAL_TEXTURES, m_buffer);
+
+	for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+	{
+		shader.setInt(shader.uniform("material_bound", slot), XRE_MATERIAL_BOUND_TEXTURE_UNIT + slot);
+	}
+
+	if (m_mode == MATERIAL_TEXTURES_ARRAYS)
+	{
+		for (unsigned int i = 0; i < m_arrays.size(); i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, m_arrays[i].texture);
+			shader.setInt("material_arrays[" + std::to_string(i) + "]", i);
+		}
+	}
+}
+
+bool MaterialTextures::bound(unsigned int material_id) const
+{
+	return material_id < m_bound_materials.size() && m_bound_materials[material_id];
+}
+
+void MaterialTextures::bindMaterial(unsigned int material_id) const
+{
+	for (unsigned int slot = 0; slot < XRE_MATERIAL_TEXTURE_SLOTS; slot++)
+	{
+		unsigned int texture_id = m_materials[material_id][slot];
+		auto element = m_textures.find(texture_id);
+		if (texture_id != 0 && element != m_textures.end() && element->second.bound)
+		{
+			glActiveTexture(GL_TEXTURE0 + XRE_MATERIAL_BOUND_TEXTURE_UNIT + slot);
+			glBindTexture(GL_TEXTURE_2D, texture_id);
+		}
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <shader.h>
 #include <logger.h>
@@ -9,6 +10,7 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 static auto LOGGER = xre::LogModule::getLoggerInstance();
 
@@ -17,14 +19,47 @@ using namespace xre;
 std::vector<std::string> Mesh::texture_types{ "texture_diffuse", "texture_specular", "texture_normal", "shadow_depth_map_directional", "shadow_depth_map_cubemap" };
 
 Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures, BoundingVolume aabb)
+	: Mesh(vertices.data(), (unsigned int)vertices.size(), indices.data(), (unsigned int)indices.size(), textures, aabb)
+{
+}
+
+Mesh::Mesh(const Vertex* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count, const std::vector<Texture>& textures, BoundingVolume aabb,
+	const MeshLod* lods, unsigned int lod_count, const Meshlet* meshlets, unsigned int meshlet_count,
+	const Submesh* submeshes, unsigned int submesh_count)
+{
+	std::vector<CompactVertex> compact_vertices;
+	std::vector<glm::u16vec4> positions;
+	if (vertices != NULL)
+	{
+		compress(vertices, vertex_count, aabb, compact_vertices, positions);
+	}
+
+	create(compact_vertices.data(), positions.data(), vertex_count, indices, index_count, textures, aabb, lods, lod_count, meshlets, meshlet_count, submeshes, submesh_count);
+}
+
+Mesh::Mesh(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+	const std::vector<Texture>& textures, const BoundingVolume& aabb, const MeshLod* lods, unsigned int lod_count,
+	const Meshlet* meshlets, unsigned int meshlet_count, const Submesh* submeshes, unsigned int submesh_count)
+{
+	create(vertices, positions, vertex_count, indices, index_count, textures, aabb, lods, lod_count, meshlets, meshlet_count, submeshes, submesh_count);
+}
+
+void Mesh::create(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+	const std::vector<Texture>& textures, const BoundingVolume& aabb, const MeshLod* lods, unsigned int lod_count,
+	const Meshlet* meshlets, unsigned int meshlet_count, const Submesh* submeshes, unsigned int submesh_count)
 {
 	setup_success = false;
+	this->vertex_count = 0;
+	this->index_count = 0;
+	this->index_type = GL_UNSIGNED_INT;
+	this->meshlet_count = meshlets != NULL ? meshlet_count : 0;
+	this->meshlet_buffer = 0;
 	try
 	{
-		if (vertices.size() > 0 && indices.size() > 0)
+		if (vertices != NULL && positions != NULL && indices != NULL && vertex_count > 0 && index_count > 0)
 		{
-			this->vertices = vertices;
-			this->indices = indices;
+			this->vertex_count = vertex_count;
+			this->index_count = index_count;
 		}
 		else
 			throw;
@@ -39,9 +74,23 @@ Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>&
 		}
 
 
+		if (lod_count > 0)
+		{
+			this->lods.assign(lods, lods + lod_count);
+		}
+		else
+		{
+			this->lods.push_back({ 0, index_count, 0.0f });
+		}
+
+		if (submeshes != NULL)
+		{
+			this->submeshes.assign(submeshes, submeshes + submesh_count);
+		}
+
 		this->aabb = aabb;
 
-		setupMesh();
+		setupMesh(vertices, positions, indices, meshlets);
 	}
 	catch (...)
 	{
@@ -55,7 +104,7 @@ void Mesh::draw(const Shader& shader, const std::string model_name, const glm::m
 {
 	Renderer::renderer()->pushToDrawQueue
 	(
-		VAO, indices.size(),
+		VAO, depth_VAO, VBO, EBO, index_count, index_type, &lods, meshlet_buffer, meshlet_count, submeshes.empty() ? NULL : &submeshes,
 		shader, model_matrix,
 		&textures, &texture_types,
 		model_name, is_dynamic,
@@ -63,7 +112,117 @@ void Mesh::draw(const Shader& shader, const std::string model_name, const glm::m
 	);
 }
 
-void Mesh::setupMesh()
+void Mesh::release()
+{
+	if (!setup_success)
+	{
+		return;
+	}
+
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteVertexArrays(1, &depth_VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &depth_VBO);
+	glDeleteBuffers(1, &EBO);
+	if (meshlet_buffer != 0)
+	{
+		glDeleteBuffers(1, &meshlet_buffer);
+	}
+
+	setup_success = false;
+}
+
+void Mesh::setPositionDecode(const Shader& shader, const BoundingVolume& aabb)
+{
+	shader.setVec3("position_min", aabb.min_v);
+	shader.setVec3("position_extent", aabb.max_v - aabb.min_v);
+}
+
+// Octahedral encoding, same as the G-buffer normals
+static glm::i16vec2 encodeOctahedral(glm::vec3 n)
+{
+	n /= glm::max(glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z), 1e-20f);
+
+	glm::vec2 e = glm::vec2(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+		e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * sign;
+	}
+
+	return glm::i16vec2((short)glm::packSnorm1x16(e.x), (short)glm::packSnorm1x16(e.y));
+}
+
+static glm::vec3 decodeOctahedral(glm::i16vec2 encoded)
+{
+	glm::vec2 e = glm::vec2(glm::unpackSnorm1x16((unsigned short)encoded.x), glm::unpackSnorm1x16((unsigned short)encoded.y));
+	glm::vec3 n = glm::vec3(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+	if (n.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+		glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+		n.x = folded.x;
+		n.y = folded.y;
+	}
+
+	float length = glm::length(n);
+	return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+CompactVertex Mesh::compress(const Vertex& vertex, const BoundingVolume& aabb)
+{
+	CompactVertex compact;
+
+	glm::vec3 extent = aabb.max_v - aabb.min_v;
+	glm::vec3 position = glm::vec3(
+		extent.x > 0.0f ? (vertex.position.x - aabb.min_v.x) / extent.x : 0.0f,
+		extent.y > 0.0f ? (vertex.position.y - aabb.min_v.y) / extent.y : 0.0f,
+		extent.z > 0.0f ? (vertex.position.z - aabb.min_v.z) / extent.z : 0.0f);
+
+	// Mirrored uvs flip the bitangent against cross(normal, tangent)
+	bool flipped = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bit_tangent) < 0.0f;
+
+	compact.position = glm::u16vec4(glm::packUnorm1x16(position.x), glm::packUnorm1x16(position.y), glm::packUnorm1x16(position.z), flipped ? 0 : 65535);
+	compact.normal = encodeOctahedral(vertex.normal);
+	compact.tex_coords = glm::u16vec2(glm::packHalf1x16(vertex.tex_coords.x), glm::packHalf1x16(vertex.tex_coords.y));
+	compact.tangent = encodeOctahedral(vertex.tangent);
+
+	return compact;
+}
+
+void Mesh::compress(const Vertex* vertices, unsigned int vertex_count, BoundingVolume& aabb, std::vector<CompactVertex>& compact_vertices, std::vector<glm::u16vec4>& positions)
+{
+	// Positions are quantized to the bounds, so they must enclose every vertex.
+	for (unsigned int i = 0; i < vertex_count; i++)
+	{
+		aabb.min_v = glm::min(aabb.min_v, vertices[i].position);
+		aabb.max_v = glm::max(aabb.max_v, vertices[i].position);
+	}
+
+	compact_vertices.resize(vertex_count);
+	positions.resize(vertex_count);
+	for (unsigned int i = 0; i < vertex_count; i++)
+	{
+		compact_vertices[i] = compress(vertices[i], aabb);
+		positions[i] = compact_vertices[i].position;
+	}
+}
+
+Vertex Mesh::decompress(const CompactVertex& vertex, const BoundingVolume& aabb)
+{
+	Vertex decompressed;
+
+	glm::vec3 position = glm::vec3(glm::unpackUnorm1x16(vertex.position.x), glm::unpackUnorm1x16(vertex.position.y), glm::unpackUnorm1x16(vertex.position.z));
+	decompressed.position = aabb.min_v + position * (aabb.max_v - aabb.min_v);
+	decompressed.normal = decodeOctahedral(vertex.normal);
+	decompressed.tex_coords = glm::vec2(glm::unpackHalf1x16(vertex.tex_coords.x), glm::unpackHalf1x16(vertex.tex_coords.y));
+	decompressed.tangent = decodeOctahedral(vertex.tangent);
+	decompressed.bit_tangent = glm::cross(decompressed.normal, decompressed.tangent) * (vertex.position.w == 0 ? -1.0f : 1.0f);
+
+	return decompressed;
+}
+
+void Mesh::setupMesh(const CompactVertex* vertices, const glm::u16vec4* positions, const unsigned int* indices, const Meshlet* meshlets)
 {
 	try
 	{
@@ -73,29 +232,62 @@ void Mesh::setupMesh()
 
 		glBindVertexArray(VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(CompactVertex), vertices, GL_STATIC_DRAW);
+
+		// Static batch indices are local to their submesh, so the largest index decides rather than the vertex count
+		unsigned int max_index = *std::max_element(indices, indices + index_count);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		if (max_index < 65536)
+		{
+			// Padded to whole 32 bit words, the visibility resolve reads the buffer as uints.
+			std::vector<unsigned short> short_indices((index_count + 1) & ~1u, 0);
+			std::copy(indices, indices + index_count, short_indices.begin());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(unsigned short), short_indices.data(), GL_STATIC_DRAW);
+			index_type = GL_UNSIGNED_SHORT;
+		}
+		else
+		{
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+			index_type = GL_UNSIGNED_INT;
+		}
 
-		// vertex Positions
+		// vertex Positions + bitangent sign
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)0);
 		// vertex normals
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
 		// vertex texture coords
 		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tex_coords));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, tex_coords));
 		// vertex tangent
 		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bit_tangent));
+		glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, tangent));
+
+		// Depth only passes fetch 8 bytes per vertex instead of the full vertex
+		glGenVertexArrays(1, &depth_VAO);
+		glGenBuffers(1, &depth_VBO);
+
+		glBindVertexArray(depth_VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, depth_VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(glm::u16vec4), positions, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+		// vertex Positions, same encoding as the full layout so that both transform identically
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(glm::u16vec4), (void*)0);
 
 		glBindVertexArray(0);
 
+		if (meshlet_count > 0)
+		{
+			glGenBuffers(1, &meshlet_buffer);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshlet_buffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, meshlet_count * sizeof(Meshlet), meshlets, GL_STATIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+
 		setup_success = true;
 	}
 	catch (...)
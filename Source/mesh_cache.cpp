@@ -0,0 +1,466 @@
+#include <mesh_cache.h>
+#include <logger.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+// File layout
+// ---------------------------------------------------------------------
+// CacheHeader
+// CacheMeshRecord[mesh_count]
+// string blob (texture paths, not null terminated)
+// vertex / position / index / lod / meshlet blobs, each aligned to XRE_MESH_CACHE_ALIGNMENT
+// ---------------------------------------------------------------------
+
+#define XRE_MESH_CACHE_MAGIC 0x434D5258 // "XRMC"
+#define XRE_MESH_CACHE_ALIGNMENT 16
+
+struct CacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_hash;
+	uint32_t post_process_flags;
+	uint32_t vertex_size;
+	uint32_t mesh_count;
+	uint32_t reserved;
+};
+
+struct CacheMeshRecord
+{
+	uint64_t vertex_offset;
+	uint64_t position_offset;
+	uint64_t index_offset;
+	uint64_t lod_offset;
+	uint64_t meshlet_offset;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t lod_count;
+	uint32_t meshlet_count;
+	float aabb_min[3];
+	float aabb_max[3];
+	uint32_t texture_path_offsets[XRE_MESH_CACHE_TEXTURE_SLOTS];
+	uint32_t texture_path_lengths[XRE_MESH_CACHE_TEXTURE_SLOTS];
+};
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + XRE_MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(XRE_MESH_CACHE_ALIGNMENT - 1);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& file_path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		close();
+		return false;
+	}
+	m_mapping = mapping;
+
+	m_data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == NULL)
+	{
+		close();
+		return false;
+	}
+	m_size = (size_t)file_size.QuadPart;
+#else
+	m_file = ::open(file_path.c_str(), O_RDONLY);
+	if (m_file < 0)
+	{
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(m_file, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	m_data = (const unsigned char*)data;
+	m_size = (size_t)file_stat.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data != NULL)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != NULL)
+	{
+		CloseHandle(m_file);
+	}
+	m_mapping = NULL;
+	m_file = NULL;
+#else
+	if (m_data != NULL)
+	{
+		munmap((void*)m_data, m_size);
+	}
+	if (m_file >= 0)
+	{
+		::close(m_file);
+	}
+	m_file = -1;
+#endif
+
+	m_data = NULL;
+	m_size = 0;
+}
+
+std::string MeshCache::cachePath(const std::string& source_path)
+{
+	return source_path + XRE_MESH_CACHE_EXTENSION;
+}
+
+// FNV-1a, continued from hash
+static uint64_t HashBytes(uint64_t hash, const unsigned char* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+uint64_t MeshCache::hashFile(const std::string& file_path)
+{
+	MappedFile file;
+	if (!file.open(file_path))
+	{
+		return 0;
+	}
+
+	return HashBytes(14695981039346656037ULL, file.data(), file.size());
+}
+
+uint64_t MeshCache::hashSource(const std::string& file_path)
+{
+	MappedFile file;
+	if (!file.open(file_path))
+	{
+		return 0;
+	}
+
+	uint64_t hash = HashBytes(14695981039346656037ULL, file.data(), file.size());
+
+	// The texture paths come from the OBJ material libraries, a changed library must rebuild the cache too.
+	std::string directory = file_path.substr(0, file_path.find_last_of('/') + 1);
+	const char* data = (const char*)file.data();
+	size_t line_start = 0;
+	while (line_start < file.size())
+	{
+		const char* line_end = (const char*)std::memchr(data + line_start, '\n', file.size() - line_start);
+		size_t line_length = line_end != NULL ? line_end - (data + line_start) : file.size() - line_start;
+
+		if (line_length > 7 && std::strncmp(data + line_start, "mtllib ", 7) == 0)
+		{
+			std::istringstream libraries(std::string(data + line_start + 7, line_length - 7));
+			std::string library;
+			while (libraries >> library)
+			{
+				// a missing library hashes as 0
+				uint64_t library_hash = hashFile(directory + library);
+				hash = HashBytes(hash, (const unsigned char*)&library_hash, sizeof(library_hash));
+			}
+		}
+
+		line_start += line_length + 1;
+	}
+
+	return hash;
+}
+
+bool MeshCache::write(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_flags, const std::vector<MeshData>& meshes)
+{
+	CacheHeader header;
+	header.magic = XRE_MESH_CACHE_MAGIC;
+	header.version = XRE_MESH_CACHE_VERSION;
+	header.source_hash = source_hash;
+	header.post_process_flags = post_process_flags;
+	header.vertex_size = sizeof(CompactVertex);
+	header.mesh_count = (uint32_t)meshes.size();
+	header.reserved = 0;
+
+	std::vector<CacheMeshRecord> records(meshes.size());
+	std::string strings;
+
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		for (unsigned int t = 0; t < XRE_MESH_CACHE_TEXTURE_SLOTS; t++)
+		{
+			records[i].texture_path_offsets[t] = (uint32_t)strings.size();
+			records[i].texture_path_lengths[t] = (uint32_t)meshes[i].texture_paths[t].size();
+			strings += meshes[i].texture_paths[t];
+		}
+	}
+
+	uint64_t offset = sizeof(CacheHeader) + records.size() * sizeof(CacheMeshRecord) + strings.size();
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		const MeshData& mesh = meshes[i];
+
+		records[i].vertex_count = (uint32_t)mesh.vertices.size();
+		records[i].index_count = (uint32_t)mesh.indices.size();
+		records[i].lod_count = (uint32_t)mesh.lods.size();
+		records[i].meshlet_count = (uint32_t)mesh.meshlets.size();
+
+		offset = AlignOffset(offset);
+		records[i].vertex_offset = offset;
+		offset += mesh.vertices.size() * sizeof(CompactVertex);
+
+		offset = AlignOffset(offset);
+		records[i].position_offset = offset;
+		offset += mesh.positions.size() * sizeof(glm::u16vec4);
+
+		offset = AlignOffset(offset);
+		records[i].index_offset = offset;
+		offset += mesh.indices.size() * sizeof(unsigned int);
+
+		offset = AlignOffset(offset);
+		records[i].lod_offset = offset;
+		offset += mesh.lods.size() * sizeof(MeshLod);
+
+		offset = AlignOffset(offset);
+		records[i].meshlet_offset = offset;
+		offset += mesh.meshlets.size() * sizeof(Meshlet);
+
+		records[i].aabb_min[0] = mesh.aabb.min_v.x;
+		records[i].aabb_min[1] = mesh.aabb.min_v.y;
+		records[i].aabb_min[2] = mesh.aabb.min_v.z;
+		records[i].aabb_max[0] = mesh.aabb.max_v.x;
+		records[i].aabb_max[1] = mesh.aabb.max_v.y;
+		records[i].aabb_max[2] = mesh.aabb.max_v.z;
+	}
+
+	// Written to a temporary file first so a crash never leaves a half written cache behind.
+	std::string temp_path = cache_path + ".tmp";
+	FILE* file = std::fopen(temp_path.c_str(), "wb");
+	if (file == NULL)
+	{
+		LOGGER->log(ERROR, "MeshCache : write", "Failed to open " + temp_path);
+		return false;
+	}
+
+	static const unsigned char padding[XRE_MESH_CACHE_ALIGNMENT] = { 0 };
+	uint64_t written = 0;
+	bool success = true;
+
+	auto Write = [&](const void* data, size_t size)
+	{
+		if (success && size > 0)
+		{
+			success = std::fwrite(data, 1, size, file) == size;
+			written += size;
+		}
+	};
+
+	Write(&header, sizeof(CacheHeader));
+	Write(records.data(), records.size() * sizeof(CacheMeshRecord));
+	Write(strings.data(), strings.size());
+
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		Write(padding, (size_t)(records[i].vertex_offset - written));
+		Write(meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(CompactVertex));
+
+		Write(padding, (size_t)(records[i].position_offset - written));
+		Write(meshes[i].positions.data(), meshes[i].positions.size() * sizeof(glm::u16vec4));
+
+		Write(padding, (size_t)(records[i].index_offset - written));
+		Write(meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+
+		Write(padding, (size_t)(records[i].lod_offset - written));
+		Write(meshes[i].lods.data(), meshes[i].lods.size() * sizeof(MeshLod));
+
+		Write(padding, (size_t)(records[i].meshlet_offset - written));
+		Write(meshes[i].meshlets.data(), meshes[i].meshlets.size() * sizeof(Meshlet));
+	}
+
+	success = (std::fclose(file) == 0) && success;
+
+	if (success)
+	{
+		std::remove(cache_path.c_str());
+		success = std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+	}
+
+	if (!success)
+	{
+		std::remove(temp_path.c_str());
+		LOGGER->log(ERROR, "MeshCache : write", "Failed to write " + cache_path);
+	}
+
+	return success;
+}
+
+bool MeshCache::open(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_flags)
+{
+	m_meshes.clear();
+
+	if (!m_file.open(cache_path))
+	{
+		return false;
+	}
+
+	const unsigned char* data = m_file.data();
+	size_t size = m_file.size();
+
+	if (size < sizeof(CacheHeader))
+	{
+		m_file.close();
+		return false;
+	}
+
+	CacheHeader header;
+	std::memcpy(&header, data, sizeof(CacheHeader));
+
+	if (header.magic != XRE_MESH_CACHE_MAGIC || header.version != XRE_MESH_CACHE_VERSION || header.vertex_size != sizeof(CompactVertex))
+	{
+		LOGGER->log(INFO, "MeshCache : open", "Cache format changed, rebuilding " + cache_path);
+		m_file.close();
+		return false;
+	}
+
+	if (header.source_hash != source_hash || header.post_process_flags != post_process_flags)
+	{
+		LOGGER->log(INFO, "MeshCache : open", "Cache is stale, rebuilding " + cache_path);
+		m_file.close();
+		return false;
+	}
+
+	uint64_t strings_offset = sizeof(CacheHeader) + (uint64_t)header.mesh_count * sizeof(CacheMeshRecord);
+	if (strings_offset > size)
+	{
+		LOGGER->log(ERROR, "MeshCache : open", "Corrupt cache " + cache_path);
+		m_file.close();
+		return false;
+	}
+
+	m_meshes.resize(header.mesh_count);
+
+	for (unsigned int i = 0; i < header.mesh_count; i++)
+	{
+		CacheMeshRecord record;
+		std::memcpy(&record, data + sizeof(CacheHeader) + i * sizeof(CacheMeshRecord), sizeof(CacheMeshRecord));
+
+		uint64_t vertex_end = record.vertex_offset + (uint64_t)record.vertex_count * sizeof(CompactVertex);
+		uint64_t position_end = record.position_offset + (uint64_t)record.vertex_count * sizeof(glm::u16vec4);
+		uint64_t index_end = record.index_offset + (uint64_t)record.index_count * sizeof(unsigned int);
+		uint64_t lod_end = record.lod_offset + (uint64_t)record.lod_count * sizeof(MeshLod);
+		uint64_t meshlet_end = record.meshlet_offset + (uint64_t)record.meshlet_count * sizeof(Meshlet);
+
+		bool valid = vertex_end <= size && position_end <= size && index_end <= size && lod_end <= size && meshlet_end <= size
+			&& record.vertex_offset % XRE_MESH_CACHE_ALIGNMENT == 0
+			&& record.position_offset % XRE_MESH_CACHE_ALIGNMENT == 0
+			&& record.index_offset % XRE_MESH_CACHE_ALIGNMENT == 0
+			&& record.lod_offset % XRE_MESH_CACHE_ALIGNMENT == 0
+			&& record.meshlet_offset % XRE_MESH_CACHE_ALIGNMENT == 0;
+
+		const MeshLod* lods = (const MeshLod*)(data + record.lod_offset);
+		for (unsigned int l = 0; l < record.lod_count && valid; l++)
+		{
+			valid = (uint64_t)lods[l].index_offset + lods[l].index_count <= record.index_count;
+		}
+
+		const Meshlet* meshlets = (const Meshlet*)(data + record.meshlet_offset);
+		for (unsigned int m = 0; m < record.meshlet_count && valid; m++)
+		{
+			valid = (uint64_t)meshlets[m].index_offset + (uint64_t)meshlets[m].triangle_count * 3 <= record.index_count;
+		}
+
+		for (unsigned int t = 0; t < XRE_MESH_CACHE_TEXTURE_SLOTS && valid; t++)
+		{
+			valid = strings_offset + record.texture_path_offsets[t] + record.texture_path_lengths[t] <= size;
+		}
+
+		if (!valid)
+		{
+			LOGGER->log(ERROR, "MeshCache : open", "Corrupt cache " + cache_path);
+			m_meshes.clear();
+			m_file.close();
+			return false;
+		}
+
+		CachedMesh& mesh = m_meshes[i];
+		mesh.vertices = (const CompactVertex*)(data + record.vertex_offset);
+		mesh.positions = (const glm::u16vec4*)(data + record.position_offset);
+		mesh.vertex_count = record.vertex_count;
+		mesh.indices = (const unsigned int*)(data + record.index_offset);
+		mesh.index_count = record.index_count;
+		mesh.lods = (const MeshLod*)(data + record.lod_offset);
+		mesh.lod_count = record.lod_count;
+		mesh.meshlets = meshlets;
+		mesh.meshlet_count = record.meshlet_count;
+
+		mesh.aabb.min_v = glm::vec3(record.aabb_min[0], record.aabb_min[1], record.aabb_min[2]);
+		mesh.aabb.max_v = glm::vec3(record.aabb_max[0], record.aabb_max[1], record.aabb_max[2]);
+
+		for (unsigned int t = 0; t < XRE_MESH_CACHE_TEXTURE_SLOTS; t++)
+		{
+			mesh.texture_paths[t].assign((const char*)(data + strings_offset + record.texture_path_offsets[t]), record.texture_path_lengths[t]);
+		}
+	}
+
+	return true;
+}
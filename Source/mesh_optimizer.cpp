@@ -0,0 +1,835 @@
+#include <mesh_optimizer.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+using namespace xre;
+
+// Forsyth's scoring constants
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cache_position, unsigned int remaining_triangles)
+{
+	if (remaining_triangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cache_position >= 0)
+	{
+		// The last triangle's vertices get a fixed score, so the next triangle does not just reuse its edge.
+		if (cache_position < 3)
+		{
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scaler = 1.0f / (XRE_MESH_OPTIMIZER_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cache_position - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// Vertices with few triangles left are finished first, so they can leave the cache.
+	return score + VALENCE_BOOST_SCALE * std::pow((float)remaining_triangles, -VALENCE_BOOST_POWER);
+}
+
+void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	if (vertices.empty() || indices.size() < 3 || indices.size() % 3 != 0)
+	{
+		return;
+	}
+
+	unsigned int vertex_count = (unsigned int)vertices.size();
+	unsigned int index_count = (unsigned int)indices.size();
+
+	optimizeVertexCache(indices.data(), index_count, vertex_count);
+	optimizeOverdraw(indices.data(), index_count, vertices.data(), vertex_count, XRE_MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+	optimizeVertexFetch(vertices.data(), vertex_count, indices.data(), index_count);
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, unsigned int index_count, unsigned int vertex_count)
+{
+	unsigned int triangle_count = index_count / 3;
+	if (triangle_count == 0)
+	{
+		return;
+	}
+
+	// Vertex to triangle adjacency, the first remaining[v] entries of each list are the triangles not emitted yet.
+	std::vector<unsigned int> remaining(vertex_count, 0);
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		remaining[indices[i]]++;
+	}
+
+	std::vector<unsigned int> offsets(vertex_count + 1, 0);
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+
+	std::vector<unsigned int> adjacency(index_count);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cache_positions(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		vertex_scores[v] = vertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangle_scores(triangle_count);
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned char> emitted(triangle_count, 0);
+	std::vector<unsigned int> output(index_count);
+
+	unsigned int cache[XRE_MESH_OPTIMIZER_CACHE_SIZE + 3];
+	unsigned int new_cache[XRE_MESH_OPTIMIZER_CACHE_SIZE + 3];
+	unsigned int cache_count = 0;
+	unsigned int cursor = 0; // every triangle before it has been emitted
+	int best_triangle = -1;
+
+	for (unsigned int out = 0; out < triangle_count; out++)
+	{
+		// Nothing left around the cache, continue with the first triangle not emitted yet.
+		if (best_triangle < 0)
+		{
+			while (emitted[cursor])
+			{
+				cursor++;
+			}
+			best_triangle = (int)cursor;
+		}
+
+		unsigned int triangle = (unsigned int)best_triangle;
+		const unsigned int* triangle_indices = indices + triangle * 3;
+
+		emitted[triangle] = 1;
+		std::memcpy(output.data() + out * 3, triangle_indices, 3 * sizeof(unsigned int));
+
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle_indices[k];
+			unsigned int* triangles = adjacency.data() + offsets[v];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if (triangles[j] == triangle)
+				{
+					std::swap(triangles[j], triangles[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// The triangle's vertices move to the front, the rest shifts back and may fall out.
+		unsigned int new_count = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle_indices[k];
+			if (std::find(new_cache, new_cache + new_count, v) == new_cache + new_count)
+			{
+				new_cache[new_count++] = v;
+			}
+		}
+		for (unsigned int i = 0; i < cache_count; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != triangle_indices[0] && v != triangle_indices[1] && v != triangle_indices[2])
+			{
+				new_cache[new_count++] = v;
+			}
+		}
+
+		// Rescore the cached and the evicted vertices, and the triangles around them.
+		for (unsigned int i = 0; i < new_count; i++)
+		{
+			unsigned int v = new_cache[i];
+			cache_positions[v] = i < XRE_MESH_OPTIMIZER_CACHE_SIZE ? (int)i : -1;
+
+			float score = vertexScore(cache_positions[v], remaining[v]);
+			float delta = score - vertex_scores[v];
+			vertex_scores[v] = score;
+
+			const unsigned int* triangles = adjacency.data() + offsets[v];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				triangle_scores[triangles[j]] += delta;
+			}
+		}
+
+		cache_count = std::min(new_count, (unsigned int)XRE_MESH_OPTIMIZER_CACHE_SIZE);
+		std::memcpy(cache, new_cache, cache_count * sizeof(unsigned int));
+
+		best_triangle = -1;
+		float best_score = -1.0f;
+		for (unsigned int i = 0; i < cache_count; i++)
+		{
+			unsigned int v = cache[i];
+			const unsigned int* triangles = adjacency.data() + offsets[v];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if (triangle_scores[triangles[j]] > best_score)
+				{
+					best_score = triangle_scores[triangles[j]];
+					best_triangle = (int)triangles[j];
+				}
+			}
+		}
+	}
+
+	std::memcpy(indices, output.data(), index_count * sizeof(unsigned int));
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned int* indices, unsigned int index_count, const Vertex* vertices, unsigned int vertex_count, float threshold)
+{
+	unsigned int triangle_count = index_count / 3;
+	if (triangle_count == 0)
+	{
+		return;
+	}
+
+	const unsigned int fifo_size = XRE_MESH_OPTIMIZER_FIFO_SIZE;
+	float mesh_acmr = averageCacheMissRatio(indices, index_count, vertex_count, fifo_size);
+
+	// A vertex is cached when it was transformed less than fifo_size misses ago.
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	unsigned int time = fifo_size + 1;
+	auto triangleMisses = [&](unsigned int triangle)
+	{
+		unsigned int misses = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[triangle * 3 + k];
+			if (time - timestamps[v] > fifo_size)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	};
+
+	// Hard boundaries : the cache optimizer jumped somewhere new, all three vertices miss.
+	std::vector<unsigned int> hard_clusters;
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (triangleMisses(t) == 3)
+		{
+			hard_clusters.push_back(t);
+		}
+	}
+	if (hard_clusters.empty() || hard_clusters[0] != 0)
+	{
+		hard_clusters.insert(hard_clusters.begin(), 0);
+	}
+
+	// Soft boundaries : cut a cluster as soon as its own miss ratio is close enough to the whole mesh.
+	std::vector<unsigned int> clusters;
+	for (unsigned int c = 0; c < hard_clusters.size(); c++)
+	{
+		unsigned int end = c + 1 < hard_clusters.size() ? hard_clusters[c + 1] : triangle_count;
+		unsigned int cluster_start = hard_clusters[c];
+		unsigned int misses = 0;
+
+		clusters.push_back(cluster_start);
+		time += fifo_size + 1; // empty cache
+
+		for (unsigned int t = cluster_start; t < end; t++)
+		{
+			misses += triangleMisses(t);
+
+			if (t + 1 < end && (float)misses / (t - cluster_start + 1) <= mesh_acmr * threshold)
+			{
+				cluster_start = t + 1;
+				misses = 0;
+				clusters.push_back(cluster_start);
+				time += fifo_size + 1;
+			}
+		}
+	}
+
+	glm::vec3 mesh_centroid = glm::vec3(0.0f);
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		mesh_centroid += vertices[v].position;
+	}
+	mesh_centroid /= (float)vertex_count;
+
+	// Clusters facing away from the center occlude the rest of the mesh from most directions, draw them first.
+	std::vector<std::pair<float, unsigned int>> order(clusters.size());
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+		glm::vec3 normal = glm::vec3(0.0f);
+		glm::vec3 centroid = glm::vec3(0.0f);
+		float area = 0.0f;
+
+		for (unsigned int t = clusters[c]; t < end; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+
+			glm::vec3 triangle_normal = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(triangle_normal);
+
+			normal += triangle_normal;
+			centroid += (p0 + p1 + p2) * (triangle_area / 3.0f);
+			area += triangle_area;
+		}
+
+		float normal_length = glm::length(normal);
+		float sort_key = 0.0f;
+		if (area > 0.0f && normal_length > 0.0f)
+		{
+			sort_key = glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+		}
+
+		order[c] = { sort_key, c };
+	}
+
+	std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	std::vector<unsigned int> output;
+	output.reserve(index_count);
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		unsigned int c = order[i].second;
+		unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+		output.insert(output.end(), indices + clusters[c] * 3, indices + end * 3);
+	}
+
+	std::memcpy(indices, output.data(), index_count * sizeof(unsigned int));
+}
+
+void MeshOptimizer::optimizeVertexFetch(Vertex* vertices, unsigned int vertex_count, unsigned int* indices, unsigned int index_count)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertex_count, unused);
+	unsigned int next = 0;
+
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		unsigned int& new_index = remap[indices[i]];
+		if (new_index == unused)
+		{
+			new_index = next++;
+		}
+		indices[i] = new_index;
+	}
+
+	// Vertices no triangle uses go last.
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		if (remap[v] == unused)
+		{
+			remap[v] = next++;
+		}
+	}
+
+	std::vector<Vertex> reordered(vertex_count);
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		reordered[remap[v]] = vertices[v];
+	}
+
+	std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+// Sum of squared distances to the planes of the surrounding triangles, weighted by their area.
+struct Quadric
+{
+	double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+
+	void addPlane(const glm::dvec3& n, double d, double w)
+	{
+		a00 += w * n.x * n.x; a11 += w * n.y * n.y; a22 += w * n.z * n.z;
+		a01 += w * n.x * n.y; a02 += w * n.x * n.z; a12 += w * n.y * n.z;
+		b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& q)
+	{
+		a00 += q.a00; a11 += q.a11; a22 += q.a22;
+		a01 += q.a01; a02 += q.a02; a12 += q.a12;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	// Mean squared distance
+	double evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double r = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0.0 ? std::fabs(r) / weight : 0.0;
+	}
+};
+
+struct PositionHash
+{
+	size_t operator()(const glm::vec3& p) const
+	{
+		uint32_t bits[3];
+		std::memcpy(bits, &p, sizeof(bits));
+		return std::hash<uint64_t>()(((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u) ^ ((uint64_t)bits[2] * 83492791u));
+	}
+};
+
+static uint64_t EdgeKey(unsigned int a, unsigned int b)
+{
+	return ((uint64_t)a << 32) | b;
+}
+
+float MeshOptimizer::simplify(const Vertex* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count,
+	unsigned int target_index_count, float target_error, std::vector<unsigned int>& result)
+{
+	result.assign(indices, indices + index_count);
+	if (vertex_count == 0 || index_count % 3 != 0)
+	{
+		return 0.0f;
+	}
+
+	// Vertices at the same position are wedges of one corner, split by a uv or normal seam.
+	std::vector<unsigned int> position_ids(vertex_count);
+	std::vector<unsigned int> wedge_counts(vertex_count, 0);
+	{
+		std::unordered_map<glm::vec3, unsigned int, PositionHash> first_vertex;
+		first_vertex.reserve(vertex_count);
+		for (unsigned int v = 0; v < vertex_count; v++)
+		{
+			position_ids[v] = first_vertex.emplace(vertices[v].position, v).first->second;
+			wedge_counts[position_ids[v]]++;
+		}
+	}
+
+	std::vector<unsigned char> locked(vertex_count, 0);
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		locked[v] = wedge_counts[position_ids[v]] > 1;
+	}
+
+	// Edges without exactly one opposite edge are open borders or non manifold.
+	std::unordered_map<uint64_t, unsigned int> edges;
+	edges.reserve(index_count);
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		unsigned int a = position_ids[indices[i]];
+		unsigned int b = position_ids[indices[i - i % 3 + (i + 1) % 3]];
+		edges[EdgeKey(a, b)]++;
+	}
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		unsigned int a = indices[i];
+		unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+		auto opposite = edges.find(EdgeKey(position_ids[b], position_ids[a]));
+		if (edges[EdgeKey(position_ids[a], position_ids[b])] != 1 || opposite == edges.end() || opposite->second != 1)
+		{
+			locked[a] = locked[b] = 1;
+		}
+	}
+
+	// Kept per position, so the wedges of a locked corner share theirs.
+	std::vector<Quadric> quadrics(vertex_count);
+	for (unsigned int t = 0; t < index_count / 3; t++)
+	{
+		glm::dvec3 p0 = vertices[indices[t * 3]].position;
+		glm::dvec3 p1 = vertices[indices[t * 3 + 1]].position;
+		glm::dvec3 p2 = vertices[indices[t * 3 + 2]].position;
+
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		if (length == 0.0)
+		{
+			continue;
+		}
+
+		normal /= length;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			quadrics[position_ids[indices[t * 3 + k]]].addPlane(normal, -glm::dot(normal, p0), length * 0.5);
+		}
+	}
+
+	struct Collapse
+	{
+		unsigned int from, to;
+		float error;
+	};
+
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> offsets, adjacency, collapse_targets(vertex_count);
+	std::vector<unsigned char> touched(vertex_count);
+	double target_error_squared = (double)target_error * target_error;
+	double max_error = 0.0;
+
+	for (unsigned int v = 0; v < vertex_count; v++)
+	{
+		collapse_targets[v] = v;
+	}
+
+	// Moving from onto to must not turn any remaining triangle around from over.
+	auto flips = [&](unsigned int from, unsigned int to)
+	{
+		for (unsigned int j = offsets[from]; j < offsets[from + 1]; j++)
+		{
+			const unsigned int* triangle = result.data() + adjacency[j] * 3;
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			{
+				continue;
+			}
+
+			glm::vec3 p[3], q[3];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				p[k] = vertices[triangle[k]].position;
+				q[k] = triangle[k] == from ? vertices[to].position : p[k];
+			}
+
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// Passes of independent collapses, cheapest first, until the target count or error is reached.
+	while (result.size() > target_index_count)
+	{
+		unsigned int triangle_count = (unsigned int)result.size() / 3;
+
+		offsets.assign(vertex_count + 1, 0);
+		for (unsigned int i = 0; i < result.size(); i++)
+		{
+			offsets[result[i] + 1]++;
+		}
+		for (unsigned int v = 0; v < vertex_count; v++)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < result.size(); i++)
+		{
+			adjacency[fill[result[i]]++] = i / 3;
+		}
+
+		collapses.clear();
+		for (unsigned int i = 0; i < result.size(); i++)
+		{
+			unsigned int a = result[i];
+			unsigned int b = result[i - i % 3 + (i + 1) % 3];
+			unsigned int ends[2][2] = { { a, b }, { b, a } };
+
+			for (unsigned int e = 0; e < 2; e++)
+			{
+				unsigned int from = ends[e][0], to = ends[e][1];
+				if (locked[from])
+				{
+					continue;
+				}
+
+				Quadric quadric = quadrics[position_ids[from]];
+				quadric.add(quadrics[position_ids[to]]);
+				collapses.push_back({ from, to, (float)quadric.evaluate(vertices[to].position) });
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		std::fill(touched.begin(), touched.end(), 0);
+		unsigned int triangles_to_remove = triangle_count - target_index_count / 3;
+		unsigned int removed = 0;
+		unsigned int applied = 0;
+
+		for (unsigned int c = 0; c < collapses.size() && removed < triangles_to_remove; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			if (collapse.error > target_error_squared)
+			{
+				break;
+			}
+
+			if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to))
+			{
+				continue;
+			}
+
+			collapse_targets[collapse.from] = collapse.to;
+			quadrics[position_ids[collapse.to]].add(quadrics[position_ids[collapse.from]]);
+			max_error = std::max(max_error, (double)collapse.error);
+			applied++;
+
+			// Everything around from changes, the rest of this pass must leave it alone.
+			for (unsigned int j = offsets[collapse.from]; j < offsets[collapse.from + 1]; j++)
+			{
+				const unsigned int* triangle = result.data() + adjacency[j] * 3;
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+				}
+			}
+		}
+
+		if (applied == 0)
+		{
+			break;
+		}
+
+		unsigned int write = 0;
+		for (unsigned int t = 0; t < triangle_count; t++)
+		{
+			unsigned int a = collapse_targets[result[t * 3]];
+			unsigned int b = collapse_targets[result[t * 3 + 1]];
+			unsigned int c = collapse_targets[result[t * 3 + 2]];
+
+			if (a != b && b != c && a != c)
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+
+		for (unsigned int v = 0; v < vertex_count; v++)
+		{
+			collapse_targets[v] = v;
+		}
+	}
+
+	return (float)std::sqrt(max_error);
+}
+
+// Bounding sphere and normal cone of the triangles [first_triangle, first_triangle + triangle_count).
+static Meshlet MeshletBounds(const std::vector<Vertex>& vertices, const unsigned int* indices, unsigned int first_triangle, unsigned int triangle_count)
+{
+	Meshlet meshlet = {};
+	meshlet.index_offset = first_triangle * 3;
+	meshlet.triangle_count = triangle_count;
+
+	const unsigned int* triangles = indices + first_triangle * 3;
+
+	glm::vec3 min_v = vertices[triangles[0]].position;
+	glm::vec3 max_v = min_v;
+	for (unsigned int i = 1; i < triangle_count * 3; i++)
+	{
+		min_v = glm::min(min_v, vertices[triangles[i]].position);
+		max_v = glm::max(max_v, vertices[triangles[i]].position);
+	}
+
+	meshlet.center = (min_v + max_v) * 0.5f;
+	for (unsigned int i = 0; i < triangle_count * 3; i++)
+	{
+		meshlet.radius = std::max(meshlet.radius, glm::length(vertices[triangles[i]].position - meshlet.center));
+	}
+
+	// Degenerate triangles face nowhere and do not widen the cone.
+	glm::vec3 normals[XRE_MESHLET_MAX_TRIANGLES];
+	glm::vec3 axis = glm::vec3(0.0f);
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		const glm::vec3& p0 = vertices[triangles[t * 3]].position;
+		glm::vec3 normal = glm::cross(vertices[triangles[t * 3 + 1]].position - p0, vertices[triangles[t * 3 + 2]].position - p0);
+		float length = glm::length(normal);
+
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		axis += normals[t];
+	}
+
+	meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.cone_apex = meshlet.center;
+	meshlet.cone_cutoff = 1.0f;
+
+	float axis_length = glm::length(axis);
+	if (axis_length <= 0.0f)
+	{
+		return meshlet;
+	}
+	axis /= axis_length;
+	meshlet.cone_axis = axis;
+
+	float min_dot = 1.0f;
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (normals[t] != glm::vec3(0.0f))
+		{
+			min_dot = std::min(min_dot, glm::dot(normals[t], axis));
+		}
+	}
+
+	if (min_dot <= XRE_MESHLET_MIN_CONE_SPREAD)
+	{
+		return meshlet;
+	}
+
+	// Apex : far enough behind the center along the axis that every triangle plane faces away from it.
+	float max_t = 0.0f;
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (normals[t] != glm::vec3(0.0f))
+		{
+			const glm::vec3& p0 = vertices[triangles[t * 3]].position;
+			max_t = std::max(max_t, glm::dot(meshlet.center - p0, normals[t]) / glm::dot(axis, normals[t]));
+		}
+	}
+
+	meshlet.cone_apex = meshlet.center - axis * max_t;
+	meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+
+	return meshlet;
+}
+
+void MeshOptimizer::buildMeshlets(const std::vector<Vertex>& vertices, const unsigned int* indices, unsigned int index_count, std::vector<Meshlet>& meshlets)
+{
+	meshlets.clear();
+
+	if (vertices.empty() || index_count < 3 || index_count % 3 != 0)
+	{
+		return;
+	}
+
+	// meshlet each vertex was last added to
+	std::vector<unsigned int> vertex_meshlet(vertices.size(), ~0u);
+	unsigned int current = 0;
+
+	auto NewVertices = [&](const unsigned int* triangle)
+	{
+		unsigned int a = triangle[0], b = triangle[1], c = triangle[2];
+		return (unsigned int)(vertex_meshlet[a] != current)
+			+ (unsigned int)(vertex_meshlet[b] != current && b != a)
+			+ (unsigned int)(vertex_meshlet[c] != current && c != a && c != b);
+	};
+
+	unsigned int triangle_count = index_count / 3;
+	unsigned int first_triangle = 0;
+	unsigned int unique_vertices = 0;
+
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		const unsigned int* triangle = indices + t * 3;
+		unsigned int added = NewVertices(triangle);
+
+		if (unique_vertices + added > XRE_MESHLET_MAX_VERTICES || t - first_triangle >= XRE_MESHLET_MAX_TRIANGLES)
+		{
+			meshlets.push_back(MeshletBounds(vertices, indices, first_triangle, t - first_triangle));
+
+			current++;
+			first_triangle = t;
+			unique_vertices = 0;
+			added = NewVertices(triangle);
+		}
+
+		vertex_meshlet[triangle[0]] = current;
+		vertex_meshlet[triangle[1]] = current;
+		vertex_meshlet[triangle[2]] = current;
+		unique_vertices += added;
+	}
+
+	meshlets.push_back(MeshletBounds(vertices, indices, first_triangle, triangle_count - first_triangle));
+}
+
+void MeshOptimizer::buildLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<MeshLod>& lods)
+{
+	unsigned int full_count = (unsigned int)indices.size();
+
+	lods.clear();
+	lods.push_back({ 0, full_count, 0.0f });
+
+	if (vertices.empty() || full_count % 3 != 0)
+	{
+		return;
+	}
+
+	glm::vec3 min_v = vertices[0].position;
+	glm::vec3 max_v = vertices[0].position;
+	for (unsigned int v = 1; v < vertices.size(); v++)
+	{
+		min_v = glm::min(min_v, vertices[v].position);
+		max_v = glm::max(max_v, vertices[v].position);
+	}
+	float error_limit = glm::length(max_v - min_v) * XRE_MESH_LOD_MAX_ERROR;
+
+	std::vector<unsigned int> lod_indices;
+	for (unsigned int level = 1; level < XRE_MESH_LOD_MAX_LEVELS; level++)
+	{
+		unsigned int previous_count = lods.back().index_count;
+		unsigned int target_count = (unsigned int)(previous_count / 3 * XRE_MESH_LOD_REDUCTION) * 3;
+		if (target_count < XRE_MESH_LOD_MIN_TRIANGLES * 3)
+		{
+			break;
+		}
+
+		// Always from the full mesh, so errors do not compound through the chain.
+		float error = simplify(vertices.data(), (unsigned int)vertices.size(), indices.data(), full_count, target_count, error_limit, lod_indices);
+
+		// Locked seams or the error limit stopped it, a level that barely shrinks is not worth its indices.
+		if (lod_indices.empty() || lod_indices.size() > previous_count * 9 / 10)
+		{
+			break;
+		}
+
+		optimizeVertexCache(lod_indices.data(), (unsigned int)lod_indices.size(), (unsigned int)vertices.size());
+
+		lods.push_back({ (unsigned int)indices.size(), (unsigned int)lod_indices.size(), std::max(error, lods.back().error) });
+		indices.insert(indices.end(), lod_indices.begin(), lod_indices.end());
+	}
+}
+
+float MeshOptimizer::averageCacheMissRatio(const unsigned int* indices, unsigned int index_count, unsigned int vertex_count, unsigned int cache_size)
+{
+	if (index_count < 3)
+	{
+		return 0.0f;
+	}
+
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	unsigned int time = cache_size + 1;
+	unsigned int misses = 0;
+
+	for (unsigned int i = 0; i < index_count; i++)
+	{
+		unsigned int v = indices[i];
+		if (time - timestamps[v] > cache_size)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+
+	return (float)misses / (index_count / 3);
+}
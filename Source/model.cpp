@@ -6,6 +6,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <mesh.h>
+#include <mesh_optimizer.h>
+#include <thread_pool.h>
+#include <texture_registry.h>
 #include <image_loader.h>
 #include <shader.h>
 
@@ -17,6 +20,13 @@ using namespace xre;
 
 auto LOGGER = xre::LogModule::getLoggerInstance();
 
+// Material texture slots, in the order they are stored in the mesh cache.
+static const aiTextureType texture_slot_types[XRE_MESH_CACHE_TEXTURE_SLOTS] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_NORMALS, aiTextureType_SHININESS };
+static const char* texture_slot_names[XRE_MESH_CACHE_TEXTURE_SLOTS] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_roughness" }; // albedo, metallic, normal, roughness *PBR
+static const TEXTURE_USAGE texture_slot_usages[XRE_MESH_CACHE_TEXTURE_SLOTS] = { TEXTURE_USAGE_COLOR, TEXTURE_USAGE_MASK, TEXTURE_USAGE_NORMAL, TEXTURE_USAGE_MASK };
+// Shown while the real texture streams in : grey albedo, dielectric, flat normal, fully rough.
+static const unsigned char texture_slot_placeholders[XRE_MESH_CACHE_TEXTURE_SLOTS][4] = { { 128, 128, 128, 255 }, { 0, 0, 0, 255 }, { 128, 128, 255, 255 }, { 255, 255, 255, 255 } };
+
 Model::Model(const std::string& file_path, const std::string& name, unsigned int post_process_options)
 {
 	auto start = std::chrono::high_resolution_clock::now;
@@ -24,6 +34,21 @@ Model::Model(const std::string& file_path, const std::string& name, unsigned int
 
 	model_name = name;
 	setup_success = false;
+	scene = NULL;
+
+	dynamic = false;
+	model_matrix = glm::mat4(1.0);
+	directory = file_path.substr(0, file_path.find_last_of('/'));
+
+	source_hash = MeshCache::hashSource(file_path);
+	cache_path = MeshCache::cachePath(file_path);
+	this->post_process_options = post_process_options;
+
+	if (source_hash != 0 && loadFromCache(cache_path, source_hash, post_process_options))
+	{
+		return;
+	}
+
 	Assimp::Importer importer;
 
 	scene = importer.ReadFile(file_path, post_process_options);
@@ -34,10 +59,68 @@ Model::Model(const std::string& file_path, const std::string& name, unsigned int
 		return;
 	}
 
-	dynamic = false;
-	model_matrix = glm::mat4(1.0);
-	directory = file_path.substr(0, file_path.find_last_of('/'));
-	processNode(scene->mRootNode);
+	std::vector<aiMesh*> ai_meshes;
+	processNode(scene->mRootNode, ai_meshes);
+
+	// Meshes are extracted in parallel, GL objects are then created in one go on this thread.
+	std::vector<MeshData> extracted(ai_meshes.size());
+	std::vector<unsigned char> extracted_success(ai_meshes.size(), 0);
+
+	ThreadPool::threadPool()->parallelFor((unsigned int)ai_meshes.size(), [&](unsigned int i)
+	{
+		extracted_success[i] = extractMeshData(ai_meshes[i], extracted[i]);
+	});
+
+	std::vector<MeshData> mesh_data;
+	mesh_data.reserve(extracted.size());
+	for (unsigned int i = 0; i < extracted.size(); i++)
+	{
+		if (extracted_success[i])
+		{
+			mesh_data.push_back(std::move(extracted[i]));
+		}
+		else
+		{
+			setup_success = false;
+		}
+	}
+
+	meshes.reserve(mesh_data.size());
+	for (unsigned int i = 0; i < mesh_data.size(); i++)
+	{
+		const MeshData& data = mesh_data[i];
+		meshes.push_back(createMesh(data.vertices.data(), data.positions.data(), (unsigned int)data.vertices.size(), data.indices.data(), (unsigned int)data.indices.size(),
+			data.lods.data(), (unsigned int)data.lods.size(), data.meshlets.data(), (unsigned int)data.meshlets.size(), data.aabb, data.texture_paths));
+	}
+
+	if (source_hash != 0 && !MeshCache::write(cache_path, source_hash, post_process_options, mesh_data))
+	{
+		LOGGER->log(WARN, "Model", "Could not write mesh cache - " + cache_path);
+	}
+
+	scene = NULL;
+}
+
+bool Model::loadFromCache(const std::string& cache_path, uint64_t source_hash, unsigned int post_process_options)
+{
+	MeshCache cache;
+	if (!cache.open(cache_path, source_hash, post_process_options))
+	{
+		return false;
+	}
+
+	LOGGER->log(INFO, "Model", "Loading from mesh cache - " + cache_path);
+
+	// The buffers are uploaded straight from the mapping, which is released when the cache goes out of scope.
+	const std::vector<CachedMesh>& cached_meshes = cache.meshes();
+	meshes.reserve(cached_meshes.size());
+	for (unsigned int i = 0; i < cached_meshes.size(); i++)
+	{
+		const CachedMesh& cached = cached_meshes[i];
+		meshes.push_back(createMesh(cached.vertices, cached.positions, cached.vertex_count, cached.indices, cached.index_count, cached.lods, cached.lod_count, cached.meshlets, cached.meshlet_count, cached.aabb, cached.texture_paths));
+	}
+
+	return true;
 }
 
 void Model::draw(const Shader& model_shader, const std::string& model_name)
@@ -51,136 +134,153 @@ void Model::draw(const Shader& model_shader, const std::string& model_name)
 	}
 }
 
-void Model::processNode(aiNode* node)
+void Model::draw(const Shader& model_shader, const std::string& model_name, const glm::mat4& instance_matrix)
+{
+	for (unsigned i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i] != NULL)
+		{
+			meshes[i]->draw(model_shader, model_name, instance_matrix, dynamic);
+		}
+	}
+}
+
+void Model::processNode(aiNode* node, std::vector<aiMesh*>& ai_meshes)
 {
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
-		meshes.push_back(extractMeshData(scene->mMeshes[node->mMeshes[i]]));
+		ai_meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i]);
+		processNode(node->mChildren[i], ai_meshes);
 	}
 }
 
-Mesh* Model::extractMeshData(aiMesh* ai_mesh)
+// Runs on the thread pool, must not touch GL or any state shared between meshes.
+bool Model::extractMeshData(aiMesh* ai_mesh, MeshData& mesh_data)
 {
 	std::vector<Vertex> vertices;
-	std::vector<Texture> textures;
-	std::vector<unsigned int> indices;
+	std::vector<unsigned int>& indices = mesh_data.indices;
+
+	try
+	{
+		if (!ai_mesh->HasPositions())
+		{
+			VertexDataException e;
+			e.exception_message = "No vertex position data";
+			throw e;
+		}
+
+		if (!ai_mesh->HasNormals())
+		{
+			VertexDataException e;
+			e.exception_message = "No vertex normal data";
+			throw e;
+		}
+	}
+	catch (const VertexDataException& e)
+	{
+		LOGGER->log(ERROR, "Mesh Data Extraction", model_name + " : " + e.exception_message);
+		return false;
+	}
+
+	bool has_tex_coords = ai_mesh->HasTextureCoords(0);
+	bool has_tangents = ai_mesh->HasTangentsAndBitangents();
+
+	if (!has_tex_coords)
+	{
+		LOGGER->log(WARN, "Mesh Data Extraction", model_name + " : " + "No texture coordinates found! Texture coordinates will be set to (0 , 0)");
+	}
+
+	if (!has_tangents)
+	{
+		LOGGER->log(WARN, "Mesh Data Extraction", model_name + " : " + "Tangents data not found! Tangents and bit_tangents will be set to (0, 0, 0)");
+	}
 
 	// Vertex Data
+	vertices.resize(ai_mesh->mNumVertices);
 	for (unsigned int i = 0; i < ai_mesh->mNumVertices; i++)
 	{
-		try
+		Vertex& v = vertices[i];
+
+		// Vertex Positions
+		v.position.x = ai_mesh->mVertices[i].x;
+		v.position.y = ai_mesh->mVertices[i].y;
+		v.position.z = ai_mesh->mVertices[i].z;
+
+		// Vertex Normals
+		v.normal.x = ai_mesh->mNormals[i].x;
+		v.normal.y = ai_mesh->mNormals[i].y;
+		v.normal.z = ai_mesh->mNormals[i].z;
+
+		// Texture Coordinates
+		if (has_tex_coords)
 		{
-			Vertex v;
-
-			// Vertex Positions
-			if (ai_mesh->HasPositions())
-			{
-				v.position.x = ai_mesh->mVertices[i].x;
-				v.position.y = ai_mesh->mVertices[i].y;
-				v.position.z = ai_mesh->mVertices[i].z;
-			}
-			else
-			{
-				VertexDataException e;
-				e.exception_message = "No vertex position data";
-				throw e;
-			}
-
-			// Vertex Normals
-			if (ai_mesh->HasNormals())
-			{
-				v.normal.x = ai_mesh->mNormals[i].x;
-				v.normal.y = ai_mesh->mNormals[i].y;
-				v.normal.z = ai_mesh->mNormals[i].z;
-			}
-			else
-			{
-				VertexDataException e;
-				e.exception_message = "No vertex normal data";
-				throw e;
-			}
-
-			// Texture Coordinates
-			if (ai_mesh->HasTextureCoords(0))
-			{
-				v.tex_coords.x = ai_mesh->mTextureCoords[0][i].x;
-				v.tex_coords.y = ai_mesh->mTextureCoords[0][i].y;
-			}
-			else
-			{
-				LOGGER->log(WARN, "Mesh Data Extraction", model_name + " : " + "No texture coordinates found! Texture coordinates will be set to (0 , 0)");
-				v.tex_coords.x = 0.0f;
-				v.tex_coords.y = 0.0f;
-			}
-
-			// Tangents
-			if (ai_mesh->HasTangentsAndBitangents())
-			{
-				v.tangent.x = ai_mesh->mTangents[i].x;
-				v.tangent.y = ai_mesh->mTangents[i].y;
-				v.tangent.z = ai_mesh->mTangents[i].z;
-
-				v.bit_tangent.x = ai_mesh->mBitangents[i].x;
-				v.bit_tangent.y = ai_mesh->mBitangents[i].y;
-				v.bit_tangent.z = ai_mesh->mBitangents[i].z;
-			}
-			else
-			{
-				LOGGER->log(WARN, "Mesh Data Extraction", model_name + " : " + "Tangents data not found! Tangents and bit_tangents will be set to (0, 0, 0)");
-				v.tangent.x = v.tangent.y = v.tangent.z = 0;
-				v.bit_tangent.x = v.bit_tangent.y = v.bit_tangent.z = 0;
-			}
-
-			vertices.push_back(v);
+			v.tex_coords.x = ai_mesh->mTextureCoords[0][i].x;
+			v.tex_coords.y = ai_mesh->mTextureCoords[0][i].y;
 		}
-		catch (const VertexDataException& e)
+		else
 		{
-			LOGGER->log(ERROR, "Mesh Data Extraction", model_name + " : " + e.exception_message);
-			setup_success = false;
-			return NULL;
+			v.tex_coords.x = 0.0f;
+			v.tex_coords.y = 0.0f;
 		}
-		catch (const std::exception& e)
+
+		// Tangents
+		if (has_tangents)
 		{
-			LOGGER->log(ERROR, "Mesh Data Extraction", model_name + " : " + e.what());
-			setup_success = false;
-			return NULL;
+			v.tangent.x = ai_mesh->mTangents[i].x;
+			v.tangent.y = ai_mesh->mTangents[i].y;
+			v.tangent.z = ai_mesh->mTangents[i].z;
+
+			v.bit_tangent.x = ai_mesh->mBitangents[i].x;
+			v.bit_tangent.y = ai_mesh->mBitangents[i].y;
+			v.bit_tangent.z = ai_mesh->mBitangents[i].z;
+		}
+		else
+		{
+			v.tangent.x = v.tangent.y = v.tangent.z = 0;
+			v.bit_tangent.x = v.bit_tangent.y = v.bit_tangent.z = 0;
 		}
 	}
 
 	// Indices
+	unsigned int index_count = 0;
+	for (unsigned int i = 0; i < ai_mesh->mNumFaces; i++)
+	{
+		index_count += ai_mesh->mFaces[i].mNumIndices;
+	}
+
+	indices.resize(index_count);
+	unsigned int index = 0;
 	for (unsigned int i = 0; i < ai_mesh->mNumFaces; i++)
 	{
-		aiFace face = ai_mesh->mFaces[i];
+		const aiFace& face = ai_mesh->mFaces[i];
 		for (unsigned int j = 0; j < face.mNumIndices; j++)
 		{
-			indices.push_back(face.mIndices[j]);
+			indices[index++] = face.mIndices[j];
 		}
 	}
 
-	aiMaterial* material = scene->mMaterials[ai_mesh->mMaterialIndex];
-
-	LOGGER->log(INFO, "LOAD TEXTURE", "Loading diffuse texture.");
-	Texture diffuse_texture = loadTextureFromPath(material, aiTextureType_DIFFUSE, "texture_diffuse"); // albedo *PBR
-	textures.push_back(diffuse_texture);
-
-	LOGGER->log(INFO, "LOAD TEXTURE", "Loading specular texture.");
-	Texture specular_texture = loadTextureFromPath(material, aiTextureType_SPECULAR, "texture_specular"); // metallic *PBR
-	textures.push_back(specular_texture);
-
-	LOGGER->log(INFO, "LOAD TEXTURE", "Loading normal texture.");
-	Texture normal_texture = loadTextureFromPath(material, aiTextureType_NORMALS, "texture_normal"); // normal
-	textures.push_back(normal_texture);
+	// Reordered, clustered and simplified once here, the cache keeps the optimized order, the meshlets and the levels of detail.
+	if ((ai_mesh->mPrimitiveTypes & ~aiPrimitiveType_NGONEncodingFlag) == aiPrimitiveType_TRIANGLE)
+	{
+		MeshOptimizer::optimize(vertices, indices);
+		MeshOptimizer::buildMeshlets(vertices, indices.data(), (unsigned int)indices.size(), mesh_data.meshlets);
+		MeshOptimizer::buildLods(vertices, indices, mesh_data.lods);
+	}
 
-	LOGGER->log(INFO, "LOAD TEXTURE", "Loading roughness texture.");
-	Texture roughness_texture = loadTextureFromPath(material, aiTextureType_SHININESS, "texture_roughness"); // roughness *PBR
-	textures.push_back(roughness_texture);
+	// Texture paths are stored, the textures themselves are loaded by createMesh.
+	aiMaterial* material = scene->mMaterials[ai_mesh->mMaterialIndex];
+	for (unsigned int t = 0; t < XRE_MESH_CACHE_TEXTURE_SLOTS; t++)
+	{
+		aiString str;
+		material->GetTexture(texture_slot_types[t], 0, &str);
+		mesh_data.texture_paths[t] = str.C_Str();
+	}
 
-	BoundingVolume aabb;
+	BoundingVolume& aabb = mesh_data.aabb;
 	aabb.max_v.x = ai_mesh->mAABB.mMax.x;
 	aabb.max_v.y = ai_mesh->mAABB.mMax.y;
 	aabb.max_v.z = ai_mesh->mAABB.mMax.z;
@@ -189,95 +289,73 @@ Mesh* Model::extractMeshData(aiMesh* ai_mesh)
 	aabb.min_v.y = ai_mesh->mAABB.mMin.y;
 	aabb.min_v.z = ai_mesh->mAABB.mMin.z;
 
-	return new Mesh(vertices, indices, textures, aabb);
+	// Quantized here rather than on the GL thread, the cache stores the GPU layout.
+	Mesh::compress(vertices.data(), (unsigned int)vertices.size(), aabb, mesh_data.vertices, mesh_data.positions);
+
+	return true;
 }
 
-Texture Model::loadTextureFromPath(aiMaterial* material, aiTextureType texture_type, const std::string& texture_type_name)
+Mesh* Model::createMesh(const CompactVertex* vertices, const glm::u16vec4* positions, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count, const MeshLod* lods, unsigned int lod_count,
+	const Meshlet* meshlets, unsigned int meshlet_count, const BoundingVolume& aabb, const std::string* texture_paths)
 {
-	Texture t;
-
-	aiString str;
-	material->GetTexture(texture_type, 0, &str);
-
-	bool skip = false;
-	for (unsigned int i = 0; i < loaded_textures.size(); i++)
-	{
-		if (std::strcmp(loaded_textures[i].path.data(), str.C_Str()) == 0)
-		{
-			t = loaded_textures[i];
-			skip = true;
-			break;
-		}
-	}
-	if (!skip)
+	std::vector<Texture> textures;
+	for (unsigned int t = 0; t < XRE_MESH_CACHE_TEXTURE_SLOTS; t++)
 	{
-		t.id = GetTexture(str.C_Str(), texture_type == aiTextureType_DIFFUSE);
-		t.type = texture_type_name;
-		t.path = str.C_Str();
-		loaded_textures.push_back(t);
+		LOGGER->log(INFO, "LOAD TEXTURE", std::string("Loading ") + texture_slot_names[t] + ".");
+		textures.push_back(loadTexture(texture_paths[t], texture_slot_names[t], texture_slot_usages[t], texture_slot_placeholders[t]));
 	}
 
+	return new Mesh(vertices, positions, vertex_count, indices, index_count, textures, aabb, lods, lod_count, meshlets, meshlet_count);
+}
+
+Texture Model::loadTexture(const std::string& texture_path, const std::string& texture_type_name, TEXTURE_USAGE usage, const unsigned char placeholder[4])
+{
+	Texture t;
+	t.id = GetTexture(texture_path, usage, placeholder);
+	t.type = texture_type_name;
+	t.path = texture_path;
+
+	// One entry per acquisition, each is released once by releaseTextures.
+	loaded_textures.push_back(t);
+
 	return t;
 }
 
-unsigned int Model::GetTexture(const std::string& texture_path, bool gamma)
+unsigned int Model::GetTexture(const std::string& texture_path, TEXTURE_USAGE usage, const unsigned char placeholder[4])
 {
 	std::string file_path = directory + '/' + texture_path;
 
 	LOGGER->log(DEBUG, "LOAD TEXTURE", texture_path + " : " + file_path);
 
-	unsigned int texture_id;
-	glGenTextures(1, &texture_id);
-
-	int texture_width, texture_height, num_channels;
-	unsigned char* data = stbi_load(file_path.c_str(), &texture_width, &texture_height, &num_channels, 0);
+	// Shared with every other model using the same image, decoded and uploaded in the background.
+	return TextureRegistry::registry()->acquire(file_path, usage, placeholder);
+}
 
-	if (data)
+void Model::releaseTextures()
+{
+	for (unsigned int i = 0; i < loaded_textures.size(); i++)
 	{
-		unsigned int internal_format;
-		unsigned int format = GL_RGB;
-
-		if (num_channels == 1)
-		{
-			format = GL_RED;
-			internal_format = GL_COMPRESSED_RED;
-		}
+		TextureRegistry::registry()->release(loaded_textures[i].id);
+	}
+	loaded_textures.clear();
+}
 
-		else if (num_channels == 3)
-		{
-			format = GL_RGB;
-			internal_format = GL_COMPRESSED_SRGB;
-		}
+bool Model::openMeshCache(MeshCache& cache) const
+{
+	return source_hash != 0 && cache.open(cache_path, source_hash, post_process_options);
+}
 
-		else if (num_channels == 4)
+void Model::releaseMeshes()
+{
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i] != NULL)
 		{
-			format = GL_RGBA;
-			internal_format = GL_COMPRESSED_RGBA;
-
-			if (gamma)
-			{
-				internal_format = GL_COMPRESSED_SRGB_ALPHA;
-			}
+			meshes[i]->release();
+			delete meshes[i];
 		}
-
-
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture_width, texture_height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 16);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		LOGGER->log(xre::ERROR, "LOAD TEXTURE", "Failed to create texture : " + std::string(texture_path) + " : " + stbi_failure_reason());
-		stbi_image_free(data);
 	}
-
-	return texture_id;
+	meshes.clear();
 }
 
 void Model::translate(glm::vec3 translation)
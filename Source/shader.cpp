@@ -10,12 +10,26 @@
 #include <iostream>
 #include <string>
 #include <tuple>
+#include <algorithm>
+#include <cstring>
 
 static auto LOGGER = xre::LogModule::getLoggerInstance();
 
 using namespace xre;
 
-Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path, const char* geometry_shader_path)
+static std::string addDefines(const std::string& shader_code, const std::string& defines)
+{
+	size_t version = shader_code.find("#version");
+	size_t line_end = version == std::string::npos ? std::string::npos : shader_code.find('\n', version);
+	if (defines.empty() || line_end == std::string::npos)
+	{
+		return shader_code;
+	}
+
+	return shader_code.substr(0, line_end + 1) + defines + shader_code.substr(line_end + 1);
+}
+
+Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path, const char* geometry_shader_path, const std::string& defines)
 {
 	shader_program_id = glCreateProgram();
 
@@ -32,7 +46,7 @@ Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path,
 
 		vertex_shader_stream << vertex_shader_file.rdbuf();
 		vertex_shader_file.close();
-		vertex_shader_code = vertex_shader_stream.str();
+		vertex_shader_code = addDefines(vertex_shader_stream.str(), defines);
 
 		LOGGER->log(xre::INFO, "SHADER : FRAGMENT", "Reading - " + std::string(fragment_shader_path));
 		fragment_shader_file.open(fragment_shader_path);
@@ -40,7 +54,7 @@ Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path,
 
 		fragment_shader_stream << fragment_shader_file.rdbuf();
 		fragment_shader_file.close();
-		fragment_shader_code = fragment_shader_stream.str();
+		fragment_shader_code = addDefines(fragment_shader_stream.str(), defines);
 
 		//LOGGER->log(xre::INFO, type, "Shader read successful!");
 	}
@@ -84,7 +98,7 @@ Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path,
 
 			geometry_shader_stream << geometry_shader_file.rdbuf();
 			geometry_shader_file.close();
-			geometry_shader_code = geometry_shader_stream.str();
+			geometry_shader_code = addDefines(geometry_shader_stream.str(), defines);
 		}
 		catch (std::ifstream::failure& e)
 		{
@@ -105,6 +119,7 @@ Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path,
 	glLinkProgram(shader_program_id);
 
 	checkCompileErrors(shader_program_id, "PROGRAM");
+	introspectUniforms();
 
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
@@ -113,12 +128,223 @@ Shader::Shader(const char* vertex_shader_path, const char* fragment_shader_path,
 		glDeleteShader(geometry_shader);
 }
 
-void Shader::setBool(std::string uniform_name, bool value) const { glUniform1i(glGetUniformLocation(shader_program_id, uniform_name.c_str()), value); }
-void Shader::setInt(std::string uniform_name, int value) const { glUniform1i(glGetUniformLocation(shader_program_id, uniform_name.c_str()), value); }
-void Shader::setFloat(std::string uniform_name, float value)const { glUniform1f(glGetUniformLocation(shader_program_id, uniform_name.c_str()), value); }
-void Shader::setMat4(std::string uniform_name, glm::mat4 value) const { glUniformMatrix4fv(glGetUniformLocation(shader_program_id, uniform_name.c_str()), 1, GL_FALSE, glm::value_ptr(value)); }
-void Shader::setVec3(std::string uniform_name, glm::vec3 value) const { glUniform3fv(glGetUniformLocation(shader_program_id, uniform_name.c_str()), 1, glm::value_ptr(value)); }
-void Shader::setVec4(std::string uniform_name, glm::vec4 value) const { glUniform4fv(glGetUniformLocation(shader_program_id, uniform_name.c_str()), 1, glm::value_ptr(value)); }
+Shader::Shader(const char* compute_shader_path)
+{
+	shader_program_id = glCreateProgram();
+
+	std::string compute_shader_code;
+	std::ifstream compute_shader_file;
+
+	compute_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try
+	{
+		LOGGER->log(xre::INFO, "SHADER : COMPUTE", "Reading - " + std::string(compute_shader_path));
+		compute_shader_file.open(compute_shader_path);
+		std::stringstream compute_shader_stream;
+
+		compute_shader_stream << compute_shader_file.rdbuf();
+		compute_shader_file.close();
+		compute_shader_code = compute_shader_stream.str();
+	}
+	catch (std::ifstream::failure& e)
+	{
+		LOGGER->log(xre::ERROR, "SHADER : COMPUTE", "Failed to read shader file : " + std::string(e.what()));
+		return;
+	}
+
+	const char* c_compute_shader_code = compute_shader_code.c_str();
+
+	unsigned int compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute_shader, 1, &c_compute_shader_code, NULL);
+	glCompileShader(compute_shader);
+	checkCompileErrors(compute_shader, "SHADER");
+
+	glAttachShader(shader_program_id, compute_shader);
+	glLinkProgram(shader_program_id);
+
+	checkCompileErrors(shader_program_id, "PROGRAM");
+	introspectUniforms();
+
+	glDeleteShader(compute_shader);
+}
+
+// FNV-1a, offset by the seed of the table
+static uint32_t hashUniformName(std::string_view name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+	for (char c : name)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void Shader::introspectUniforms()
+{
+	GLint active_uniforms = 0, max_length = 0;
+	glGetProgramiv(shader_program_id, GL_ACTIVE_UNIFORMS, &active_uniforms);
+	glGetProgramiv(shader_program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+	std::vector<char> name_buffer(max_length + 1);
+	for (GLint i = 0; i < active_uniforms; ++i)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(shader_program_id, i, max_length + 1, &length, &size, &type, name_buffer.data());
+		std::string name(name_buffer.data(), length);
+
+		// Arrays are reported once, as "name[0]", with their size.
+		bool is_array = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+		if (is_array)
+			name.resize(name.size() - 3);
+
+		int first = static_cast<int>(uniforms.size());
+		for (GLint element = 0; element < (is_array ? size : 1); ++element)
+		{
+			std::string element_name = is_array ? name + "[" + std::to_string(element) + "]" : name;
+
+			UniformRecord record;
+			record.location = glGetUniformLocation(shader_program_id, element_name.c_str());
+			record.elements = is_array ? size - element : 1;
+			uniforms.push_back(record);
+			uniform_names.emplace_back(std::move(element_name), first + element);
+		}
+
+		// Uniform block members have no location.
+		if (uniforms[first].location == -1)
+		{
+			uniforms.resize(first);
+			while (!uniform_names.empty() && uniform_names.back().second >= first)
+				uniform_names.pop_back();
+			continue;
+		}
+
+		if (is_array)
+			uniform_names.emplace_back(name, first);
+	}
+
+	buildUniformTable();
+}
+
+void Shader::buildUniformTable()
+{
+	size_t table_size = 1;
+	while (table_size < uniform_names.size() * 2)
+		table_size <<= 1;
+
+	// A handful of uniforms per program, a collision free seed turns up within a few tries. Past that the table
+	// grows, which makes one likelier still.
+	for (uniform_hash_seed = 0;; ++uniform_hash_seed)
+	{
+		if (uniform_hash_seed == 64)
+		{
+			uniform_hash_seed = 0;
+			table_size <<= 1;
+		}
+
+		uniform_table.assign(table_size, -1);
+		bool collision = false;
+		for (size_t i = 0; i < uniform_names.size() && !collision; ++i)
+		{
+			int& slot = uniform_table[hashUniformName(uniform_names[i].first, uniform_hash_seed) & (table_size - 1)];
+			collision = slot != -1;
+			slot = static_cast<int>(i);
+		}
+
+		if (!collision)
+			break;
+	}
+}
+
+int Shader::uniform(std::string_view uniform_name) const
+{
+	if (uniform_table.empty())
+		return -1;
+
+	int entry = uniform_table[hashUniformName(uniform_name, uniform_hash_seed) & (uniform_table.size() - 1)];
+	if (entry == -1 || uniform_names[entry].first != uniform_name)
+		return -1;
+
+	return uniform_names[entry].second;
+}
+
+int Shader::uniform(std::string_view array_name, unsigned int element) const
+{
+	int first = uniform(array_name);
+	if (first == -1 || element >= static_cast<unsigned int>(uniforms[first].elements))
+		return -1;
+
+	return first + element;
+}
+
+bool Shader::valueChanged(int uniform, const void* value, size_t size) const
+{
+	if (uniform < 0 || uniform >= static_cast<int>(uniforms.size()))
+		return false;
+
+	UniformRecord& record = uniforms[uniform];
+	if (record.cached && memcmp(record.value, value, size) == 0)
+		return false;
+
+	memcpy(record.value, value, size);
+	record.cached = true;
+	return true;
+}
+
+void Shader::setBool(std::string_view uniform_name, bool value) const { setBool(uniform(uniform_name), value); }
+void Shader::setInt(std::string_view uniform_name, int value) const { setInt(uniform(uniform_name), value); }
+void Shader::setUInt(std::string_view uniform_name, unsigned int value) const { setUInt(uniform(uniform_name), value); }
+void Shader::setFloat(std::string_view uniform_name, float value) const { setFloat(uniform(uniform_name), value); }
+void Shader::setMat3(std::string_view uniform_name, const glm::mat3& value) const { setMat3(uniform(uniform_name), value); }
+void Shader::setMat4(std::string_view uniform_name, const glm::mat4& value) const { setMat4(uniform(uniform_name), value); }
+void Shader::setIVec2(std::string_view uniform_name, const glm::ivec2& value) const { setIVec2(uniform(uniform_name), value); }
+void Shader::setVec2(std::string_view uniform_name, const glm::vec2& value) const { setVec2(uniform(uniform_name), value); }
+void Shader::setVec3(std::string_view uniform_name, const glm::vec3& value) const { setVec3(uniform(uniform_name), value); }
+void Shader::setVec4(std::string_view uniform_name, const glm::vec4& value) const { setVec4(uniform(uniform_name), value); }
+
+void Shader::setBool(int uniform, bool value) const { setInt(uniform, static_cast<int>(value)); }
+void Shader::setInt(int uniform, int value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform1i(shader_program_id, uniforms[uniform].location, value); }
+void Shader::setUInt(int uniform, unsigned int value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform1ui(shader_program_id, uniforms[uniform].location, value); }
+void Shader::setFloat(int uniform, float value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform1f(shader_program_id, uniforms[uniform].location, value); }
+void Shader::setMat3(int uniform, const glm::mat3& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniformMatrix3fv(shader_program_id, uniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value)); }
+void Shader::setMat4(int uniform, const glm::mat4& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniformMatrix4fv(shader_program_id, uniforms[uniform].location, 1, GL_FALSE, glm::value_ptr(value)); }
+void Shader::setIVec2(int uniform, const glm::ivec2& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform2iv(shader_program_id, uniforms[uniform].location, 1, glm::value_ptr(value)); }
+void Shader::setVec2(int uniform, const glm::vec2& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform2fv(shader_program_id, uniforms[uniform].location, 1, glm::value_ptr(value)); }
+void Shader::setVec3(int uniform, const glm::vec3& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform3fv(shader_program_id, uniforms[uniform].location, 1, glm::value_ptr(value)); }
+void Shader::setVec4(int uniform, const glm::vec4& value) const { if (valueChanged(uniform, &value, sizeof(value))) glProgramUniform4fv(shader_program_id, uniforms[uniform].location, 1, glm::value_ptr(value)); }
+
+void Shader::setVec4(int uniform, const glm::vec4* values, int count) const
+{
+	if (uniform < 0)
+		return;
+
+	count = std::min(count, uniforms[uniform].elements);
+
+	// Every element is compared, so that all of their caches are kept up to date.
+	bool changed = false;
+	for (int i = 0; i < count; ++i)
+		changed |= valueChanged(uniform + i, &values[i], sizeof(glm::vec4));
+
+	if (changed)
+		glProgramUniform4fv(shader_program_id, uniforms[uniform].location, count, glm::value_ptr(values[0]));
+}
+
+void Shader::setMat4(int uniform, const glm::mat4* values, int count) const
+{
+	if (uniform < 0)
+		return;
+
+	count = std::min(count, uniforms[uniform].elements);
+
+	bool changed = false;
+	for (int i = 0; i < count; ++i)
+		changed |= valueChanged(uniform + i, &values[i], sizeof(glm::mat4));
+
+	if (changed)
+		glProgramUniformMatrix4fv(shader_program_id, uniforms[uniform].location, count, GL_FALSE, glm::value_ptr(values[0]));
+}
 
 void Shader::checkCompileErrors(unsigned int& shader, const std::string& type)
 {
@@ -0,0 +1,161 @@
+#include <static_batcher.h>
+#include <logger.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+StaticBatcher::~StaticBatcher()
+{
+	for (unsigned int i = 0; i < m_batches.size(); i++)
+	{
+		m_batches[i]->release();
+		delete m_batches[i];
+	}
+}
+
+// Tangent frames of degenerate vertices stay zero instead of turning into NaNs.
+static glm::vec3 TransformDirection(const glm::mat3& matrix, const glm::vec3& direction)
+{
+	glm::vec3 transformed = matrix * direction;
+	float length = glm::length(transformed);
+	return length > 0.0f ? transformed / length : glm::vec3(0.0f);
+}
+
+bool StaticBatcher::add(Model& model)
+{
+	if (model.dynamic)
+	{
+		LOGGER->log(WARN, "StaticBatcher : add", "Dynamic models are not batched.");
+		return false;
+	}
+
+	MeshCache cache;
+	const std::vector<Mesh*>& meshes = model.getMeshes();
+	if (!model.openMeshCache(cache) || cache.meshes().size() != meshes.size())
+	{
+		LOGGER->log(WARN, "StaticBatcher : add", "Model has no usable mesh cache, it is not batched.");
+		return false;
+	}
+
+	const glm::mat4& transform = model.model_matrix;
+	glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	// Mirroring transforms turn the triangles around, the winding is swapped back
+	bool mirrored = glm::determinant(glm::mat3(transform)) < 0.0f;
+
+	for (unsigned int m = 0; m < meshes.size(); m++)
+	{
+		const CachedMesh& cached = cache.meshes()[m];
+		if (meshes[m] == NULL || cached.vertex_count == 0 || cached.index_count % 3 != 0)
+		{
+			continue;
+		}
+
+		std::vector<unsigned int> key;
+		for (const Texture& texture : meshes[m]->textures)
+		{
+			key.push_back(texture.id);
+		}
+
+		PendingBatch& batch = m_pending[key];
+		if (batch.textures.empty())
+		{
+			batch.textures = meshes[m]->textures;
+		}
+
+		Submesh submesh;
+		submesh.base_vertex = (int)batch.vertices.size();
+		submesh.first_lod = (unsigned int)batch.lods.size();
+		submesh.lod_count = std::max(cached.lod_count, 1u);
+
+		submesh.aabb.min_v = glm::vec3(std::numeric_limits<float>::max());
+		submesh.aabb.max_v = glm::vec3(-std::numeric_limits<float>::max());
+
+		for (unsigned int v = 0; v < cached.vertex_count; v++)
+		{
+			Vertex vertex = Mesh::decompress(cached.vertices[v], cached.aabb);
+			vertex.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+			vertex.normal = TransformDirection(normal_matrix, vertex.normal);
+			vertex.tangent = TransformDirection(glm::mat3(transform), vertex.tangent);
+			vertex.bit_tangent = TransformDirection(glm::mat3(transform), vertex.bit_tangent);
+
+			submesh.aabb.min_v = glm::min(submesh.aabb.min_v, vertex.position);
+			submesh.aabb.max_v = glm::max(submesh.aabb.max_v, vertex.position);
+			batch.vertices.push_back(vertex);
+		}
+
+		unsigned int index_base = (unsigned int)batch.indices.size();
+		batch.indices.insert(batch.indices.end(), cached.indices, cached.indices + cached.index_count);
+		if (mirrored)
+		{
+			for (unsigned int i = index_base; i < batch.indices.size(); i += 3)
+			{
+				std::swap(batch.indices[i + 1], batch.indices[i + 2]);
+			}
+		}
+
+		if (cached.lod_count == 0)
+		{
+			batch.lods.push_back({ index_base, cached.index_count, 0.0f });
+		}
+
+		// errors were measured in object space
+		for (unsigned int l = 0; l < cached.lod_count; l++)
+		{
+			batch.lods.push_back({ index_base + cached.lods[l].index_offset, cached.lods[l].index_count, cached.lods[l].error * scale });
+		}
+
+		batch.submeshes.push_back(submesh);
+	}
+
+	model.releaseMeshes();
+	return true;
+}
+
+void StaticBatcher::build()
+{
+	unsigned int submesh_count = 0;
+
+	for (auto& entry : m_pending)
+	{
+		PendingBatch& batch = entry.second;
+		if (batch.vertices.empty())
+		{
+			continue;
+		}
+
+		BoundingVolume aabb = batch.submeshes[0].aabb;
+		for (const Submesh& submesh : batch.submeshes)
+		{
+			aabb.min_v = glm::min(aabb.min_v, submesh.aabb.min_v);
+			aabb.max_v = glm::max(aabb.max_v, submesh.aabb.max_v);
+		}
+
+		m_batches.push_back(new Mesh(batch.vertices.data(), (unsigned int)batch.vertices.size(), batch.indices.data(), (unsigned int)batch.indices.size(),
+			batch.textures, aabb, batch.lods.data(), (unsigned int)batch.lods.size(), NULL, 0, batch.submeshes.data(), (unsigned int)batch.submeshes.size()));
+
+		submesh_count += (unsigned int)batch.submeshes.size();
+	}
+
+	m_pending.clear();
+
+	LOGGER->log(INFO, "StaticBatcher : build", std::to_string(submesh_count) + " meshes merged into " + std::to_string(m_batches.size()) + " batches.");
+}
+
+void StaticBatcher::draw(const Shader& shader, const std::string& name)
+{
+	for (unsigned int i = 0; i < m_batches.size(); i++)
+	{
+		m_batches[i]->draw(shader, name, m_model_matrix, false);
+	}
+}
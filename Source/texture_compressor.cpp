@@ -0,0 +1,608 @@
+#include <texture_compressor.h>
+#include <mesh_cache.h>
+#include <logger.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+#pragma region DDS
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC_DX10 0x30315844 // "DX10"
+#define DDS_XRE_MAGIC 0x54455258 // "XRET", stored in the reserved words
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+#define DXGI_FORMAT_BC1_UNORM 71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC3_UNORM 77
+#define DXGI_FORMAT_BC3_UNORM_SRGB 78
+#define DXGI_FORMAT_BC4_UNORM 80
+#define DXGI_FORMAT_BC5_UNORM 83
+#define D3D10_RESOURCE_DIMENSION_TEXTURE2D 3
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourcc;
+	uint32_t rgb_bit_count;
+	uint32_t r_mask, g_mask, b_mask, a_mask;
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitch_or_linear_size;
+	uint32_t depth;
+	uint32_t mip_map_count;
+	uint32_t reserved1[11]; // [0] XRE magic, [1] version, [2..3] source hash, [4] usage
+	DDSPixelFormat pixel_format;
+	uint32_t caps, caps2, caps3, caps4;
+	uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgi_format;
+	uint32_t resource_dimension;
+	uint32_t misc_flag;
+	uint32_t array_size;
+	uint32_t misc_flags2;
+};
+
+static uint32_t FormatToDXGI(GLenum internal_format)
+{
+	switch (internal_format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return DXGI_FORMAT_BC1_UNORM;
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT: return DXGI_FORMAT_BC1_UNORM_SRGB;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return DXGI_FORMAT_BC3_UNORM;
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return DXGI_FORMAT_BC3_UNORM_SRGB;
+	case GL_COMPRESSED_RED_RGTC1: return DXGI_FORMAT_BC4_UNORM;
+	case GL_COMPRESSED_RG_RGTC2: return DXGI_FORMAT_BC5_UNORM;
+	default: return 0;
+	}
+}
+
+static GLenum DXGIToFormat(uint32_t dxgi_format, unsigned int& block_size)
+{
+	switch (dxgi_format)
+	{
+	case DXGI_FORMAT_BC1_UNORM: block_size = 8; return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case DXGI_FORMAT_BC1_UNORM_SRGB: block_size = 8; return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+	case DXGI_FORMAT_BC3_UNORM: block_size = 16; return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case DXGI_FORMAT_BC3_UNORM_SRGB: block_size = 16; return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+	case DXGI_FORMAT_BC4_UNORM: block_size = 8; return GL_COMPRESSED_RED_RGTC1;
+	case DXGI_FORMAT_BC5_UNORM: block_size = 16; return GL_COMPRESSED_RG_RGTC2;
+	default: block_size = 0; return 0;
+	}
+}
+
+static size_t LevelSize(int width, int height, unsigned int block_size)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_size;
+}
+
+#pragma endregion
+
+#pragma region Mip Generation
+
+static float SRGBToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char ToUnorm8(float v)
+{
+	v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+// 2x2 box filter. Colour is averaged in linear space, normals are averaged as vectors and renormalized.
+static void Downsample(const std::vector<unsigned char>& source, int width, int height, TEXTURE_USAGE usage, std::vector<unsigned char>& destination, int& mip_width, int& mip_height)
+{
+	// Function local static, initialized once even with several workers compressing.
+	static const std::vector<float> srgb_to_linear = []()
+	{
+		std::vector<float> table(256);
+		for (int i = 0; i < 256; i++)
+		{
+			table[i] = SRGBToLinear(i / 255.0f);
+		}
+		return table;
+	}();
+
+	mip_width = width > 1 ? width / 2 : 1;
+	mip_height = height > 1 ? height / 2 : 1;
+	destination.resize((size_t)mip_width * mip_height * 4);
+
+	for (int y = 0; y < mip_height; y++)
+	{
+		int y0 = y * 2;
+		int y1 = y0 + 1 < height ? y0 + 1 : y0;
+
+		for (int x = 0; x < mip_width; x++)
+		{
+			int x0 = x * 2;
+			int x1 = x0 + 1 < width ? x0 + 1 : x0;
+
+			const unsigned char* texels[4] =
+			{
+				&source[((size_t)y0 * width + x0) * 4], &source[((size_t)y0 * width + x1) * 4],
+				&source[((size_t)y1 * width + x0) * 4], &source[((size_t)y1 * width + x1) * 4]
+			};
+			unsigned char* out = &destination[((size_t)y * mip_width + x) * 4];
+
+			if (usage == TEXTURE_USAGE_COLOR)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					float sum = 0.0f;
+					for (int t = 0; t < 4; t++)
+					{
+						sum += srgb_to_linear[texels[t][c]];
+					}
+					out[c] = ToUnorm8(LinearToSRGB(sum * 0.25f));
+				}
+				out[3] = (unsigned char)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+			}
+			else if (usage == TEXTURE_USAGE_NORMAL)
+			{
+				glm::vec3 sum(0.0f);
+				for (int t = 0; t < 4; t++)
+				{
+					sum += glm::vec3(texels[t][0], texels[t][1], texels[t][2]) / 127.5f - 1.0f;
+				}
+				glm::vec3 n = glm::length(sum) > 0.0001f ? glm::normalize(sum) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+				out[0] = ToUnorm8(n.x * 0.5f + 0.5f);
+				out[1] = ToUnorm8(n.y * 0.5f + 0.5f);
+				out[2] = ToUnorm8(n.z * 0.5f + 0.5f);
+				out[3] = 255;
+			}
+			else
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					out[c] = (unsigned char)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+#pragma endregion
+
+#pragma region Block Encoders
+
+static void WriteU16(unsigned char* out, uint16_t v)
+{
+	out[0] = (unsigned char)(v & 0xFF);
+	out[1] = (unsigned char)(v >> 8);
+}
+
+static uint16_t PackRGB565(const glm::vec3& c)
+{
+	glm::vec3 q = glm::clamp(c / 255.0f, 0.0f, 1.0f);
+	uint16_t r = (uint16_t)(q.r * 31.0f + 0.5f);
+	uint16_t g = (uint16_t)(q.g * 63.0f + 0.5f);
+	uint16_t b = (uint16_t)(q.b * 31.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec3 UnpackRGB565(uint16_t v)
+{
+	return glm::vec3(((v >> 11) & 31) * 255.0f / 31.0f, ((v >> 5) & 63) * 255.0f / 63.0f, (v & 31) * 255.0f / 31.0f);
+}
+
+// Single channel block, 8 value mode. Shared by BC3 alpha, BC4 and BC5.
+static void EncodeBC4Block(const unsigned char values[16], unsigned char* out)
+{
+	unsigned char min_v = 255, max_v = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		min_v = values[i] < min_v ? values[i] : min_v;
+		max_v = values[i] > max_v ? values[i] : max_v;
+	}
+
+	out[0] = max_v;
+	out[1] = min_v;
+
+	uint64_t indices = 0;
+	if (max_v != min_v)
+	{
+		int palette[8];
+		palette[0] = max_v;
+		palette[1] = min_v;
+		for (int i = 2; i < 8; i++)
+		{
+			palette[i] = ((8 - i) * max_v + (i - 1) * min_v + 3) / 7;
+		}
+
+		for (int t = 0; t < 16; t++)
+		{
+			int best = 0, best_error = 256;
+			for (int i = 0; i < 8; i++)
+			{
+				int error = std::abs(palette[i] - values[t]);
+				if (error < best_error)
+				{
+					best_error = error;
+					best = i;
+				}
+			}
+			indices |= (uint64_t)best << (3 * t);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		out[2 + i] = (unsigned char)((indices >> (8 * i)) & 0xFF);
+	}
+}
+
+// Endpoints from the extremes along the principal axis of the block colours, always 4 colour mode.
+static void EncodeBC1Block(const unsigned char rgba[64], unsigned char* out)
+{
+	glm::vec3 colors[16];
+	glm::vec3 mean(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		colors[i] = glm::vec3(rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+		mean += colors[i];
+	}
+	mean /= 16.0f;
+
+	glm::mat3 covariance(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		glm::vec3 d = colors[i] - mean;
+		covariance += glm::outerProduct(d, d);
+	}
+
+	glm::vec3 axis(1.0f);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 next = covariance * axis;
+		float length = glm::length(next);
+		if (length < 0.0001f)
+		{
+			break;
+		}
+		axis = next / length;
+	}
+
+	float min_t = 1e30f, max_t = -1e30f;
+	glm::vec3 min_c = colors[0], max_c = colors[0];
+	for (int i = 0; i < 16; i++)
+	{
+		float t = glm::dot(colors[i] - mean, axis);
+		if (t < min_t)
+		{
+			min_t = t;
+			min_c = colors[i];
+		}
+		if (t > max_t)
+		{
+			max_t = t;
+			max_c = colors[i];
+		}
+	}
+
+	uint16_t c0 = PackRGB565(max_c);
+	uint16_t c1 = PackRGB565(min_c);
+	if (c0 < c1)
+	{
+		uint16_t swap = c0;
+		c0 = c1;
+		c1 = swap;
+	}
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		glm::vec3 palette[4];
+		palette[0] = UnpackRGB565(c0);
+		palette[1] = UnpackRGB565(c1);
+		palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+		palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+
+		for (int t = 0; t < 16; t++)
+		{
+			int best = 0;
+			float best_error = 1e30f;
+			for (int i = 0; i < 4; i++)
+			{
+				glm::vec3 d = palette[i] - colors[t];
+				float error = glm::dot(d, d);
+				if (error < best_error)
+				{
+					best_error = error;
+					best = i;
+				}
+			}
+			indices |= (uint32_t)best << (2 * t);
+		}
+	}
+
+	WriteU16(out, c0);
+	WriteU16(out + 2, c1);
+	for (int i = 0; i < 4; i++)
+	{
+		out[4 + i] = (unsigned char)((indices >> (8 * i)) & 0xFF);
+	}
+}
+
+static void EncodeLevel(const std::vector<unsigned char>& rgba, int width, int height, GLenum internal_format, unsigned int block_size, std::vector<unsigned char>& blocks)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	blocks.resize(LevelSize(width, height, block_size));
+
+	for (int by = 0; by < blocks_y; by++)
+	{
+		for (int bx = 0; bx < blocks_x; bx++)
+		{
+			// Edge blocks of small or odd sized levels repeat the last texel.
+			unsigned char block[64];
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+					std::memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+				}
+			}
+
+			unsigned char* out = &blocks[((size_t)by * blocks_x + bx) * block_size];
+			unsigned char channel[16];
+
+			switch (internal_format)
+			{
+			case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+				EncodeBC1Block(block, out);
+				break;
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+				for (int i = 0; i < 16; i++) channel[i] = block[i * 4 + 3];
+				EncodeBC4Block(channel, out);
+				EncodeBC1Block(block, out + 8);
+				break;
+			case GL_COMPRESSED_RG_RGTC2:
+				for (int i = 0; i < 16; i++) channel[i] = block[i * 4 + 0];
+				EncodeBC4Block(channel, out);
+				for (int i = 0; i < 16; i++) channel[i] = block[i * 4 + 1];
+				EncodeBC4Block(channel, out + 8);
+				break;
+			default: // GL_COMPRESSED_RED_RGTC1
+				for (int i = 0; i < 16; i++) channel[i] = block[i * 4 + 0];
+				EncodeBC4Block(channel, out);
+				break;
+			}
+		}
+	}
+}
+
+#pragma endregion
+
+std::string TextureCompressor::cachePath(const std::string& source_path, TEXTURE_USAGE usage)
+{
+	static const char* usage_suffixes[] = { ".color", ".normal", ".mask" };
+	return source_path + usage_suffixes[usage] + XRE_TEXTURE_CACHE_EXTENSION;
+}
+
+void TextureCompressor::compress(const unsigned char* rgba, int width, int height, TEXTURE_USAGE usage, CompressedTexture& texture)
+{
+	switch (usage)
+	{
+	case TEXTURE_USAGE_COLOR:
+	{
+		bool translucent = false;
+		for (size_t i = 0; i < (size_t)width * height && !translucent; i++)
+		{
+			translucent = rgba[i * 4 + 3] < 255;
+		}
+		texture.internal_format = translucent ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+		texture.block_size = translucent ? 16 : 8;
+		break;
+	}
+	case TEXTURE_USAGE_NORMAL:
+		texture.internal_format = GL_COMPRESSED_RG_RGTC2;
+		texture.block_size = 16;
+		break;
+	default:
+		texture.internal_format = GL_COMPRESSED_RED_RGTC1;
+		texture.block_size = 8;
+		break;
+	}
+
+	texture.widths.clear();
+	texture.heights.clear();
+	texture.levels.clear();
+
+	std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4);
+	std::vector<unsigned char> next_level;
+
+	while (true)
+	{
+		texture.widths.push_back(width);
+		texture.heights.push_back(height);
+		texture.levels.emplace_back();
+		EncodeLevel(level, width, height, texture.internal_format, texture.block_size, texture.levels.back());
+
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+
+		Downsample(level, width, height, usage, next_level, width, height);
+		level.swap(next_level);
+	}
+}
+
+bool TextureCompressor::readCache(const std::string& cache_path, uint64_t source_hash, TEXTURE_USAGE usage, CompressedTexture& texture)
+{
+	MappedFile file;
+	if (!file.open(cache_path))
+	{
+		return false;
+	}
+
+	const unsigned char* data = file.data();
+	size_t size = file.size();
+	size_t offset = sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+
+	if (size < offset)
+	{
+		return false;
+	}
+
+	uint32_t magic;
+	DDSHeader header;
+	DDSHeaderDX10 header_dx10;
+	std::memcpy(&magic, data, sizeof(uint32_t));
+	std::memcpy(&header, data + sizeof(uint32_t), sizeof(DDSHeader));
+	std::memcpy(&header_dx10, data + sizeof(uint32_t) + sizeof(DDSHeader), sizeof(DDSHeaderDX10));
+
+	uint64_t cached_hash = ((uint64_t)header.reserved1[3] << 32) | header.reserved1[2];
+
+	if (magic != DDS_MAGIC || header.pixel_format.fourcc != DDS_FOURCC_DX10 || header.reserved1[0] != DDS_XRE_MAGIC
+		|| header.reserved1[1] != XRE_TEXTURE_CACHE_VERSION || header.reserved1[4] != (uint32_t)usage || cached_hash != source_hash)
+	{
+		LOGGER->log(INFO, "TextureCompressor : readCache", "Cache is stale, rebuilding " + cache_path);
+		return false;
+	}
+
+	texture.internal_format = DXGIToFormat(header_dx10.dxgi_format, texture.block_size);
+	if (texture.internal_format == 0 || header.mip_map_count == 0 || header.width == 0 || header.height == 0)
+	{
+		LOGGER->log(ERROR, "TextureCompressor : readCache", "Corrupt cache " + cache_path);
+		return false;
+	}
+
+	texture.widths.clear();
+	texture.heights.clear();
+	texture.levels.clear();
+
+	int width = (int)header.width;
+	int height = (int)header.height;
+	for (uint32_t level = 0; level < header.mip_map_count; level++)
+	{
+		size_t level_size = LevelSize(width, height, texture.block_size);
+		if (offset + level_size > size)
+		{
+			LOGGER->log(ERROR, "TextureCompressor : readCache", "Corrupt cache " + cache_path);
+			return false;
+		}
+
+		texture.widths.push_back(width);
+		texture.heights.push_back(height);
+		texture.levels.emplace_back(data + offset, data + offset + level_size);
+		offset += level_size;
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return true;
+}
+
+bool TextureCompressor::writeCache(const std::string& cache_path, uint64_t source_hash, TEXTURE_USAGE usage, const CompressedTexture& texture)
+{
+	if (texture.levels.empty())
+	{
+		return false;
+	}
+
+	uint32_t magic = DDS_MAGIC;
+
+	DDSHeader header;
+	std::memset(&header, 0, sizeof(DDSHeader));
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = (uint32_t)texture.heights[0];
+	header.width = (uint32_t)texture.widths[0];
+	header.pitch_or_linear_size = (uint32_t)texture.levels[0].size();
+	header.mip_map_count = (uint32_t)texture.levels.size();
+	header.reserved1[0] = DDS_XRE_MAGIC;
+	header.reserved1[1] = XRE_TEXTURE_CACHE_VERSION;
+	header.reserved1[2] = (uint32_t)(source_hash & 0xFFFFFFFF);
+	header.reserved1[3] = (uint32_t)(source_hash >> 32);
+	header.reserved1[4] = (uint32_t)usage;
+	header.pixel_format.size = sizeof(DDSPixelFormat);
+	header.pixel_format.flags = DDPF_FOURCC;
+	header.pixel_format.fourcc = DDS_FOURCC_DX10;
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+	DDSHeaderDX10 header_dx10;
+	header_dx10.dxgi_format = FormatToDXGI(texture.internal_format);
+	header_dx10.resource_dimension = D3D10_RESOURCE_DIMENSION_TEXTURE2D;
+	header_dx10.misc_flag = 0;
+	header_dx10.array_size = 1;
+	header_dx10.misc_flags2 = 0;
+
+	// Unique per writer, so that concurrent decodes never share a temporary file.
+	static std::atomic<unsigned int> temp_counter{ 0 };
+	std::string temp_path = cache_path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "."
+		+ std::to_string(temp_counter++) + ".tmp";
+	FILE* file = std::fopen(temp_path.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	bool success = std::fwrite(&magic, sizeof(uint32_t), 1, file) == 1
+		&& std::fwrite(&header, sizeof(DDSHeader), 1, file) == 1
+		&& std::fwrite(&header_dx10, sizeof(DDSHeaderDX10), 1, file) == 1;
+
+	for (unsigned int i = 0; i < texture.levels.size() && success; i++)
+	{
+		success = std::fwrite(texture.levels[i].data(), 1, texture.levels[i].size(), file) == texture.levels[i].size();
+	}
+
+	success = (std::fclose(file) == 0) && success;
+
+	if (success)
+	{
+		std::remove(cache_path.c_str());
+		success = std::rename(temp_path.c_str(), cache_path.c_str()) == 0;
+	}
+
+	if (!success)
+	{
+		std::remove(temp_path.c_str());
+	}
+
+	return success;
+}
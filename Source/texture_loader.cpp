@@ -0,0 +1,571 @@
+#include <texture_loader.h>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <thread_pool.h>
+#include <mesh_cache.h>
+#include <logger.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+AsyncTextureLoader::AsyncTextureLoader()
+	: m_decoded(std::make_shared<DecodeQueue>()), m_decoding(0), m_frame(0), m_memory_budget(XRE_TEXTURE_MEMORY_BUDGET),
+	  m_allocated_bytes(0), m_reserved_bytes(0), m_staging_buffer(0), m_staging_memory(NULL), m_segment(0)
+{
+	for (unsigned int i = 0; i < XRE_TEXTURE_STAGING_SEGMENTS; i++)
+	{
+		m_segment_fences[i] = NULL;
+	}
+}
+
+AsyncTextureLoader* AsyncTextureLoader::loader()
+{
+	if (instance == nullptr)
+	{
+		instance = std::unique_ptr<AsyncTextureLoader>(new AsyncTextureLoader());
+	}
+	return instance.get();
+}
+
+void AsyncTextureLoader::createStagingBuffer()
+{
+	GLsizeiptr size = (GLsizeiptr)XRE_TEXTURE_UPLOAD_BUDGET * XRE_TEXTURE_STAGING_SEGMENTS;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &m_staging_buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging_buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+	m_staging_memory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (m_staging_memory == NULL)
+	{
+		LOGGER->log(ERROR, "AsyncTextureLoader : createStagingBuffer", "Failed to map the texture staging buffer.");
+	}
+}
+
+unsigned int AsyncTextureLoader::load(const std::string& file_path, TEXTURE_USAGE usage, const unsigned char placeholder[4])
+{
+	unsigned int texture_id;
+	glGenTextures(1, &texture_id);
+
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 16);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_residency[texture_id] = TEXTURE_PENDING;
+	m_decoding++;
+
+	auto texture = std::make_shared<DecodedTexture>();
+	texture->texture_id = texture_id;
+	texture->file_path = file_path;
+	texture->usage = usage;
+
+	// The queue is shared with the task so a late decode never touches a destroyed loader.
+	std::shared_ptr<DecodeQueue> decoded = m_decoded;
+	ThreadPool::threadPool()->submit([texture, decoded]
+	{
+		decode(*texture);
+
+		std::lock_guard<std::mutex> lock(decoded->mutex);
+		decoded->textures.push_back(texture);
+	});
+
+	return texture_id;
+}
+
+void AsyncTextureLoader::decode(DecodedTexture& texture)
+{
+	uint64_t source_hash = MeshCache::hashFile(texture.file_path);
+	std::string cache_path = TextureCompressor::cachePath(texture.file_path, texture.usage);
+
+	if (source_hash != 0 && TextureCompressor::readCache(cache_path, source_hash, texture.usage, texture.image))
+	{
+		texture.success = true;
+		return;
+	}
+
+	int width, height, channels;
+	unsigned char* data = stbi_load(texture.file_path.c_str(), &width, &height, &channels, 4);
+
+	if (!data)
+	{
+		LOGGER->log(ERROR, "LOAD TEXTURE", "Failed to create texture : " + texture.file_path + " : " + stbi_failure_reason());
+		texture.success = false;
+		return;
+	}
+
+	TextureCompressor::compress(data, width, height, texture.usage, texture.image);
+	stbi_image_free(data);
+
+	if (source_hash != 0 && !TextureCompressor::writeCache(cache_path, source_hash, texture.usage, texture.image))
+	{
+		LOGGER->log(WARN, "LOAD TEXTURE", "Could not write texture cache - " + cache_path);
+	}
+
+	texture.success = true;
+}
+
+void AsyncTextureLoader::update()
+{
+	if (m_decoding == 0 && m_textures.empty())
+	{
+		m_frame++;
+		return;
+	}
+
+	if (m_staging_buffer == 0)
+	{
+		createStagingBuffer();
+	}
+
+	receiveDecodedTextures();
+	updateTargetLevels();
+
+	for (auto& element : m_textures)
+	{
+		streamOut(element.first, element.second);
+	}
+
+	// Never stall: if the GPU is still reading this segment, try again next frame.
+	GLsync& fence = m_segment_fences[m_segment];
+	bool segment_free = m_staging_memory != NULL;
+	if (segment_free && fence != NULL)
+	{
+		GLenum wait_result = glClientWaitSync(fence, 0, 0);
+		segment_free = wait_result != GL_TIMEOUT_EXPIRED && wait_result != GL_WAIT_FAILED;
+		if (segment_free)
+		{
+			glDeleteSync(fence);
+			fence = NULL;
+		}
+	}
+
+	size_t used = 0;
+	if (segment_free)
+	{
+		// Textures still showing their placeholder first, then by screen size.
+		std::vector<std::pair<float, unsigned int>> order;
+		for (auto& element : m_textures)
+		{
+			StreamedTexture& texture = element.second;
+			if (texture.resident_level > texture.target_level)
+			{
+				bool placeholder = texture.resident_level == (int)texture.decoded->image.levels.size();
+				order.push_back({ placeholder ? INFINITY : texture.priority, element.first });
+			}
+		}
+		std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+		size_t segment_offset = (size_t)m_segment * XRE_TEXTURE_UPLOAD_BUDGET;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging_buffer);
+
+		for (unsigned int i = 0; i < order.size(); i++)
+		{
+			if (!streamIn(order[i].second, m_textures[order[i].second], segment_offset, used))
+			{
+				break;
+			}
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	for (auto& element : m_textures)
+	{
+		const StreamedTexture& texture = element.second;
+		if (texture.resident_level == (int)texture.decoded->image.levels.size())
+		{
+			m_residency[element.first] = TEXTURE_PENDING;
+		}
+		else
+		{
+			m_residency[element.first] = texture.resident_level > texture.target_level ? TEXTURE_STREAMING : TEXTURE_RESIDENT;
+		}
+	}
+
+	if (used > 0)
+	{
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_segment = (m_segment + 1) % XRE_TEXTURE_STAGING_SEGMENTS;
+	}
+
+	m_frame++;
+}
+
+void AsyncTextureLoader::receiveDecodedTextures()
+{
+	std::lock_guard<std::mutex> lock(m_decoded->mutex);
+
+	for (unsigned int i = 0; i < m_decoded->textures.size(); i++)
+	{
+		std::shared_ptr<DecodedTexture>& decoded = m_decoded->textures[i];
+		unsigned int texture_id = decoded->texture_id;
+		m_decoding--;
+
+		auto destroyed = m_destroyed.find(texture_id);
+		if (destroyed != m_destroyed.end())
+		{
+			glDeleteTextures(1, &texture_id);
+			m_residency.erase(texture_id);
+			m_destroyed.erase(destroyed);
+			continue;
+		}
+
+		if (!decoded->success)
+		{
+			m_residency[texture_id] = TEXTURE_FAILED;
+			m_pinned.erase(texture_id);
+			continue;
+		}
+
+		const CompressedTexture& image = decoded->image;
+		int level_count = (int)image.levels.size();
+
+		// Finest level that still fits the always resident size.
+		int coarse_level = level_count - 1;
+		while (coarse_level > 0 && std::max(image.widths[coarse_level - 1], image.heights[coarse_level - 1]) <= XRE_TEXTURE_STREAMING_MIN_SIZE)
+		{
+			coarse_level--;
+		}
+
+		StreamedTexture texture;
+		texture.decoded = decoded;
+		texture.coarse_level = coarse_level;
+		texture.resident_level = level_count;
+		texture.target_level = coarse_level;
+		texture.requested_level = coarse_level;
+		texture.last_request_frame = m_frame;
+		texture.target_request_frame = m_frame;
+		texture.pinned = m_pinned.erase(texture_id) > 0;
+
+		m_textures[texture_id] = texture;
+	}
+
+	m_decoded->textures.clear();
+}
+
+void AsyncTextureLoader::requestScreenSize(unsigned int texture_id, float screen_size)
+{
+	auto element = m_textures.find(texture_id);
+	if (element == m_textures.end())
+	{
+		return;
+	}
+
+	StreamedTexture& texture = element->second;
+	const CompressedTexture& image = texture.decoded->image;
+
+	// One texel per pixel at the requested level, sharpened by the bias.
+	float texture_size = (float)std::max(image.widths[0], image.heights[0]);
+	int level = texture.coarse_level;
+	if (screen_size > 0.0f)
+	{
+		level = (int)std::floor(std::log2(texture_size / screen_size)) - XRE_TEXTURE_STREAMING_MIP_BIAS;
+		level = std::max(0, std::min(level, texture.coarse_level));
+	}
+
+	if (texture.last_request_frame != m_frame)
+	{
+		texture.requested_level = level;
+		texture.priority = screen_size;
+	}
+	else
+	{
+		texture.requested_level = std::min(texture.requested_level, level);
+		texture.priority = std::max(texture.priority, screen_size);
+	}
+	texture.last_request_frame = m_frame;
+}
+
+void AsyncTextureLoader::updateTargetLevels()
+{
+	std::vector<std::pair<float, unsigned int>> order;
+	size_t total_bytes = m_reserved_bytes;
+
+	for (auto& element : m_textures)
+	{
+		StreamedTexture& texture = element.second;
+
+		// pinned levels still count, the others make room for them
+		if (texture.pinned)
+		{
+			texture.target_level = 0;
+			total_bytes += levelBytes(texture.decoded->image, 0);
+			continue;
+		}
+
+		// Finer levels come in right away, coarser ones only once the finer ones went unrequested for
+		// XRE_TEXTURE_STREAMING_KEEP_FRAMES, so that levels do not thrash as the camera moves.
+		bool requested = texture.last_request_frame == m_frame;
+		if (!requested)
+		{
+			texture.priority = 0.0f;
+		}
+
+		if (requested && texture.requested_level <= texture.target_level)
+		{
+			texture.target_level = texture.requested_level;
+			texture.target_request_frame = m_frame;
+		}
+		else if (m_frame - texture.target_request_frame > XRE_TEXTURE_STREAMING_KEEP_FRAMES)
+		{
+			texture.target_level = requested ? texture.requested_level : texture.coarse_level;
+			texture.target_request_frame = m_frame;
+		}
+
+		total_bytes += levelBytes(texture.decoded->image, texture.target_level);
+		order.push_back({ texture.priority, element.first });
+	}
+
+	if (total_bytes <= m_memory_budget)
+	{
+		return;
+	}
+
+	// Over budget : drop the finest mip of the smallest textures on screen first, one level per pass.
+	std::sort(order.begin(), order.end());
+
+	bool dropped = true;
+	while (total_bytes > m_memory_budget && dropped)
+	{
+		dropped = false;
+		for (unsigned int i = 0; i < order.size() && total_bytes > m_memory_budget; i++)
+		{
+			StreamedTexture& texture = m_textures[order[i].second];
+			if (texture.target_level < texture.coarse_level)
+			{
+				total_bytes -= texture.decoded->image.levels[texture.target_level].size();
+				texture.target_level++;
+				dropped = true;
+			}
+		}
+	}
+}
+
+void AsyncTextureLoader::streamOut(unsigned int texture_id, StreamedTexture& texture)
+{
+	const CompressedTexture& image = texture.decoded->image;
+	bool partial = texture.uploading_level >= 0 && texture.uploading_level < texture.target_level;
+	bool resident = texture.resident_level < texture.target_level;
+
+	if (!partial && !resident)
+	{
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+
+	// A zero sized level releases its memory.
+	if (partial)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, texture.uploading_level, image.internal_format, 0, 0, 0, 0, NULL);
+		texture.allocated_bytes -= image.levels[texture.uploading_level].size();
+		m_allocated_bytes -= image.levels[texture.uploading_level].size();
+		texture.uploading_level = -1;
+		texture.uploaded_rows = 0;
+	}
+
+	if (resident)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.target_level);
+		for (int level = texture.resident_level; level < texture.target_level; level++)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, image.internal_format, 0, 0, 0, 0, NULL);
+			texture.allocated_bytes -= image.levels[level].size();
+			m_allocated_bytes -= image.levels[level].size();
+		}
+		texture.resident_level = texture.target_level;
+	}
+}
+
+bool AsyncTextureLoader::streamIn(unsigned int texture_id, StreamedTexture& texture, size_t segment_offset, size_t& used)
+{
+	const CompressedTexture& image = texture.decoded->image;
+	int level_count = (int)image.levels.size();
+
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+
+	// Coarse to fine, slices are whole rows of 4x4 blocks.
+	while (texture.resident_level > texture.target_level)
+	{
+		int level = texture.resident_level - 1;
+		int width = image.widths[level];
+		int height = image.heights[level];
+		int block_rows = (height + 3) / 4;
+		size_t row_size = (size_t)((width + 3) / 4) * image.block_size;
+
+		if (texture.uploading_level != level)
+		{
+			// Allocated without data, the rows arrive through the staging ring.
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, image.internal_format, width, height, 0, (GLsizei)image.levels[level].size(), NULL);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging_buffer);
+
+			texture.allocated_bytes += image.levels[level].size();
+			m_allocated_bytes += image.levels[level].size();
+			texture.uploading_level = level;
+			texture.uploaded_rows = 0;
+		}
+
+		size_t offset = (used + 15) & ~(size_t)15;
+		if (offset >= XRE_TEXTURE_UPLOAD_BUDGET)
+		{
+			return false;
+		}
+
+		size_t rows_left = (size_t)(block_rows - texture.uploaded_rows);
+		size_t rows_fit = (XRE_TEXTURE_UPLOAD_BUDGET - offset) / row_size;
+		int rows = (int)(rows_left < rows_fit ? rows_left : rows_fit);
+		if (rows == 0)
+		{
+			return false;
+		}
+
+		int y = texture.uploaded_rows * 4;
+		int slice_height = rows * 4 < height - y ? rows * 4 : height - y;
+		size_t slice_size = rows * row_size;
+
+		std::memcpy(m_staging_memory + segment_offset + offset, image.levels[level].data() + texture.uploaded_rows * row_size, slice_size);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, slice_height, image.internal_format, (GLsizei)slice_size, (void*)(segment_offset + offset));
+
+		used = offset + slice_size;
+		texture.uploaded_rows += rows;
+
+		if (texture.uploaded_rows == block_rows)
+		{
+			// The first complete level replaces the placeholder.
+			if (texture.resident_level == level_count)
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+			texture.resident_level = level;
+			texture.uploading_level = -1;
+			texture.uploaded_rows = 0;
+		}
+	}
+
+	return true;
+}
+
+size_t AsyncTextureLoader::levelBytes(const CompressedTexture& image, int first_level)
+{
+	size_t bytes = 0;
+	for (unsigned int i = first_level; i < image.levels.size(); i++)
+	{
+		bytes += image.levels[i].size();
+	}
+	return bytes;
+}
+
+void AsyncTextureLoader::destroy(unsigned int texture_id)
+{
+	if (residency(texture_id) == TEXTURE_PENDING && m_textures.find(texture_id) == m_textures.end())
+	{
+		m_destroyed.insert(texture_id);
+		return;
+	}
+
+	auto element = m_textures.find(texture_id);
+	if (element != m_textures.end())
+	{
+		m_allocated_bytes -= element->second.allocated_bytes;
+		m_textures.erase(element);
+	}
+
+	glDeleteTextures(1, &texture_id);
+	m_residency.erase(texture_id);
+	m_pinned.erase(texture_id);
+}
+
+void AsyncTextureLoader::pin(unsigned int texture_id, bool pinned)
+{
+	auto element = m_textures.find(texture_id);
+	if (element != m_textures.end())
+	{
+		element->second.pinned = pinned;
+	}
+	else if (pinned && residency(texture_id) == TEXTURE_PENDING)
+	{
+		m_pinned.insert(texture_id);
+	}
+	else
+	{
+		m_pinned.erase(texture_id);
+	}
+}
+
+bool AsyncTextureLoader::complete(unsigned int texture_id) const
+{
+	auto element = m_textures.find(texture_id);
+	if (element == m_textures.end())
+	{
+		return residency(texture_id) == TEXTURE_RESIDENT; // not created by the loader
+	}
+	return element->second.resident_level == 0;
+}
+
+TEXTURE_RESIDENCY AsyncTextureLoader::residency(unsigned int texture_id) const
+{
+	auto element = m_residency.find(texture_id);
+	if (element == m_residency.end())
+	{
+		return TEXTURE_RESIDENT; // not created by the loader
+	}
+	return element->second;
+}
+
+bool AsyncTextureLoader::translucent(unsigned int texture_id) const
+{
+	auto element = m_textures.find(texture_id);
+	if (element == m_textures.end())
+	{
+		return false;
+	}
+
+	GLenum internal_format = element->second.decoded->image.internal_format;
+	return internal_format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT || internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+size_t AsyncTextureLoader::textureBytes(unsigned int texture_id) const
+{
+	auto element = m_textures.find(texture_id);
+	return element == m_textures.end() ? 0 : element->second.allocated_bytes;
+}
+
+bool AsyncTextureLoader::idle() const
+{
+	if (m_decoding > 0)
+	{
+		return false;
+	}
+
+	for (const auto& element : m_textures)
+	{
+		if (element.second.resident_level > element.second.target_level)
+		{
+			return false;
+		}
+	}
+	return true;
+}
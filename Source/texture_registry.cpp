@@ -0,0 +1,123 @@
+#include <texture_registry.h>
+#include <texture_loader.h>
+#include <logger.h>
+
+#include <string>
+#include <vector>
+#include <cctype>
+
+static auto LOGGER = xre::LogModule::getLoggerInstance();
+
+using namespace xre;
+
+TextureRegistry* TextureRegistry::registry()
+{
+	if (instance == nullptr)
+	{
+		instance = std::unique_ptr<TextureRegistry>(new TextureRegistry());
+	}
+	return instance.get();
+}
+
+// Forward slashes, no empty or "." segments, ".." folded into its parent. Lower case on Windows,
+// where the file system ignores case.
+std::string TextureRegistry::normalizePath(const std::string& file_path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	bool absolute = !file_path.empty() && (file_path[0] == '/' || file_path[0] == '\\');
+
+	for (size_t i = 0; i <= file_path.size(); i++)
+	{
+		char c = i < file_path.size() ? file_path[i] : '/';
+		if (c != '/' && c != '\\')
+		{
+#ifdef _WIN32
+			c = (char)std::tolower((unsigned char)c);
+#endif
+			segment += c;
+			continue;
+		}
+
+		if (segment == "..")
+		{
+			if (!segments.empty() && segments.back() != "..")
+			{
+				segments.pop_back();
+			}
+			else if (!absolute)
+			{
+				segments.push_back(segment);
+			}
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	std::string normalized = absolute ? "/" : "";
+	for (unsigned int i = 0; i < segments.size(); i++)
+	{
+		normalized += (i > 0 ? "/" : "") + segments[i];
+	}
+
+	return normalized;
+}
+
+unsigned int TextureRegistry::acquire(const std::string& file_path, TEXTURE_USAGE usage, const unsigned char placeholder[4])
+{
+	// The same image used as albedo and as a mask is encoded differently, so usage is part of the key.
+	std::string key = normalizePath(file_path) + '|' + std::to_string((int)usage);
+
+	Entry& entry = m_entries[key];
+	if (entry.references == 0)
+	{
+		entry.texture_id = AsyncTextureLoader::loader()->load(file_path, usage, placeholder);
+		m_keys[entry.texture_id] = key;
+	}
+	else
+	{
+		LOGGER->log(DEBUG, "TextureRegistry : acquire", "Sharing " + key);
+	}
+
+	entry.references++;
+	return entry.texture_id;
+}
+
+void TextureRegistry::release(unsigned int texture_id)
+{
+	auto key = m_keys.find(texture_id);
+	if (key == m_keys.end())
+	{
+		LOGGER->log(WARN, "TextureRegistry : release", "Texture " + std::to_string(texture_id) + " is not owned by the registry.");
+		return;
+	}
+
+	auto entry = m_entries.find(key->second);
+	if (--entry->second.references == 0)
+	{
+		AsyncTextureLoader::loader()->destroy(texture_id);
+		m_entries.erase(entry);
+		m_keys.erase(key);
+	}
+}
+
+TextureRegistryStats TextureRegistry::stats() const
+{
+	TextureRegistryStats stats;
+	AsyncTextureLoader* texture_loader = AsyncTextureLoader::loader();
+
+	for (const auto& entry : m_entries)
+	{
+		size_t texture_bytes = texture_loader->textureBytes(entry.second.texture_id);
+
+		stats.texture_count++;
+		stats.reference_count += entry.second.references;
+		stats.resident_bytes += texture_bytes;
+		stats.shared_bytes += texture_bytes * (entry.second.references - 1);
+	}
+
+	return stats;
+}
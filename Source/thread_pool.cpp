@@ -0,0 +1,127 @@
+#include <thread_pool.h>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+using namespace xre;
+
+ThreadPool::ThreadPool(unsigned int worker_count)
+	: m_stop(false)
+{
+	for (unsigned int i = 0; i < worker_count; i++)
+	{
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_stop = true;
+	}
+	m_queue_condition.notify_all();
+
+	for (unsigned int i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+ThreadPool* ThreadPool::threadPool()
+{
+	if (instance == nullptr)
+	{
+		// Leave one core to the GL thread.
+		unsigned int hardware_threads = std::thread::hardware_concurrency();
+		unsigned int worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+
+		instance = std::unique_ptr<ThreadPool>(new ThreadPool(worker_count));
+	}
+	return instance.get();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_queue_mutex);
+			m_queue_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+
+			if (m_stop && m_tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_tasks.push(std::move(task));
+	}
+	m_queue_condition.notify_one();
+}
+
+void ThreadPool::parallelFor(unsigned int count, const std::function<void(unsigned int)>& task)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Indices are handed out through a shared counter, so helpers that only start after the caller has
+	// finished everything simply find no work left. The state outlives this call for them.
+	struct ParallelForState
+	{
+		std::atomic<unsigned int> next_index{ 0 };
+		std::atomic<unsigned int> completed{ 0 };
+		unsigned int count = 0;
+		std::function<void(unsigned int)> task;
+		std::mutex done_mutex;
+		std::condition_variable done_condition;
+	};
+
+	auto state = std::make_shared<ParallelForState>();
+	state->count = count;
+	state->task = task;
+
+	auto Run = [](const std::shared_ptr<ParallelForState>& state)
+	{
+		unsigned int index;
+		while ((index = state->next_index.fetch_add(1)) < state->count)
+		{
+			state->task(index);
+
+			if (state->completed.fetch_add(1) + 1 == state->count)
+			{
+				std::lock_guard<std::mutex> lock(state->done_mutex);
+				state->done_condition.notify_all();
+			}
+		}
+	};
+
+	unsigned int helper_count = count - 1 < workerCount() ? count - 1 : workerCount();
+	for (unsigned int i = 0; i < helper_count; i++)
+	{
+		submit([state, Run] { Run(state); });
+	}
+
+	Run(state);
+
+	std::unique_lock<std::mutex> lock(state->done_mutex);
+	state->done_condition.wait(lock, [&state] { return state->completed.load() == state->count; });
+}